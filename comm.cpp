@@ -28,6 +28,8 @@
  * or implied, of the University of Lugano.
  */
 
+#include <algorithm>
+
 #include "comm.hpp"
 #include "log.hpp"
 #include "memory.hpp"
@@ -43,8 +45,22 @@ mexico::Comm::Comm(Instance* ptr, MPI_Comm i_comm)
 
     MEXICO_WRITE(Log::DEBUG, "nprocs = %d, myrank = %d", nprocs, myrank);
 
-    alltoallv_send_displs = memory->alloc_int(nprocs);
-    alltoallv_recv_displs = memory->alloc_int(nprocs);
+    /// Allocated on first use in alltoallv()
+    alltoallv_send_displs = 0;
+    alltoallv_recv_displs = 0;
+
+    counts_round = 0;
+
+    /// Allocated on first use in ranks_in_MPI_COMM_WORLD()
+    world_ranks = 0;
+}
+
+mexico::Comm::~Comm()
+{
+    /// The lazily allocated arrays are zero if they were never used
+    memory->free_int(&world_ranks);
+    memory->free_int(&alltoallv_recv_displs);
+    memory->free_int(&alltoallv_send_displs);
 }
 
 void mexico::Comm::alltoall(void* sendbuf, int sendcnt, MPI_Datatype sendtype, 
@@ -54,9 +70,166 @@ void mexico::Comm::alltoall(void* sendbuf, int sendcnt, MPI_Datatype sendtype,
                  recvbuf, recvcnt, recvtype, comm);
 }
 
+int mexico::Comm::isend_counts(int* sendcnts, int tag, MPI_Request* req, bool sync)
+{
+    int w, n;
+
+    n = 0;
+    for(w = 0; w < nprocs; ++w)
+        if(sendcnts[w] > 0)
+        {
+            if(sync)
+                MPI_Issend(&sendcnts[w], 1, MPI_INT, w, tag, comm, &req[n++]);
+            else
+                MPI_Isend (&sendcnts[w], 1, MPI_INT, w, tag, comm, &req[n++]);
+        }
+
+    return n;
+}
+
+void mexico::Comm::alltoall_counts_nbx(int* sendcnts, int* recvcnts)
+{
+    MPI_Request* req;
+    MPI_Request barrier;
+    MPI_Status status;
+    int n, tag, flag, done;
+    bool barrier_active;
+
+    /// Tags 0 to 2 are used by the runtime implementations. A processing 
+    /// element which left the barrier can already send the counts of the 
+    /// next call while others are still probing, hence the alternating tag
+    tag = 3 + (counts_round++)%2;
+
+    std::fill(recvcnts, recvcnts+nprocs, 0);
+
+    req = (MPI_Request* )memory->alloc_char(count_positive(sendcnts, sendcnts+nprocs)*sizeof(MPI_Request));
+    n   = isend_counts(sendcnts, tag, req, true);
+
+    barrier_active = false;
+    done = 0;
+
+    while(!done)
+    {
+        MPI_Iprobe(MPI_ANY_SOURCE, tag, comm, &flag, &status);
+        if(flag)
+            MPI_Recv(&recvcnts[status.MPI_SOURCE], 1, MPI_INT, status.MPI_SOURCE, tag, comm, MPI_STATUS_IGNORE);
+
+        if(barrier_active)
+            MPI_Test(&barrier, &done, MPI_STATUS_IGNORE);
+        else
+        {
+            /// The synchronous sends complete once they are matched
+            MPI_Testall(n, req, &flag, MPI_STATUSES_IGNORE);
+            if(flag)
+            {
+                MPI_Ibarrier(comm, &barrier);
+                barrier_active = true;
+            }
+        }
+    }
+
+    memory->free_char((char** )&req);
+}
+
+void mexico::Comm::alltoallv_nbx(int* sendbuf, int* sendcnts, int* senddispls,
+                                  int** recvbuf, int* recvcnts, int* recvdispls)
+{
+    MPI_Request* req;
+    MPI_Request barrier;
+    MPI_Status status;
+    int w, n, tag, flag, done, cnt, total;
+    bool barrier_active;
+
+    /// See alltoall_counts_nbx()
+    tag = 3 + (counts_round++)%2;
+
+    std::fill(recvcnts, recvcnts+nprocs, 0);
+    std::fill(recvdispls, recvdispls+nprocs, 0);
+
+    req = (MPI_Request* )memory->alloc_char(count_positive(sendcnts, sendcnts+nprocs)*sizeof(MPI_Request));
+
+    n = 0;
+    for(w = 0; w < nprocs; ++w)
+        if(sendcnts[w] > 0)
+            MPI_Issend(&sendbuf[senddispls[w]], sendcnts[w], MPI_INT, w, tag, comm, &req[n++]);
+
+    barrier_active = false;
+    done  = 0;
+    total = 0;
+
+    while(!done)
+    {
+        MPI_Iprobe(MPI_ANY_SOURCE, tag, comm, &flag, &status);
+        if(flag)
+        {
+            MPI_Get_count(&status, MPI_INT, &cnt);
+
+            memory->realloc_int(recvbuf, total + cnt);
+            MPI_Recv(&(*recvbuf)[total], cnt, MPI_INT, status.MPI_SOURCE, tag, comm, MPI_STATUS_IGNORE);
+
+            recvcnts  [status.MPI_SOURCE] = cnt;
+            recvdispls[status.MPI_SOURCE] = total;
+            total += cnt;
+        }
+
+        if(barrier_active)
+            MPI_Test(&barrier, &done, MPI_STATUS_IGNORE);
+        else
+        {
+            MPI_Testall(n, req, &flag, MPI_STATUSES_IGNORE);
+            if(flag)
+            {
+                MPI_Ibarrier(comm, &barrier);
+                barrier_active = true;
+            }
+        }
+    }
+
+    memory->free_char((char** )&req);
+}
+
+void mexico::Comm::alltoall_counts_reduce_scatter(int* sendcnts, int* recvcnts)
+{
+    MPI_Request* req;
+    MPI_Status status;
+    int* flags;
+    int i, w, n, tag, num_srcs, cnt;
+
+    tag = 3 + (counts_round++)%2;
+
+    std::fill(recvcnts, recvcnts+nprocs, 0);
+
+    flags = memory->alloc_int(nprocs);
+    for(w = 0; w < nprocs; ++w)
+        flags[w] = (sendcnts[w] > 0);
+
+    MPI_Reduce_scatter_block(flags, &num_srcs, 1, MPI_INT, MPI_SUM, comm);
+
+    memory->free_int(&flags);
+
+    req = (MPI_Request* )memory->alloc_char(count_positive(sendcnts, sendcnts+nprocs)*sizeof(MPI_Request));
+    n   = isend_counts(sendcnts, tag, req, false);
+
+    for(i = 0; i < num_srcs; ++i)
+    {
+        MPI_Recv(&cnt, 1, MPI_INT, MPI_ANY_SOURCE, tag, comm, &status);
+        recvcnts[status.MPI_SOURCE] = cnt;
+    }
+
+    MPI_Waitall(n, req, MPI_STATUSES_IGNORE);
+
+    memory->free_char((char** )&req);
+}
+
 void mexico::Comm::alltoallv(void* sendbuf, int* sendcnts, MPI_Datatype sendtype,
                               void* recvbuf, int* recvcnts, MPI_Datatype recvtype)
 {
+    if(!alltoallv_send_displs)
+    {
+        alltoallv_send_displs = memory->alloc_int(nprocs);
+        alltoallv_recv_displs = memory->alloc_int(nprocs);
+    }
+
     incl_scan(sendcnts, sendcnts+nprocs, alltoallv_send_displs);
     incl_scan(recvcnts, recvcnts+nprocs, alltoallv_recv_displs);
 
@@ -64,11 +237,50 @@ void mexico::Comm::alltoallv(void* sendbuf, int* sendcnts, MPI_Datatype sendtype
                   recvbuf, recvcnts, alltoallv_recv_displs, recvtype, comm);
 }
 
+void mexico::Comm::alltoallv(void* sendbuf, int* sendcnts, int* senddispls, MPI_Datatype sendtype,
+                              void* recvbuf, int* recvcnts, int* recvdispls, MPI_Datatype recvtype)
+{
+    MPI_Alltoallv(sendbuf, sendcnts, senddispls, sendtype,
+                  recvbuf, recvcnts, recvdispls, recvtype, comm);
+}
+
+MPI_Request mexico::Comm::ialltoallv(void* sendbuf, int* sendcnts, int* senddispls, MPI_Datatype sendtype,
+                                     void* recvbuf, int* recvcnts, int* recvdispls, MPI_Datatype recvtype)
+{
+    MPI_Request req;
+
+    MPI_Ialltoallv(sendbuf, sendcnts, senddispls, sendtype,
+                   recvbuf, recvcnts, recvdispls, recvtype, comm, &req);
+
+    return req;
+}
+
+void mexico::Comm::split_type_shared(MPI_Comm* newcomm)
+{
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, myrank, MPI_INFO_NULL, newcomm);
+}
+
+void mexico::Comm::split(int color, int key, MPI_Comm* newcomm)
+{
+    MPI_Comm_split(comm, color, key, newcomm);
+}
+
+void mexico::Comm::dist_graph_create_adjacent(int indegree, int* sources, int outdegree, int* destinations, MPI_Comm* newcomm)
+{
+    MPI_Dist_graph_create_adjacent(comm, indegree, sources, MPI_UNWEIGHTED,
+                                   outdegree, destinations, MPI_UNWEIGHTED, MPI_INFO_NULL, 0, newcomm);
+}
+
 void mexico::Comm::allreduce(void* sendbuf, void* recvbuf, int cnt, MPI_Datatype type, MPI_Op op)
 {
     MPI_Allreduce(sendbuf, recvbuf, cnt, type, op, comm);
 }
 
+void mexico::Comm::reduce_scatter_block(void* sendbuf, void* recvbuf, int cnt, MPI_Datatype type, MPI_Op op)
+{
+    MPI_Reduce_scatter_block(sendbuf, recvbuf, cnt, type, op, comm);
+}
+
 void mexico::Comm::allgather(void* sendbuf, int sendcnt, MPI_Datatype sendtype,
                               void* recvbuf, int recvcnt, MPI_Datatype recvtype)
 {
@@ -80,17 +292,50 @@ void mexico::Comm::win_create(void* buf, MPI_Aint size, int disp_unit, MPI_Info
     MPI_Win_create(buf, size, disp_unit, info, comm, win);
 }
 
+void mexico::Comm::win_allocate(MPI_Aint size, int disp_unit, MPI_Info info, void* baseptr, MPI_Win* win)
+{
+    MPI_Win_allocate(size, disp_unit, info, comm, baseptr, win);
+}
+
+void mexico::Comm::group_incl(int n, int* ranks, MPI_Group* newgroup)
+{
+    MPI_Group grp;
+
+    MPI_Comm_group(comm, &grp);
+    MPI_Group_incl(grp, n, ranks, newgroup);
+    MPI_Group_free(&grp);
+}
+
 int mexico::Comm::translate_to_MPI_COMM_WORLD(int rank)
+{
+    return ranks_in_MPI_COMM_WORLD()[rank];
+}
+
+int* mexico::Comm::ranks_in_MPI_COMM_WORLD()
 {
     MPI_Group grp, grp_world;
-    int rank_world;
+    int i, *ranks;
 
-    MPI_Comm_group(comm, &grp);
-    MPI_Comm_group(MPI_COMM_WORLD, &grp_world);
+    if(!world_ranks)
+    {
+        ranks       = memory->alloc_int(nprocs);
+        world_ranks = memory->alloc_int(nprocs);
+
+        for(i = 0; i < nprocs; ++i)
+            ranks[i] = i;
+
+        MPI_Comm_group(comm, &grp);
+        MPI_Comm_group(MPI_COMM_WORLD, &grp_world);
+
+        MPI_Group_translate_ranks(grp, nprocs, ranks, grp_world, world_ranks);
+
+        MPI_Group_free(&grp);
+        MPI_Group_free(&grp_world);
 
-    MPI_Group_translate_ranks(grp, 1, &rank, grp_world, &rank_world);
+        memory->free_int(&ranks);
+    }
 
-    return rank_world;
+    return world_ranks;
 }
 
 MPI_Request mexico::Comm::isend(void* buf, int count, MPI_Datatype datatype, int dest, int tag)
@@ -57,15 +57,47 @@ public:
     /// communicator is a duplicate
     Comm(Instance* ptr, MPI_Comm i_comm);
 
+    /// Destructor
+    ~Comm();
+
     /// Allotall communication
     void alltoall(void* sendbuf, int sendcnt, MPI_Datatype sendtype, 
                   void* recvbuf, int recvcnt, MPI_Datatype recvtype);
 
+    /// Sparse replacement for alltoall(sendcnts, 1, MPI_INT, recvcnts, 1, MPI_INT)
+    /// if only few entries of sendcnts are nonzero. The nonzero counts are
+    /// send with MPI_Issend and termination is detected with an MPI_Ibarrier
+    /// once all sends have been matched (non-blocking consensus). The
+    /// function is collective
+    void alltoall_counts_nbx(int* sendcnts, int* recvcnts);
+
+    /// Same as alltoall_counts_nbx() but the number of processing elements
+    /// which send a count to this processing element is computed with
+    /// MPI_Reduce_scatter_block first. The function is collective
+    void alltoall_counts_reduce_scatter(int* sendcnts, int* recvcnts);
+
+    /// Sparse replacement for alltoallv() of integers if only few entries
+    /// of sendcnts are nonzero. The blocks are send with MPI_Issend and
+    /// termination is detected as in alltoall_counts_nbx(). *recvbuf is
+    /// reallocated to hold the received blocks, the block of processing
+    /// element w starts at recvdispls[w]. The function is collective
+    void alltoallv_nbx(int* sendbuf, int* sendcnts, int* senddispls,
+                       int** recvbuf, int* recvcnts, int* recvdispls);
+
     /// Simplified alltoallv call. This function computes
     /// the displacements automatically
     void alltoallv(void* sendbuf, int* sendcnts, MPI_Datatype sendtype,
                    void* recvbuf, int* recvcnts, MPI_Datatype recvtype);
 
+    /// Alltoallv call with precomputed displacements
+    void alltoallv(void* sendbuf, int* sendcnts, int* senddispls, MPI_Datatype sendtype,
+                   void* recvbuf, int* recvcnts, int* recvdispls, MPI_Datatype recvtype);
+
+    /// Non-blocking alltoallv call with precomputed displacements. The
+    /// function returns the request
+    MPI_Request ialltoallv(void* sendbuf, int* sendcnts, int* senddispls, MPI_Datatype sendtype,
+                           void* recvbuf, int* recvcnts, int* recvdispls, MPI_Datatype recvtype);
+
     /// Barrier
     inline void barrier()
     {
@@ -75,6 +107,9 @@ public:
     /// Allreduce operation
     void allreduce(void* sendbuf, void* recvbuf, int cnt, MPI_Datatype type, MPI_Op op);
 
+    /// Reduce_scatter_block operation
+    void reduce_scatter_block(void* sendbuf, void* recvbuf, int cnt, MPI_Datatype type, MPI_Op op);
+
     /// Allgather operation
     void allgather(void* sendbuf, int sendcnt, MPI_Datatype sendtype,
                    void* recvbuf, int recvcnt, MPI_Datatype recvtype);
@@ -82,9 +117,34 @@ public:
     /// Create an RMA window
     void win_create(void* buf, MPI_Aint size, int disp_unit, MPI_Info info, MPI_Win* win);
 
+    /// Allocate the memory of an RMA window and create the window. The
+    /// address of the memory is stored in baseptr (a pointer to a pointer)
+    void win_allocate(MPI_Aint size, int disp_unit, MPI_Info info, void* baseptr, MPI_Win* win);
+
+    /// Create a group of the n processing elements in ranks
+    void group_incl(int n, int* ranks, MPI_Group* newgroup);
+
     /// Translate a rank to the rank in MPI_COMM_WORLD
     int translate_to_MPI_COMM_WORLD(int rank);
 
+    /// Return the ranks in MPI_COMM_WORLD of all processing elements. The
+    /// table is computed with a single call to MPI_Group_translate_ranks
+    /// on first use and cached
+    int* ranks_in_MPI_COMM_WORLD();
+
+    /// Create a communicator with all processing elements which can
+    /// create shared memory regions (typically the processing elements
+    /// on the same node). The function is collective
+    void split_type_shared(MPI_Comm* newcomm);
+
+    /// Wrapper around MPI_Comm_split. The function is collective
+    void split(int color, int key, MPI_Comm* newcomm);
+
+    /// Create a distributed graph communicator with the given (unweighted)
+    /// in- and out-neighbors. Ranks are not reordered. The function is
+    /// collective
+    void dist_graph_create_adjacent(int indegree, int* sources, int outdegree, int* destinations, MPI_Comm* newcomm);
+
     /// Point-to-point communication: Wrapper around MPI_Isend. The function
     /// returns the request
     MPI_Request isend(void* buf, int count, MPI_Datatype datatype, int dest, int tag);
@@ -109,6 +169,18 @@ public:
     int* alltoallv_send_displs;
     int* alltoallv_recv_displs;
 
+private:
+    /// Number of calls to alltoall_counts_nbx() and
+    /// alltoall_counts_reduce_scatter(). Used to alternate the tags
+    int counts_round;
+    /// Ranks in MPI_COMM_WORLD. Allocated on first use in
+    /// ranks_in_MPI_COMM_WORLD()
+    int* world_ranks;
+
+    /// Isend the nonzero entries of sendcnts with the given tag. Returns
+    /// the number of requests stored in req
+    int isend_counts(int* sendcnts, int tag, MPI_Request* req, bool sync);
+
 };
 
 }
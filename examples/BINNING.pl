@@ -7,16 +7,21 @@ use List::Util qw[min max];
 
 
 # The list of runtime implementations
-my @rtimpl = ( "MPI Alltoall", "MPI RMA", "MPI Pt2Pt", "GA", "GA gs", "SHMEM" );
+my @rtimpl = ( "MPI Alltoall", "MPI RMA", "MPI Pt2Pt", "MPI Hierarchical", "MPI Neighborhood", "MPI Rooted", "MPI Packed RMA", "GA", "GA gs", "SHMEM" );
 
-# The options for the runtime
+# The options for the runtime. Settings for the &binning namelist can be
+# appended to the hints after a colon and are separated by semicolons
 my %rtopts = (
-	"MPI Alltoall" => [ "", "pack", "exch_with_pt2pt", "pack,exch_with_pt2pt" ],
-	"MPI RMA"	   => [ "coalesce" ],
-	"MPI Pt2Pt"    => [ "" ],
-	"GA"		   => [ "coalesce", "coalesce,use_irreg_distr" ],
-	"GA gs"		   => [ "coalesce", "coalesce,use_irreg_distr" ],
-	"SHMEM"	       => [ "coalesce" ]
+	"MPI Alltoall" => [ "", "pack", "exch_with_pt2pt", "pack,exch_with_pt2pt", "pack,counts_nbx", "pack,counts_reduce_scatter", "pack:exec_mode=1", "pack:exec_mode=2", "pack:exec_mode=3" ],
+	"MPI RMA"	   => [ "coalesce", "coalesce,shm", "coalesce,passive", "coalesce,pscw", "indexed", "sort", "pull", "pull,passive", "indexed:exec_mode=1", "pull:job_variant=1", "pull,passive:job_variant=1", "coalesce,steal:job_variant=3" ],
+	"MPI Pt2Pt"    => [ "", ":exec_mode=1", ":exec_mode=2", ":exec_mode=3", ":job_variant=1", ":job_variant=2" ],
+	"MPI Hierarchical" => [ "", ":exec_mode=1" ],
+	"MPI Neighborhood" => [ "", ":exec_mode=1", ":exec_mode=2", ":exec_mode=3" ],
+	"MPI Rooted"       => [ "", ":exec_mode=1", ":exec_mode=3" ],
+	"MPI Packed RMA"   => [ "", ":exec_mode=1" ],
+	"GA"		   => [ "coalesce", "coalesce,use_irreg_distr", "sort,use_irreg_distr", "sort,use_irreg_distr,nb_window=64", "coalesce:exec_mode=1" ],
+	"GA gs"		   => [ "coalesce", "coalesce,use_irreg_distr", "rows", "rows,use_irreg_distr", "coalesce:exec_mode=1" ],
+	"SHMEM"	       => [ "coalesce", "sort", "sort,signal", "sort,striped", "sort:exec_mode=1" ]
 );
 
 # On cub
@@ -34,6 +39,10 @@ my %rtexe = (
     "MPI Alltoall" => "$bindir/binning",
     "MPI RMA"      => "$bindir/binning",
     "MPI Pt2Pt"    => "$bindir/binning",
+    "MPI Hierarchical" => "$bindir/binning",
+    "MPI Neighborhood" => "$bindir/binning",
+    "MPI Rooted"       => "$bindir/binning",
+    "MPI Packed RMA"   => "$bindir/binning",
     "GA"           => "$bindir/binning",
     "GA gs"        => "$bindir/binning",
     "SHMEM"        => "$bindir/binning",
@@ -55,11 +64,20 @@ foreach my $rti (@rtimpl)
 	my @opts = @{ $rtopts{$rti} };
 	for(my $i = 0; $i < @opts; ++$i)
 	{
-		my $o = $opts[$i];
+		my ($o, $settings) = split(/:/, $opts[$i]);
+
+		# Namelist entries for the settings
+		my $nml = "";
+		foreach my $s (split(/;/, $settings))
+		{
+			$nml = "$nml,\n    $s";
+		}
 
 		# Create a subdirectory for each option
-		my $sdir = uc($o);
+		my $sdir = uc($opts[$i]);
 		$sdir =~ s/,/-/;
+		$sdir =~ s/[:;=]/_/g;
+		$sdir =~ s/^_//;
 		if("" eq "$sdir")
 		{
 			$sdir = "NONE";
@@ -145,7 +163,7 @@ EOF
     ! 1 = cyclic by cells
     ! 2 = randomly
     redistrib_strategy = 1,
-	redistrib_cyclic_blk = 1
+	redistrib_cyclic_blk = 1$nml
 /
 
 ! Input for the log instance
@@ -46,6 +46,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include "mexico.hpp"
 
 
@@ -54,58 +56,142 @@ class BinningJob : public mexico::Job
 {
 
 public:
-    BinningJob(int num_particles, int num_cells, int i_payload, int o_payload);
+    /// Ways of computing the output
+    enum
+    {
+        VARIANT_EXEC = 0,           ///< Bin all particles in exec()
+        VARIANT_STREAMING = 1,      ///< Bin the particles as they arrive
+                                    ///  in exec_partial()
+        VARIANT_EMIT = 2,           ///< Bin the particles in exec() and
+                                    ///  emit() the output in ranges
+        VARIANT_CHUNKS = 3          ///< Bin the particles in num_cells
+                                    ///  chunks in exec_chunk()
+    };
+
+    BinningJob(int num_particles, int num_cells, int i_payload, int o_payload, int variant);
 
     /// Implements the exec() function in
     /// mexico::Job
     void exec(void* i_buf, void* o_buf);
 
+    /// Implements the exec_partial() function in
+    /// mexico::Job
+    void exec_partial(void* i_buf, void* o_buf, int cnt, int num, int* offsets);
+
+    /// Implements the finish() function in
+    /// mexico::Job. The particles have been binned in
+    /// exec_partial() already
+    void finish(void* i_buf, void* o_buf);
+
+    /// Implements the exec_chunk() function in
+    /// mexico::Job
+    void exec_chunk(void* i_buf, void* o_buf, int chunk);
+
 private:
+    /// Bin particle i
+    void bin(float* i_flt_buf, int* o_int_buf, int i);
+
     /// Number of particles
     int num_particles;
     /// Number of cells
     int num_cells;
     /// Payload
     int i_flts, o_ints;
+    /// Variant
+    int variant;
 
 };
 
-BinningJob::BinningJob(int num_particles, int num_cells, int i_payload, int o_payload)
+BinningJob::BinningJob(int num_particles, int num_cells, int i_payload, int o_payload, int variant)
 : num_particles(num_particles), num_cells(num_cells)
 {
-    i_N = 3*num_particles + i_payload/4;
+    i_flts = i_payload/4;
+    o_ints = o_payload/4;
+
+    i_N = (3 + i_flts)*num_particles;
     i_type = MPI_FLOAT;
 
-    o_N = num_particles + o_payload/4;
+    o_N = (1 + o_ints)*num_particles;
     o_type = MPI_INT;
 
-    i_flts = i_payload/4;
-    o_ints = o_payload/4;
+    this->variant = variant;
+
+    streaming = (VARIANT_STREAMING == variant);
+
+    /// One chunk per slab of cells. num_particles is a multiple of
+    /// num_cells
+    num_chunks = (VARIANT_CHUNKS == variant) ? num_cells : 0;
 }
 
-void BinningJob::exec(void* i_buf, void* o_buf)
+void BinningJob::bin(float* i_flt_buf, int* o_int_buf, int i)
 {
-    int i, ix, iy, iz;
+    int ix, iy, iz;
     float x, y, z;
 
-    float* i_flt_buf = (float* )i_buf;
-    int* o_int_buf = (int* )o_buf;
+    x  = i_flt_buf[(3 + i_flts)*i  ];
+    y  = i_flt_buf[(3 + i_flts)*i+1];
+    z  = i_flt_buf[(3 + i_flts)*i+2];
+    
+    ix = (int )x;
+    iy = (int )y;
+    iz = (int )z;
 
-    for(i = 0; i < num_particles; ++i)
+    o_int_buf[(1 + o_ints)*i] = ix*num_cells*num_cells + iy*num_cells + iz;
+    memset(&o_int_buf[(1 + o_ints)*i+1], 'B', o_ints*sizeof(int));
+}
+
+void BinningJob::exec(void* i_buf, void* o_buf)
+{
+    int i, first, num;
+
+#undef  NUM_EMIT_RANGES
+#define NUM_EMIT_RANGES 16
+
+    if(VARIANT_EMIT == variant)
     {
-        x  = i_flt_buf[(3 + i_flts)*i  ];
-        y  = i_flt_buf[(3 + i_flts)*i+1];
-        z  = i_flt_buf[(3 + i_flts)*i+2];
-        
-        ix = (int )x;
-        iy = (int )y;
-        iz = (int )z;
+        num = std::max(1, num_particles/NUM_EMIT_RANGES);
 
-        o_int_buf[(1 + o_ints)*i] = ix*num_cells*num_cells + iy*num_cells + iz;
-        memset(&o_int_buf[(1 + o_ints)*i+1], 'B', o_ints*sizeof(int));
+        for(first = 0; first < num_particles; first += num)
+        {
+            num = std::min(num, num_particles - first);
+
+            for(i = first; i < first + num; ++i)
+                bin((float* )i_buf, (int* )o_buf, i);
+
+            /// The output of these particles is final
+            emit((1 + o_ints)*first, (1 + o_ints)*num);
+        }
+
+        return;
     }
+
+    for(i = 0; i < num_particles; ++i)
+        bin((float* )i_buf, (int* )o_buf, i);
 };
 
+void BinningJob::exec_partial(void* i_buf, void* o_buf, int cnt, int num, int* offsets)
+{
+    int k;
+
+    /// Each message holds one particle (cnt = 3 + i_flts) so the offset
+    /// is the index of the particle
+    for(k = 0; k < num; ++k)
+        bin((float* )i_buf, (int* )o_buf, offsets[k]);
+}
+
+void BinningJob::finish(void* i_buf, void* o_buf)
+{
+}
+
+void BinningJob::exec_chunk(void* i_buf, void* o_buf, int chunk)
+{
+    int i;
+
+    /// The buffers start at the first particle of the chunk
+    for(i = 0; i < num_particles/num_chunks; ++i)
+        bin((float* )i_buf, (int* )o_buf, i);
+}
+
 /// Application: The main driver code
 class Application
 {
@@ -146,6 +232,26 @@ public:
     /// Redistribute the particles 
     void redistribute_particles();
 
+    /// Ways of executing the exchange in run()
+    enum
+    {
+        EXEC_MATRICES = 0,          ///< Pass the matrices to each call of
+                                    ///  mexico::Instance::exec()
+        EXEC_PLAN = 1,              ///< Create a plan once and pass it to
+                                    ///  mexico::Instance::exec()
+        EXEC_UPDATE = 2,            ///< Same as EXEC_PLAN but migrate
+                                    ///  particles in each timestep and
+                                    ///  update the plan with
+                                    ///  mexico::Instance::update_routing()
+        EXEC_BEGIN = 3              ///< Use the split-phase
+                                    ///  mexico::Instance::exec_begin()
+    };
+
+    /// Swap the slots of num_migrations pairs of particles in the matrices
+    /// and store the changed entries in idx, worker and offsets. Returns the
+    /// number of changed entries
+    int migrate(int* i_worker, int* i_offsets, int* o_worker, int* o_offsets, int* idx, int* worker, int* offsets);
+
     /// Compute the mapping from particles to
     /// target pes
     void compute_map_redistrib_cells_cyclic(int*, int);
@@ -179,6 +285,10 @@ public:
     
     int redistrib_strategy;         ///< Redistribution strategy
     int redistrib_cyclic_blk;       ///< Block size for the cyclic distribution
+    int exec_mode;                  ///< How the exchange is executed
+    int job_variant;                ///< How the job computes the output
+    int num_migrations;             ///< Number of particle pairs which swap
+                                    ///  their slots in each timestep
 
     BinningJob* job;                ///< Binning job instance
     mexico::Instance* ci;           ///< The mexico instance
@@ -221,7 +331,7 @@ bool Application::pe_is_worker() const
 /// For simplicity we parse the "binning" namelist in Fortran
 #undef  F90NAME
 #define F90NAME(func)   func ## _
-extern "C" void F90NAME(parse_binning_namelist)(int*, int*, int*, int*, int*, int*, int*, int*);
+extern "C" void F90NAME(parse_binning_namelist)(int*, int*, int*, int*, int*, int*, int*, int*, int*, int*, int*);
 
 void Application::parse_args(int argc, char** argv)
 {
@@ -237,7 +347,10 @@ void Application::parse_args(int argc, char** argv)
                                     &num_bytes_per_particle_i,
                                     &num_bytes_per_particle_o,
                                     &redistrib_strategy,
-                                    &redistrib_cyclic_blk);
+                                    &redistrib_cyclic_blk,
+                                    &exec_mode,
+                                    &num_migrations,
+                                    &job_variant);
 }
 
 void Application::create_particles()
@@ -484,7 +597,7 @@ void Application::setup()
     /// Create the job instance
     job = 0;
     if(pe_is_worker())
-        job = new BinningJob(w_num_particles, num_cells, num_bytes_per_particle_i, num_bytes_per_particle_o);
+        job = new BinningJob(w_num_particles, num_cells, num_bytes_per_particle_i, num_bytes_per_particle_o, job_variant);
 
     if(!(fi = fopen("binning.in", "r")))
     {
@@ -524,6 +637,43 @@ void Application::prepare(float** i_buf, int** i_worker, int** i_offsets, int**
     }
 }
 
+int Application::migrate(int* i_worker, int* i_offsets, int* o_worker, int* o_offsets, int* idx, int* worker, int* offsets)
+{
+    int i, j, k, m, t;
+
+    m = 0;
+    for(k = 0; k < num_migrations && num_particles > 1; ++k)
+    {
+        i = rand()%num_particles;
+        j = rand()%num_particles;
+
+        if(i == j)
+            continue;
+
+        /// The particles keep their position in i_buf and o_buf but are
+        /// computed in the slot of the other particle
+        t = i_worker [i]; i_worker [i] = i_worker [j]; i_worker [j] = t;
+        t = i_offsets[i]; i_offsets[i] = i_offsets[j]; i_offsets[j] = t;
+        t = o_worker [i]; o_worker [i] = o_worker [j]; o_worker [j] = t;
+        t = o_offsets[i]; o_offsets[i] = o_offsets[j]; o_offsets[j] = t;
+
+        idx[m++] = i;
+        idx[m++] = j;
+    }
+
+    /// An entry may only be listed once
+    std::sort(idx, idx + m);
+    m = std::unique(idx, idx + m) - idx;
+
+    for(k = 0; k < m; ++k)
+    {
+        worker [k] = i_worker [idx[k]];
+        offsets[k] = i_offsets[idx[k]];
+    }
+
+    return m;
+}
+
 void Application::check(int* boxes)
 {
     int i, ix, iy, iz;
@@ -555,34 +705,115 @@ void Application::run()
     int* o_buf;
     int* o_worker;
     int* o_offsets;
-    int i;
-    double t0, t1, timing;
+    int* chg_idx;
+    int* chg_worker;
+    int* chg_offsets;
+    int i, m;
+    double t0, t1, timing, update_timing;
+    mexico::Plan* plan;
 
 #undef  NTIMES
 #define NTIMES 10/*20*/
 
     prepare(&i_buf, &i_worker, &i_offsets, &o_buf, &o_worker, &o_offsets);
 
+    chg_idx     = new int[2*num_migrations + 1];
+    chg_worker  = new int[2*num_migrations + 1];
+    chg_offsets = new int[2*num_migrations + 1];
+
+    plan = 0;
+    if(EXEC_PLAN == exec_mode || EXEC_UPDATE == exec_mode)
+    {
+        MPI_Barrier(MPI_COMM_WORLD);
+        t0 = MPI_Wtime();
+
+        plan = ci->plan(3 + num_bytes_per_particle_i/4,
+                        MPI_FLOAT,
+                        num_particles,
+                        1,
+                        i_worker,
+                        i_offsets,
+                        1 + num_bytes_per_particle_o/4,
+                        MPI_INT,
+                        num_particles,
+                        1,
+                        o_worker,
+                        o_offsets);
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        t1 = MPI_Wtime();
+
+        printf(" PLAN TIMING: %.3e\n", t1 - t0);
+    }
+
     timing = 0.0;
+    update_timing = 0.0;
     for(i = 0; i < NTIMES; ++i)
     {
+        if(EXEC_UPDATE == exec_mode && i > 0)
+        {
+            m = migrate(i_worker, i_offsets, o_worker, o_offsets, chg_idx, chg_worker, chg_offsets);
+
+            MPI_Barrier(MPI_COMM_WORLD);
+            t0 = MPI_Wtime();
+
+            ci->update_routing(plan, m, chg_idx, chg_worker, chg_offsets, m, chg_idx, chg_worker, chg_offsets);
+
+            MPI_Barrier(MPI_COMM_WORLD);
+            t1 = MPI_Wtime();
+
+            update_timing += (t1 - t0);
+        }
+
         MPI_Barrier(MPI_COMM_WORLD);
         t0 = MPI_Wtime();
 
-        ci->exec(i_buf,
-                 3 + num_bytes_per_particle_i/4,
-                 MPI_FLOAT,
-                 num_particles,
-                 1,
-                 i_worker,
-                 i_offsets,
-                 o_buf,
-                 1 + num_bytes_per_particle_o/4,
-                 MPI_INT,
-                 num_particles,
-                 1,
-                 o_worker,
-                 o_offsets);
+        switch(exec_mode)
+        {
+        case EXEC_MATRICES:
+            ci->exec(i_buf,
+                     3 + num_bytes_per_particle_i/4,
+                     MPI_FLOAT,
+                     num_particles,
+                     1,
+                     i_worker,
+                     i_offsets,
+                     o_buf,
+                     1 + num_bytes_per_particle_o/4,
+                     MPI_INT,
+                     num_particles,
+                     1,
+                     o_worker,
+                     o_offsets);
+            break;
+        case EXEC_PLAN:
+        case EXEC_UPDATE:
+            ci->exec(plan, i_buf, o_buf);
+            break;
+        case EXEC_BEGIN:
+            ci->exec_begin(i_buf,
+                           3 + num_bytes_per_particle_i/4,
+                           MPI_FLOAT,
+                           num_particles,
+                           1,
+                           i_worker,
+                           i_offsets,
+                           o_buf,
+                           1 + num_bytes_per_particle_o/4,
+                           MPI_INT,
+                           num_particles,
+                           1,
+                           o_worker,
+                           o_offsets);
+
+            /// A real application would do some work between the calls
+            if(!ci->exec_test())
+                ci->exec_wait();
+            break;
+        default:
+            printf(" ERROR: invalid exec_mode = %d\n", exec_mode);
+            MPI_Abort(MPI_COMM_WORLD, 128);
+        }
 
         MPI_Barrier(MPI_COMM_WORLD);
         t1 = MPI_Wtime();
@@ -596,6 +827,15 @@ void Application::run()
     
     printf(" TIMING: %.3e\n", timing);
 
+    if(EXEC_UPDATE == exec_mode)
+        printf(" UPDATE TIMING: %.3e\n", update_timing/(NTIMES - 1));
+
+    delete plan;
+
+    delete[] chg_idx;
+    delete[] chg_worker;
+    delete[] chg_offsets;
+
     delete[] i_buf;
     delete[] i_worker;
     delete[] i_offsets;
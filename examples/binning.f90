@@ -34,7 +34,10 @@ subroutine parse_binning_namelist(num_worker,               &
                                   num_bytes_per_particle_i, &
                                   num_bytes_per_particle_o, &
                                   redistrib_strategy,       &
-                                  redistrib_cyclic_blk)
+                                  redistrib_cyclic_blk,     &
+                                  exec_mode,                &
+                                  num_migrations,           &
+                                  job_variant)
     implicit none
 
     integer, intent(out) :: num_worker,                 &
@@ -44,7 +47,10 @@ subroutine parse_binning_namelist(num_worker,               &
                             num_bytes_per_particle_i,   &
                             num_bytes_per_particle_o,   &
                             redistrib_strategy,         &
-                            redistrib_cyclic_blk
+                            redistrib_cyclic_blk,       &
+                            exec_mode,                  &
+                            num_migrations,             &
+                            job_variant
     logical :: file_exists
 
     namelist /binning/ num_worker, worker, num_cells,   &
@@ -52,7 +58,15 @@ subroutine parse_binning_namelist(num_worker,               &
                        num_bytes_per_particle_i,        &
                        num_bytes_per_particle_o,        &
                        redistrib_strategy,              &
-                       redistrib_cyclic_blk
+                       redistrib_cyclic_blk,            &
+                       exec_mode,                       &
+                       num_migrations,                  &
+                       job_variant
+
+    ! Optional settings
+    exec_mode = 0
+    num_migrations = 16
+    job_variant = 0
 
     inquire(file = "binning.in", exist = file_exists )
     if(file_exists) then
@@ -37,6 +37,8 @@
 #include "parser.hpp"
 #include "comm.hpp"
 #include "memory.hpp"
+#include "plan.hpp"
+#include "assert.hpp"
 
 
 mexico::Instance::Instance(MPI_Comm comm, int num_worker, int* worker, Job* job, FILE* file)
@@ -72,6 +74,9 @@ mexico::Instance::Instance(MPI_Comm comm, int num_worker, int* worker, Job* job,
     /// Set the job instance
     this->job = job;
 
+    exec_plan = 0;
+    exec_in_flight = false;
+
     /// The runtime is created as the last member
     runtime = new Runtime(this);
 }
@@ -96,12 +101,19 @@ mexico::Instance::Instance(MPI_Comm comm, int num_worker, int* worker, Job* job,
     pe_is_worker = ( worker+num_worker != std::find(worker, worker+num_worker, this->comm->myrank) );
 
     this->job = job;
+
+    exec_plan = 0;
+    exec_in_flight = false;
     
     runtime = new Runtime(this);
 }
 
 mexico::Instance::~Instance()
 {
+    if(exec_in_flight)
+        exec_wait();
+
+    delete exec_plan;
     delete runtime;
     /* delete worker */
     delete comm;
@@ -115,6 +127,8 @@ void mexico::Instance::exec(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_n
                              void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
                              int* o_worker, int* o_offsets)
 {
+    MEXICO_ASSERT(!exec_in_flight);
+
     MEXICO_WRITE(Log::DEBUG, "start of Instance::exec() call");
 
     MEXICO_WRITE(Log::DEBUG, "calling Runtime::pre_comm()");
@@ -131,3 +145,107 @@ void mexico::Instance::exec(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_n
     MEXICO_WRITE(Log::DEBUG, "Instance::exec() finished");
 }
 
+mexico::Plan* mexico::Instance::plan(int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                     int* i_worker, int* i_offsets,
+                                     int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                     int* o_worker, int* o_offsets)
+{
+    MEXICO_ASSERT(!exec_in_flight);
+
+    MEXICO_WRITE(Log::DEBUG, "calling Runtime::create_plan()");
+    return runtime->create_plan(i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                                o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets);
+}
+
+void mexico::Instance::exec(Plan* plan, void* i_buf, void* o_buf)
+{
+    MEXICO_ASSERT(!exec_in_flight);
+
+    MEXICO_WRITE(Log::DEBUG, "start of Instance::exec() call (plan)");
+
+    MEXICO_WRITE(Log::DEBUG, "calling Runtime::pre_comm()");
+    runtime->pre_comm(plan, i_buf, o_buf);
+
+    MEXICO_WRITE(Log::DEBUG, "running Job::exec()");
+    runtime->exec_job();
+
+    MEXICO_WRITE(Log::DEBUG, "calling Runtime::post_comm()");
+    runtime->post_comm(plan, i_buf, o_buf);
+
+    MEXICO_WRITE(Log::DEBUG, "Instance::exec() finished");
+}
+
+void mexico::Instance::exec_begin(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                   int* i_worker, int* i_offsets,
+                                   void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                   int* o_worker, int* o_offsets)
+{
+    MEXICO_ASSERT(!exec_in_flight);
+    MEXICO_ASSERT(!exec_plan);
+
+    /// The offsets for the output must be known on the workers before
+    /// post_comm is started. A plan delivers them up front.
+    MEXICO_WRITE(Log::DEBUG, "calling Runtime::create_plan()");
+    exec_plan = runtime->create_plan(i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                                     o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets);
+
+    exec_begin(exec_plan, i_buf, o_buf);
+}
+
+void mexico::Instance::exec_begin(Plan* plan, void* i_buf, void* o_buf)
+{
+    MEXICO_ASSERT(!exec_in_flight);
+
+    MEXICO_WRITE(Log::DEBUG, "start of Instance::exec_begin() call");
+
+    MEXICO_WRITE(Log::DEBUG, "calling Runtime::pre_comm()");
+    runtime->pre_comm(plan, i_buf, o_buf);
+
+    MEXICO_WRITE(Log::DEBUG, "running Job::exec()");
+    runtime->exec_job();
+
+    MEXICO_WRITE(Log::DEBUG, "calling Runtime::post_comm_begin()");
+    runtime->post_comm_begin(plan, i_buf, o_buf);
+
+    exec_in_flight = true;
+}
+
+bool mexico::Instance::exec_test()
+{
+    MEXICO_ASSERT(exec_in_flight);
+
+    if(!runtime->post_comm_test())
+        return false;
+
+    delete exec_plan;
+    exec_plan = 0;
+
+    exec_in_flight = false;
+
+    return true;
+}
+
+void mexico::Instance::exec_wait()
+{
+    MEXICO_ASSERT(exec_in_flight);
+
+    MEXICO_WRITE(Log::DEBUG, "calling Runtime::post_comm_wait()");
+    runtime->post_comm_wait();
+
+    delete exec_plan;
+    exec_plan = 0;
+
+    exec_in_flight = false;
+
+    MEXICO_WRITE(Log::DEBUG, "Instance::exec_wait() finished");
+}
+
+void mexico::Instance::update_routing(Plan* plan, int i_num_changed, int* i_idx, int* i_worker, int* i_offsets,
+                                      int o_num_changed, int* o_idx, int* o_worker, int* o_offsets)
+{
+    MEXICO_ASSERT(!exec_in_flight);
+
+    MEXICO_WRITE(Log::DEBUG, "calling Plan::update()");
+    plan->update(i_num_changed, i_idx, i_worker, i_offsets, o_num_changed, o_idx, o_worker, o_offsets);
+}
+
@@ -49,6 +49,7 @@ class Memory;
 class Comm;
 class Runtime;
 class Job;
+class Plan;
 
 
 /// Instance: User interface of the library
@@ -124,6 +125,91 @@ public:
               int* o_worker,
               int* o_offsets);
 
+    /// Create a communication plan. The arguments have the same meaning
+    /// as in exec() but no buffers are passed. The routing information
+    /// (counts, displacements, offsets on the worker side) is computed
+    /// and exchanged once so that exec(plan, ...) only needs to move the
+    /// payload. The returned plan must be deleted by the user before
+    /// the instance is destroyed.
+    /// The function is collective on the communicator.
+    Plan* plan(int i_cnt,
+               MPI_Datatype i_type,
+               int i_num_vals,
+               int i_max_worker_per_val,
+               int* i_worker,
+               int* i_offsets,
+               int o_cnt,
+               MPI_Datatype o_type,
+               int o_num_vals,
+               int o_max_worker_per_val,
+               int* o_worker,
+               int* o_offsets);
+
+    /// Execute the job using a plan created with plan(). The buffers must
+    /// match the layout the plan was created for.
+    /// The function is collective on the communicator.
+    void exec(Plan* plan,
+              void* i_buf,
+              void* o_buf);
+
+    /// Split-phase variant of exec(): exec_begin() delivers the input to
+    /// the workers, runs the job on the worker and starts retrieving the
+    /// output. It returns without waiting for the output so that non-worker
+    /// processing elements can continue computing while the workers run
+    /// the job. o_buf must not be accessed before exec_test() returned true
+    /// or exec_wait() returned. Only one exec_begin() may be in flight and
+    /// no other exec(), exec_begin(), plan() or update_routing() may be
+    /// called before it completed. Destroying the instance completes an
+    /// exec_begin() in flight.
+    /// The arguments have the same meaning as in exec(). The routing is
+    /// computed in a temporary plan which is freed on completion.
+    /// The function is collective on the communicator.
+    void exec_begin(void* i_buf,
+                    int i_cnt,
+                    MPI_Datatype i_type,
+                    int i_num_vals,
+                    int i_max_worker_per_val,
+                    int* i_worker,
+                    int* i_offsets,
+                    void* o_buf,
+                    int o_cnt,
+                    MPI_Datatype o_type,
+                    int o_num_vals,
+                    int o_max_worker_per_val,
+                    int* o_worker,
+                    int* o_offsets);
+
+    /// Split-phase variant of exec(plan, ...)
+    /// The function is collective on the communicator.
+    void exec_begin(Plan* plan,
+                    void* i_buf,
+                    void* o_buf);
+
+    /// Test for completion of exec_begin(). Returns true if o_buf holds
+    /// the output.
+    /// Runtimes without a non-blocking post_comm complete the blocking
+    /// post_comm in exec_test() and exec_wait(). For these, both functions
+    /// are collective and exec_test() always returns true.
+    bool exec_test();
+
+    /// Wait for completion of exec_begin()
+    void exec_wait();
+
+    /// Change the routing of a few values in a plan. The cost is
+    /// proportional to the number of changed entries rather than to the
+    /// size of the matrices. See Plan::update() for the meaning of the
+    /// arguments.
+    /// The function is collective on the communicator.
+    void update_routing(Plan* plan,
+                        int i_num_changed,
+                        int* i_idx,
+                        int* i_worker,
+                        int* i_offsets,
+                        int o_num_changed,
+                        int* o_idx,
+                        int* o_worker,
+                        int* o_offsets);
+
 
     /// Member functions are public for convenient use in the
     /// library but must not be touched by external code!
@@ -143,6 +229,10 @@ public:
     int* worker;        ///< List of workers
     int pe_is_worker;   ///< True if the processing element is a
                         ///  worker, otherwise false.
+    Plan* exec_plan;    ///< Temporary plan created by exec_begin()
+                        ///  if no plan was given. Zero otherwise
+    bool exec_in_flight;///< True from exec_begin() until exec_test()
+                        ///  returned true or exec_wait() returned
 
 };
 
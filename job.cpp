@@ -29,11 +29,34 @@
  */
 
 #include "job.hpp"
+#include "runtime_impl.hpp"
 
 
 mexico::Job::Job()
 {
     no_comm = 0;
     no_comm_overwriteable = 1;
+    streaming = 0;
+    num_chunks = 0;
+    emit_target = 0;
+}
+
+void mexico::Job::exec_partial(void* i_buf, void* o_buf, int cnt, int num, int* offsets)
+{
+}
+
+void mexico::Job::exec_chunk(void* i_buf, void* o_buf, int chunk)
+{
+}
+
+void mexico::Job::emit(int first, int count)
+{
+    if(emit_target)
+        emit_target->emitted(first, count);
+}
+
+void mexico::Job::finish(void* i_buf, void* o_buf)
+{
+    exec(i_buf, o_buf);
 }
 
@@ -41,6 +41,9 @@
 namespace mexico
 {
 
+/// Forward declaration
+class RuntimeImpl;
+
 /// Job: Base class for all user-supplied jobs
 class Job
 {
@@ -62,11 +65,60 @@ public:
     bool no_comm_overwriteable;     ///< Allow overwriting the no_comm
                                     ///  hint by the description file.
                                     ///  The default is: yes
+    int streaming;                  ///< If streaming is set to 1, runtimes
+                                    ///  which support it hand the input to
+                                    ///  exec_partial() as it arrives and
+                                    ///  call finish() instead of exec().
+                                    ///  The default is: no
+    int num_chunks;                 ///< If positive, the work can be split
+                                    ///  into num_chunks independent chunks
+                                    ///  (see exec_chunk()) and runtimes
+                                    ///  which support it call exec_chunk()
+                                    ///  instead of exec(). Idle workers
+                                    ///  may process chunks of other
+                                    ///  workers. The default is: 0
 
     /// Execution function. This function must be
     /// implemented by the user. The function is passed
     /// the input and output buffer as arguments
     virtual void exec(void* i_buf, void* o_buf) = 0;
+
+    /// Streaming execution function. The function is called if streaming
+    /// is set and the runtime supports it. It is passed num input messages
+    /// of cnt values each which have just been stored in i_buf. offsets
+    /// holds the offsets of the messages in units of cnt values (as in
+    /// Instance::exec()). Before finish() is called every input message
+    /// has been passed to exec_partial() exactly once. The function must
+    /// not perform communication. The default implementation does nothing.
+    virtual void exec_partial(void* i_buf, void* o_buf, int cnt, int num, int* offsets);
+
+    /// Called once all input has been passed to exec_partial(). The output
+    /// must be complete when the function returns. The default
+    /// implementation calls exec()
+    virtual void finish(void* i_buf, void* o_buf);
+
+    /// Chunk execution function. The input and output buffers are split
+    /// into num_chunks chunks of i_N/num_chunks and o_N/num_chunks values.
+    /// The function is passed the chunk with the given index and must
+    /// compute its output from its input only. It may be called on a
+    /// different worker than the one which holds the chunk (with copies
+    /// of the buffers). i_N, o_N and num_chunks must be the same on all
+    /// workers. The function must not perform communication. The default
+    /// implementation does nothing.
+    virtual void exec_chunk(void* i_buf, void* o_buf, int chunk);
+
+    /// Publish a finished range of the output buffer. The count values
+    /// of type o_type starting at value first are final and will not be
+    /// touched by the job anymore. Runtimes which support it start
+    /// returning the output messages completely contained in the range
+    /// while the job keeps computing. Every output value should be
+    /// emitted at most once per execution. May be called from exec(),
+    /// finish() or exec_partial()
+    void emit(int first, int count);
+
+    /// Runtime implementation which is notified by emit(). Set by the
+    /// library
+    RuntimeImpl* emit_target;
 };
 
 }
@@ -33,6 +33,7 @@
 
 #include "job.hpp"
 #include "instance.hpp"
+#include "plan.hpp"
 
 namespace mexico
 {
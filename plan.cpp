@@ -0,0 +1,91 @@
+
+/// vi: tabstop=4:expandtab
+
+/* Copyright 2010 University of Lugano. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the University of Lugano.
+ */
+
+#include <algorithm>
+
+#include "plan.hpp"
+#include "memory.hpp"
+#include "assert.hpp"
+#include "log.hpp"
+
+
+mexico::Plan::Plan(Instance* ptr, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                    int* i_worker, int* i_offsets,
+                    int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                    int* o_worker, int* o_offsets)
+: Pointers(ptr), 
+  i_cnt(i_cnt), i_type(i_type), i_num_vals(i_num_vals), i_max_worker_per_val(i_max_worker_per_val),
+  o_cnt(o_cnt), o_type(o_type), o_num_vals(o_num_vals), o_max_worker_per_val(o_max_worker_per_val)
+{
+    MEXICO_WRITE(Log::DEBUG, "creating new mexico::Plan");
+
+    this->i_worker  = memory->alloc_int(i_num_vals*i_max_worker_per_val);
+    this->i_offsets = memory->alloc_int(i_num_vals*i_max_worker_per_val);
+    std::copy(i_worker , i_worker +i_num_vals*i_max_worker_per_val, this->i_worker );
+    std::copy(i_offsets, i_offsets+i_num_vals*i_max_worker_per_val, this->i_offsets);
+
+    this->o_worker  = memory->alloc_int(o_num_vals*o_max_worker_per_val);
+    this->o_offsets = memory->alloc_int(o_num_vals*o_max_worker_per_val);
+    std::copy(o_worker , o_worker +o_num_vals*o_max_worker_per_val, this->o_worker );
+    std::copy(o_offsets, o_offsets+o_num_vals*o_max_worker_per_val, this->o_offsets);
+}
+
+mexico::Plan::~Plan()
+{
+    memory->free_int(&i_worker);
+    memory->free_int(&i_offsets);
+    memory->free_int(&o_worker);
+    memory->free_int(&o_offsets);
+}
+
+void mexico::Plan::update(int i_num_changed, int* i_idx, int* i_worker, int* i_offsets,
+                          int o_num_changed, int* o_idx, int* o_worker, int* o_offsets)
+{
+    int j, k;
+
+    for(j = 0; j < i_max_worker_per_val; ++j)
+        for(k = 0; k < i_num_changed; ++k)
+        {
+            MEXICO_ASSERT(i_idx[k] >= 0 && i_idx[k] < i_num_vals);
+
+            this->i_worker [i_idx[k] + i_num_vals*j] = i_worker [k + i_num_changed*j];
+            this->i_offsets[i_idx[k] + i_num_vals*j] = i_offsets[k + i_num_changed*j];
+        }
+
+    for(j = 0; j < o_max_worker_per_val; ++j)
+        for(k = 0; k < o_num_changed; ++k)
+        {
+            MEXICO_ASSERT(o_idx[k] >= 0 && o_idx[k] < o_num_vals);
+
+            this->o_worker [o_idx[k] + o_num_vals*j] = o_worker [k + o_num_changed*j];
+            this->o_offsets[o_idx[k] + o_num_vals*j] = o_offsets[k + o_num_changed*j];
+        }
+}
+
@@ -0,0 +1,117 @@
+
+/// vi: tabstop=4:expandtab
+
+/* Copyright 2010 University of Lugano. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the University of Lugano.
+ */
+
+#ifndef MEXICO_PLAN_HPP_INCLUDED
+#define MEXICO_PLAN_HPP_INCLUDED 1
+
+#include "mexico_config.hpp"
+
+#ifdef MEXICO_HAVE_MPI_H
+#include <mpi.h>
+#endif
+
+#include "pointers.hpp"
+
+
+namespace mexico
+{
+
+/// Plan: A communication plan stores the routing information for
+///       repeated calls to Instance::exec() with the same worker and
+///       offset matrices. The base class keeps a private copy of the
+///       matrices and the message layout. Runtime implementations
+///       derive from it to cache whatever they can compute ahead of
+///       time (counts, displacements, offsets on the worker side, ...).
+///
+/// Plans are created by Instance::plan() and must be deleted by the
+/// user before the Instance is destroyed.
+class Plan : public Pointers
+{
+
+public:
+    /// Create a new plan. The arguments have the same meaning as in
+    /// Instance::exec(). The matrices are copied so the caller may
+    /// reuse or free them after the call.
+    Plan(Instance* ptr,
+         int i_cnt,
+         MPI_Datatype i_type,
+         int i_num_vals,
+         int i_max_worker_per_val,
+         int* i_worker,
+         int* i_offsets,
+         int o_cnt,
+         MPI_Datatype o_type,
+         int o_num_vals,
+         int o_max_worker_per_val,
+         int* o_worker,
+         int* o_offsets);
+
+    /// Destructor
+    virtual ~Plan();
+
+    /// Change the routing of a few values. i_idx holds i_num_changed
+    /// value indices and i_worker and i_offsets the new rows of the
+    /// matrices for these values, i.e., the new worker for column j of
+    /// value i_idx[k] is i_worker[k + i_num_changed*j]. The same holds for
+    /// the o_* arguments. The base class only patches its copy of the
+    /// matrices. Derived classes update their routing information in
+    /// time proportional to the number of changed entries.
+    /// The function is collective.
+    virtual void update(int i_num_changed,
+                        int* i_idx,
+                        int* i_worker,
+                        int* i_offsets,
+                        int o_num_changed,
+                        int* o_idx,
+                        int* o_worker,
+                        int* o_offsets);
+
+    /// Input message layout and routing
+    int i_cnt;
+    MPI_Datatype i_type;
+    int i_num_vals;
+    int i_max_worker_per_val;
+    int* i_worker;
+    int* i_offsets;
+
+    /// Output message layout and routing
+    int o_cnt;
+    MPI_Datatype o_type;
+    int o_num_vals;
+    int o_max_worker_per_val;
+    int* o_worker;
+    int* o_offsets;
+
+};
+
+}
+
+#endif
+
@@ -0,0 +1,193 @@
+
+/// vi: tabstop=4:expandtab
+
+/* Copyright 2010 University of Lugano. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the University of Lugano.
+ */
+
+
+#include <algorithm>
+#include <numeric>
+
+#include "runs.hpp"
+#include "memory.hpp"
+#include "comm.hpp"
+#include "assert.hpp"
+#include "log.hpp"
+
+
+mexico::Runs::Runs(Instance* ptr)
+: Pointers(ptr), num_entries(0), idx(0), num_runs(0), run_worker(0), run_offset(0), run_first(0), run_len(0), staging(0),
+  num_vals(-1), max_worker_per_val(-1), per_column(false), worker(0), offsets(0)
+{
+}
+
+mexico::Runs::~Runs()
+{
+    memory->free_int(&idx);
+    memory->free_int(&run_worker);
+    memory->free_int(&run_offset);
+    memory->free_int(&run_first);
+    memory->free_int(&run_len);
+    memory->free_char(&staging);
+    memory->free_int(&worker);
+    memory->free_int(&offsets);
+}
+
+bool mexico::Runs::unchanged(int num_vals, int max_worker_per_val, int* worker, int* offsets, bool per_column) const
+{
+    long N = (long )num_vals*max_worker_per_val;
+
+    return num_vals           == this->num_vals           &&
+           max_worker_per_val == this->max_worker_per_val &&
+           per_column         == this->per_column         &&
+           std::equal(worker , worker  + N, this->worker)   &&
+           std::equal(offsets, offsets + N, this->offsets);
+}
+
+void mexico::Runs::build(int num_vals, int max_worker_per_val, int* worker, int* offsets, bool per_column)
+{
+    int i, j, k, w, r, off;
+    long N, *keys;
+    int *first;
+
+    if(unchanged(num_vals, max_worker_per_val, worker, offsets, per_column))
+        return;
+
+    N = (long )num_vals*max_worker_per_val;
+
+    this->num_vals           = num_vals;
+    this->max_worker_per_val = max_worker_per_val;
+    this->per_column         = per_column;
+
+    memory->realloc_int(&this->worker , N);
+    memory->realloc_int(&this->offsets, N);
+    std::copy(worker , worker  + N, this->worker);
+    std::copy(offsets, offsets + N, this->offsets);
+
+    /// ----------------------------------------------------------------------
+    /// Bucket the entries by worker
+    first = memory->alloc_int(comm->nprocs+1);
+    std::fill(first, first+comm->nprocs+1, 0);
+
+    for(k = 0; k < N; ++k)
+    {
+        if(-1 == (w = worker[k]))
+            continue;
+#ifndef NDEBUG
+        if(w < 0 || w >= comm->nprocs)
+            MEXICO_FATAL("Invalid worker w = %d", w);
+#endif
+
+        ++first[w+1];
+    }
+
+    std::partial_sum(first, first+comm->nprocs+1, first);
+    num_entries = first[comm->nprocs];
+
+    /// The key combines the offset (high bits) and the local index (low
+    /// bits) so that sorting the keys of a worker sorts by offset and
+    /// keeps entries with the same offset in a deterministic order
+    keys = memory->alloc_long(num_entries);
+
+    for(j = 0; j < max_worker_per_val; ++j)
+        for(i = 0; i < num_vals; ++i)
+        {
+            if(-1 == (w = worker[i + num_vals*j]))
+                continue;
+
+            keys[first[w]++] = (((long )offsets[i + num_vals*j]) << 32) | (long )((per_column) ? i + num_vals*j : i);
+        }
+
+    /// first[w] now points to the end of the bucket of worker w
+    for(w = comm->nprocs; w > 0; --w)
+        first[w] = first[w-1];
+    first[0] = 0;
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Sort each bucket and find the runs
+    memory->realloc_int(&idx       , num_entries);
+    memory->realloc_int(&run_worker, num_entries);
+    memory->realloc_int(&run_offset, num_entries);
+    memory->realloc_int(&run_first , num_entries);
+    memory->realloc_int(&run_len   , num_entries);
+
+    num_runs = 0;
+    for(w = 0; w < comm->nprocs; ++w)
+    {
+        std::sort(keys + first[w], keys + first[w+1]);
+
+        for(k = first[w]; k < first[w+1]; ++k)
+        {
+            idx[k] = (int )(keys[k] & 0xFFFFFFFFL);
+            off    = (int )(keys[k] >> 32);
+
+            r = num_runs - 1;
+            if(k > first[w] and off == run_offset[r] + run_len[r])
+            {
+                ++run_len[r];
+                continue;
+            }
+
+            run_worker[num_runs] = w;
+            run_offset[num_runs] = off;
+            run_first [num_runs] = k;
+            run_len   [num_runs] = 1;
+            ++num_runs;
+        }
+    }
+
+    memory->free_long(&keys);
+    memory->free_int(&first);
+    /// ----------------------------------------------------------------------
+
+    MEXICO_WRITE(Log::DEBUG, "num_entries = %d, num_runs = %d", num_entries, num_runs);
+}
+
+void mexico::Runs::alloc_staging(long size)
+{
+    memory->realloc_char(&staging, num_entries*size);
+}
+
+void mexico::Runs::gather(void* buf, long size)
+{
+    int k;
+
+    alloc_staging(size);
+
+    for(k = 0; k < num_entries; ++k)
+        std::copy(((char* )buf) + idx[k]*size, ((char* )buf) + (idx[k] + 1)*size, staging + k*size);
+}
+
+void mexico::Runs::scatter(void* buf, long size)
+{
+    int k;
+
+    for(k = 0; k < num_entries; ++k)
+        std::copy(staging + k*size, staging + (k + 1)*size, ((char* )buf) + idx[k]*size);
+}
+
@@ -0,0 +1,109 @@
+
+/// vi: tabstop=4:expandtab
+
+/* Copyright 2010 University of Lugano. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the University of Lugano.
+ */
+
+
+#ifndef MEXICO_RUNS_HPP_INCLUDED
+#define MEXICO_RUNS_HPP_INCLUDED 1
+
+#include "pointers.hpp"
+
+
+namespace mexico
+{
+
+/// Runs: The entries of a worker and offset matrix sorted by worker and
+///       remote offset and split into maximal runs of consecutive offsets
+///       on the same worker. The values are staged in a contiguous buffer
+///       in this order so that each run can be moved with a single put or
+///       get, independent of the order of the values in the user buffer
+///       and across the columns of the matrix.
+///
+/// The sorted order only depends on the matrices. It is kept as long as
+/// build() is called with the same matrices.
+class Runs : public Pointers
+{
+
+public:
+    Runs(Instance* ptr);
+
+    /// Destructor
+    ~Runs();
+
+    /// Sort the entries of the matrix unless it did not change since the
+    /// last call. If per_column is true the local index of entry (i,j) is
+    /// i + num_vals*j, otherwise it is i
+    void build(int num_vals, int max_worker_per_val, int* worker, int* offsets, bool per_column);
+
+    /// Copy the values (of size bytes each) from buf into the staging
+    /// buffer in sorted order
+    void gather(void* buf, long size);
+
+    /// Copy the values (of size bytes each) from the staging buffer back
+    /// to buf
+    void scatter(void* buf, long size);
+
+    /// Reallocate the staging buffer for values of size bytes. gather()
+    /// calls this function
+    void alloc_staging(long size);
+
+    /// Number of entries and local index of each entry in sorted order
+    int  num_entries;
+    int* idx;
+
+    /// Number of runs and worker, first offset (in units of values),
+    /// position of the first entry in the staging buffer and number of
+    /// entries of each run
+    int  num_runs;
+    int* run_worker;
+    int* run_offset;
+    int* run_first;
+    int* run_len;
+
+    /// The staging buffer
+    char* staging;
+
+private:
+    /// Copy of the matrices used to detect changes
+    int  num_vals;
+    int  max_worker_per_val;
+    bool per_column;
+    int* worker;
+    int* offsets;
+
+    /// Returns true if the matrices are the same as in the last call to
+    /// build()
+    bool unchanged(int num_vals, int max_worker_per_val, int* worker, int* offsets, bool per_column) const;
+
+};
+
+}
+
+#endif
+
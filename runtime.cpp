@@ -45,6 +45,10 @@
 #include "runtime_impl_mpi_alltoall.hpp"
 #include "runtime_impl_mpi_rma.hpp"
 #include "runtime_impl_mpi_pt2pt.hpp"
+#include "runtime_impl_mpi_hierarchical.hpp"
+#include "runtime_impl_mpi_neighborhood.hpp"
+#include "runtime_impl_mpi_rooted.hpp"
+#include "runtime_impl_mpi_packed_rma.hpp"
 #endif
 
 
@@ -93,6 +97,26 @@ mexico::Runtime::Runtime(Instance* ptr)
     {
         impl = new RuntimeImpl_MPI_Pt2Pt(ptr, hints);
     }
+    else
+    if(implementation == "MPI Hierarchical")
+    {
+        impl = new RuntimeImpl_MPI_Hierarchical(ptr, hints);
+    }
+    else
+    if(implementation == "MPI Neighborhood")
+    {
+        impl = new RuntimeImpl_MPI_Neighborhood(ptr, hints);
+    }
+    else
+    if(implementation == "MPI Rooted")
+    {
+        impl = new RuntimeImpl_MPI_Rooted(ptr, hints);
+    }
+    else
+    if(implementation == "MPI Packed RMA")
+    {
+        impl = new RuntimeImpl_MPI_Packed_RMA(ptr, hints);
+    }
 #endif
     else
         MEXICO_FATAL("Found no constructor for this implementation");
@@ -112,6 +112,55 @@ public:
         impl->exec_job();
     }
 
+    /// Create a communication plan for the given message layout and
+    /// worker/offset matrices. The function is collective
+    Plan* create_plan(int i_cnt,
+                      MPI_Datatype i_type,
+                      int i_num_vals,
+                      int i_max_worker_per_val,
+                      int* i_worker,
+                      int* i_offsets,
+                      int o_cnt,
+                      MPI_Datatype o_type,
+                      int o_num_vals,
+                      int o_max_worker_per_val,
+                      int* o_worker,
+                      int* o_offsets)
+    {
+        return impl->create_plan(i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                                 o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets);
+    }
+
+    /// Shuffle data to worker processes using a plan
+    void pre_comm(Plan* plan, void* i_buf, void* o_buf)
+    {
+        impl->pre_comm(plan, i_buf, o_buf);
+    }
+
+    /// Retrieve the output data from workers using a plan
+    void post_comm(Plan* plan, void* i_buf, void* o_buf)
+    {
+        impl->post_comm(plan, i_buf, o_buf);
+    }
+
+    /// Start retrieving the output data from workers using a plan
+    void post_comm_begin(Plan* plan, void* i_buf, void* o_buf)
+    {
+        impl->post_comm_begin(plan, i_buf, o_buf);
+    }
+
+    /// Test if the output data has arrived
+    bool post_comm_test()
+    {
+        return impl->post_comm_test();
+    }
+
+    /// Wait until the output data has arrived
+    void post_comm_wait()
+    {
+        impl->post_comm_wait();
+    }
+
     
     /// Name of the implementation
     std::string implementation;
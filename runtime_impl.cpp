@@ -30,20 +30,83 @@
 
 #include "runtime_impl.hpp"
 #include "job.hpp"
+#include "plan.hpp"
 
 
 mexico::RuntimeImpl::RuntimeImpl(Instance* ptr)
-: Pointers(ptr)
+: Pointers(ptr), supports_streaming(false), pending_plan(0), pending_i_buf(0), pending_o_buf(0)
 {
+    if(instance->pe_is_worker)
+        job->emit_target = this;
 }
 
 mexico::RuntimeImpl::~RuntimeImpl()
 {
+    if(instance->pe_is_worker and this == job->emit_target)
+        job->emit_target = 0;
 }
 
 void mexico::RuntimeImpl::exec_job()
 {
-    if(instance->pe_is_worker)
+    if(!instance->pe_is_worker)
+        return;
+
+    if(supports_streaming and job->streaming)
+        job->finish(i_buf, o_buf);
+    else
         job->exec(i_buf, o_buf);
 }
 
+void mexico::RuntimeImpl::emitted(int first, int count)
+{
+}
+
+void mexico::RuntimeImpl::stream(int cnt, int num, int* offsets)
+{
+    if(num > 0 and job->streaming)
+        job->exec_partial(i_buf, o_buf, cnt, num, offsets);
+}
+
+mexico::Plan* mexico::RuntimeImpl::create_plan(int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                               int* i_worker, int* i_offsets,
+                                               int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                               int* o_worker, int* o_offsets)
+{
+    return new Plan(instance, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                    o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets);
+}
+
+void mexico::RuntimeImpl::pre_comm(Plan* plan, void* i_buf, void* o_buf)
+{
+    pre_comm(i_buf, plan->i_cnt, plan->i_type, plan->i_num_vals, plan->i_max_worker_per_val, plan->i_worker, plan->i_offsets,
+             o_buf, plan->o_cnt, plan->o_type, plan->o_num_vals, plan->o_max_worker_per_val, plan->o_worker, plan->o_offsets);
+}
+
+void mexico::RuntimeImpl::post_comm(Plan* plan, void* i_buf, void* o_buf)
+{
+    post_comm(i_buf, plan->i_cnt, plan->i_type, plan->i_num_vals, plan->i_max_worker_per_val, plan->i_worker, plan->i_offsets,
+              o_buf, plan->o_cnt, plan->o_type, plan->o_num_vals, plan->o_max_worker_per_val, plan->o_worker, plan->o_offsets);
+}
+
+void mexico::RuntimeImpl::post_comm_begin(Plan* plan, void* i_buf, void* o_buf)
+{
+    pending_plan  = plan;
+    pending_i_buf = i_buf;
+    pending_o_buf = o_buf;
+}
+
+bool mexico::RuntimeImpl::post_comm_test()
+{
+    post_comm_wait();
+    return true;
+}
+
+void mexico::RuntimeImpl::post_comm_wait()
+{
+    if(!pending_plan)
+        return;
+
+    post_comm(pending_plan, pending_i_buf, pending_o_buf);
+    pending_plan = 0;
+}
+
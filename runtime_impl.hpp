@@ -37,6 +37,9 @@
 namespace mexico
 {
 
+/// Forwarding
+class Plan;
+
 /// RuntimeImpl: Base class for all runtime implementations
 class RuntimeImpl : public Pointers
 {
@@ -78,9 +81,67 @@ public:
                            int* o_worker,
                            int* o_offsets) = 0;
     
-    /// Execute the job using i_buf and o_buf as input/output
+    /// Execute the job using i_buf and o_buf as input/output. If the
+    /// runtime streamed the input to the job, Job::finish() is called
+    /// instead of Job::exec()
     virtual void exec_job();
 
+    /// True if the runtime implementation passes all input to
+    /// Job::exec_partial() (via stream()) while receiving it. The default
+    /// is false
+    bool supports_streaming;
+
+    /// Called by Job::emit() on the worker with a finished range of the
+    /// output buffer (in units of job->o_type values). The default
+    /// implementation ignores it and returns the output in post_comm()
+    virtual void emitted(int first, int count);
+
+    /// Hand num freshly received input messages with the given offsets
+    /// to the job if streaming is enabled
+    void stream(int cnt, int num, int* offsets);
+
+    /// See Runtime::create_plan(). The default implementation
+    /// returns a plain Plan which only stores the matrices
+    virtual Plan* create_plan(int i_cnt,
+                              MPI_Datatype i_type,
+                              int i_num_vals,
+                              int i_max_worker_per_val,
+                              int* i_worker,
+                              int* i_offsets,
+                              int o_cnt,
+                              MPI_Datatype o_type,
+                              int o_num_vals,
+                              int o_max_worker_per_val,
+                              int* o_worker,
+                              int* o_offsets);
+
+    /// Plan-based variant of pre_comm(). The default implementation
+    /// forwards to pre_comm() with the matrices stored in the plan
+    virtual void pre_comm(Plan* plan, void* i_buf, void* o_buf);
+
+    /// Plan-based variant of post_comm(). The default implementation
+    /// forwards to post_comm() with the matrices stored in the plan
+    virtual void post_comm(Plan* plan, void* i_buf, void* o_buf);
+
+    /// Start the plan-based post_comm(). The output is complete after
+    /// post_comm_test() returned true or post_comm_wait() returned. The
+    /// default implementation only records the arguments and performs the
+    /// blocking post_comm() in post_comm_test() or post_comm_wait()
+    virtual void post_comm_begin(Plan* plan, void* i_buf, void* o_buf);
+
+    /// Test for completion of a post_comm_begin(). Returns true if o_buf
+    /// is ready or no post_comm is pending
+    virtual bool post_comm_test();
+
+    /// Wait for completion of a post_comm_begin()
+    virtual void post_comm_wait();
+
+
+    /// Arguments of the pending post_comm_begin() call. pending_plan is
+    /// zero if no post_comm is in flight
+    Plan* pending_plan;
+    void* pending_i_buf;
+    void* pending_o_buf;
 
     /// Input and output buffers
     void* i_buf;
@@ -106,5 +167,17 @@ public:
         MEXICO_WRITE(Log::DEBUG, name " = %d", var);    \
     } while(0)
 
+/// Read an integer valued hint given as "name=value". If the hint is
+/// not present, var is set to def
+#undef  MEXICO_READ_INT_HINT
+#define MEXICO_READ_INT_HINT(hints, name, var, def)                         \
+    do                                                                      \
+    {                                                                       \
+        std::string::size_type pos_ = (hints).find(name "=");              \
+        (var) = ((hints).npos == pos_) ? (def) :                            \
+                atoi((hints).c_str() + pos_ + sizeof(name "=") - 1);        \
+        MEXICO_WRITE(Log::DEBUG, name " = %d", var);                        \
+    } while(0)
+
 #endif
 
@@ -38,6 +38,7 @@
 #include <limits.h>
 
 #include "runtime_impl_ga.hpp"
+#include "runs.hpp"
 #include "job.hpp"
 #include "runtime.hpp"
 #include "memory.hpp"
@@ -53,10 +54,16 @@ mexico::RuntimeImpl_GA::RuntimeImpl_GA(Instance* ptr, const std::string& hints)
 {
     /// Read the hints
     MEXICO_READ_HINT(hints, "coalesce", coalesce);
+    MEXICO_READ_HINT(hints, "sort", sort);
+
+    i_runs = (sort) ? new Runs(instance) : 0;
+    o_runs = (sort) ? new Runs(instance) : 0;
 }
 
 mexico::RuntimeImpl_GA::~RuntimeImpl_GA()
 {
+    delete i_runs;
+    delete o_runs;
 }
 
 void mexico::RuntimeImpl_GA::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
@@ -64,11 +71,13 @@ void mexico::RuntimeImpl_GA::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_typ
                                        void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
                                        int* o_worker, int* o_offsets)
 {
-    int i, j, w, lo, lo0, i0, nv;
+    int i, j, r, w, lo, lo0, i0, nv;
     MPI_Aint i_extent;
 
     MPI_Type_extent(i_type, &i_extent);
 
+    set_row_width(i_cnt, o_cnt);
+
     /// Declared in RuntimeImpl_GA_Common
     put_min_cnt = INT_MAX;
     put_max_cnt = -1;
@@ -79,6 +88,16 @@ void mexico::RuntimeImpl_GA::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_typ
     /// Exchange the data
     MEXICO_WRITE(Log::DEBUG, "Starting exchange of data");
 
+    if(sort)
+    {
+        i_runs->build(i_num_vals, i_max_worker_per_val, i_worker, i_offsets, false);
+        i_runs->gather(i_buf, i_cnt*i_extent);
+
+        for(r = 0; r < i_runs->num_runs; ++r)
+            put(i_ga, i_start[i_runs->run_worker[r]] + i_cnt*i_runs->run_offset[r], i_cnt*i_runs->run_len[r],
+                i_runs->staging + i_runs->run_first[r]*i_cnt*i_extent);
+    }
+    else
     if(not coalesce)
     {
         for(j = 0; j < i_max_worker_per_val; ++j)
@@ -141,6 +160,7 @@ void mexico::RuntimeImpl_GA::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_typ
         }
     }
 
+    wait_all();
     GA_Pgroup_sync(p_handle);
     MEXICO_WRITE(Log::DEBUG, "Finished exchange of data");
     /// ----------------------------------------------------------------------
@@ -166,6 +186,7 @@ void mexico::RuntimeImpl_GA::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_typ
         if(instance->pe_is_worker)
             get(i_ga, i_start[comm->myrank], job->i_N, this->i_buf);
     
+        wait_all();
         GA_Pgroup_sync(p_handle);
         MEXICO_WRITE(Log::DEBUG, "Finished copy to local buffer");
     }
@@ -177,7 +198,7 @@ void mexico::RuntimeImpl_GA::post_comm(void* i_buf, int i_cnt, MPI_Datatype i_ty
                                         void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
                                         int* o_worker, int* o_offsets)
 {
-    int i, j, w, lo, lo0, i0, nv;
+    int i, j, r, w, lo, lo0, i0, nv;
     MPI_Aint o_extent;
     
     MPI_Type_extent(o_type, &o_extent);
@@ -202,6 +223,7 @@ void mexico::RuntimeImpl_GA::post_comm(void* i_buf, int i_cnt, MPI_Datatype i_ty
         if(instance->pe_is_worker)
             put(o_ga, o_start[comm->myrank], job->o_N, this->o_buf);
     
+        wait_all();
         GA_Pgroup_sync(p_handle);
         MEXICO_WRITE(Log::DEBUG, "Finished copy to global array");
     }
@@ -217,6 +239,16 @@ void mexico::RuntimeImpl_GA::post_comm(void* i_buf, int i_cnt, MPI_Datatype i_ty
     /// Exchange the data
     GA_Init_fence();
 
+    if(sort)
+    {
+        o_runs->build(o_num_vals, o_max_worker_per_val, o_worker, o_offsets, true);
+        o_runs->alloc_staging(o_cnt*o_extent);
+
+        for(r = 0; r < o_runs->num_runs; ++r)
+            get(o_ga, o_start[o_runs->run_worker[r]] + o_cnt*o_runs->run_offset[r], o_cnt*o_runs->run_len[r],
+                o_runs->staging + o_runs->run_first[r]*o_cnt*o_extent);
+    }
+    else
     if(not coalesce)
     {
         for(j = 0; j < o_max_worker_per_val; ++j)
@@ -279,7 +311,12 @@ void mexico::RuntimeImpl_GA::post_comm(void* i_buf, int i_cnt, MPI_Datatype i_ty
         }
     }
 
+    wait_all();
     GA_Fence();
+
+    if(sort)
+        o_runs->scatter(o_buf, o_cnt*o_extent);
+
     MEXICO_WRITE(Log::DEBUG, "Finished exchange of data");
     /// ----------------------------------------------------------------------
     
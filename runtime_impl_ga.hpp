@@ -41,6 +41,8 @@
 namespace mexico
 {
 
+class Runs;
+
 /// RuntimeImpl_GA: Runtime implementation based on the Global Arrays
 ///                 library which uses simple Put/Get mechanisms
 class RuntimeImpl_GA : public RuntimeImpl_GA_Common
@@ -87,6 +89,14 @@ public:
 private:
     /// Whether or not to coalesce puts and gets
     bool coalesce;
+    /// Sort the entries by worker and remote offset, stage the values in
+    /// this order and move each run of consecutive offsets with a single
+    /// put or get (see Runs)
+    bool sort;
+    /// Sorted entries of the input and output matrices. Only allocated
+    /// if sort is true
+    Runs* i_runs;
+    Runs* o_runs;
 
 };
 
@@ -53,10 +53,19 @@
 mexico::RuntimeImpl_GA_Common::RuntimeImpl_GA_Common(Instance* ptr, const std::string& hints)
 : RuntimeImpl(ptr)
 {
-    int i_type, o_type, i_ndims, o_ndims, *list, i, *map, nblocks, *worker;
+    int i, *sizes, types[2];
 
     /// Read the hints
     MEXICO_READ_HINT(hints, "use_irreg_distr", use_irreg_distr);
+    MEXICO_READ_HINT(hints, "rows", rows);
+    /// The runs of rows are moved with non-blocking puts and gets unless
+    /// nb_window=0 is given explicitly
+    MEXICO_READ_INT_HINT(hints, "nb_window", nb_window, (rows) ? 16 : 0);
+
+    nb_handles = 0;
+    memory->realloc_char((char** )&nb_handles, nb_window*sizeof(ga_nbhdl_t));
+    nb_num  = 0;
+    nb_next = 0;
 
     if(instance->pe_is_worker)
     {
@@ -73,13 +82,33 @@ mexico::RuntimeImpl_GA_Common::RuntimeImpl_GA_Common(Instance* ptr, const std::s
     o_buf = 0;
 
     /// ----------------------------------------------------------------------
-    /// Compute i_ndims and o_ndims 
-    
-    i_ndims = (instance->pe_is_worker) ? job->i_N : 0;
-    o_ndims = (instance->pe_is_worker) ? job->o_N : 0;
+    /// Compute i_start and o_start. The sizes of all processing elements
+    /// are gathered with a single call and i_ndims and o_ndims are the
+    /// sums of the sizes
+
+    i_start = memory->alloc_int(comm->nprocs);
+    o_start = memory->alloc_int(comm->nprocs);
+
+    sizes = memory->alloc_int(2*comm->nprocs);
+
+    sizes[2*comm->myrank  ] = (instance->pe_is_worker) ? job->i_N : 0;
+    sizes[2*comm->myrank+1] = (instance->pe_is_worker) ? job->o_N : 0;
+
+    comm->allgather(MPI_IN_PLACE, 2, MPI_INT, sizes, 2, MPI_INT);
+
+    for(i = 0; i < comm->nprocs; ++i)
+    {
+        i_start[i] = sizes[2*i  ];
+        o_start[i] = sizes[2*i+1];
+    }
+
+    memory->free_int(&sizes);
 
-    comm->allreduce(MPI_IN_PLACE, &o_ndims, 1, MPI_INT, MPI_SUM);
-    comm->allreduce(MPI_IN_PLACE, &i_ndims, 1, MPI_INT, MPI_SUM);
+    i_ndims = std::accumulate(i_start, i_start+comm->nprocs, 0);
+    o_ndims = std::accumulate(o_start, o_start+comm->nprocs, 0);
+
+    excl_scan_in_place(i_start, i_start+comm->nprocs);
+    excl_scan_in_place(o_start, o_start+comm->nprocs);
 
     MEXICO_WRITE(Log::MEDIUM, "[i|o]_ndims = [ %d, %d ]", i_ndims, o_ndims);
     /// ----------------------------------------------------------------------
@@ -87,131 +116,135 @@ mexico::RuntimeImpl_GA_Common::RuntimeImpl_GA_Common(Instance* ptr, const std::s
     /// ----------------------------------------------------------------------
     /// Compute i_types and o_types
 
-    i_type = (instance->pe_is_worker) ? convert_mpi_type_to_ga_type(job->i_type) : 0;
-    o_type = (instance->pe_is_worker) ? convert_mpi_type_to_ga_type(job->o_type) : 0;
+    types[0] = (instance->pe_is_worker) ? convert_mpi_type_to_ga_type(job->i_type) : 0;
+    types[1] = (instance->pe_is_worker) ? convert_mpi_type_to_ga_type(job->o_type) : 0;
 
     /* FIXME Assumptions: 
              a) MT_XYZ > 0
              b) Types are consistent among workers. This is not a strong assumption
      */
-    comm->allreduce(MPI_IN_PLACE, &i_type, 1, MPI_INT, MPI_MAX);
-    comm->allreduce(MPI_IN_PLACE, &o_type, 1, MPI_INT, MPI_MAX);
+    comm->allreduce(MPI_IN_PLACE, types, 2, MPI_INT, MPI_MAX);
 
-    MEXICO_WRITE(Log::DEBUG, "[i|o]_type = [ %d, %d ]", i_type, o_type);
-    /// ----------------------------------------------------------------------
+    i_ga_type = types[0];
+    o_ga_type = types[1];
 
+    MEXICO_WRITE(Log::DEBUG, "[i|o]_type = [ %d, %d ]", i_ga_type, o_ga_type);
     /// ----------------------------------------------------------------------
-    /// Compute i_start and o_start
-
-    i_start = memory->alloc_int(comm->nprocs);
-    o_start = memory->alloc_int(comm->nprocs);
 
-    i_start[comm->myrank] = (instance->pe_is_worker) ? job->i_N : 0;
-    o_start[comm->myrank] = (instance->pe_is_worker) ? job->o_N : 0;
-
-    comm->allgather(MPI_IN_PLACE, 1, MPI_INT, i_start, 1, MPI_INT);
-    comm->allgather(MPI_IN_PLACE, 1, MPI_INT, o_start, 1, MPI_INT);
-
-    excl_scan_in_place(i_start, i_start+comm->nprocs);
-    excl_scan_in_place(o_start, o_start+comm->nprocs);
-    /// ----------------------------------------------------------------------
-    
     /// ----------------------------------------------------------------------
     /// Create p_handle
-    list = memory->alloc_int(comm->nprocs);
-
-    for(i = 0; i < comm->nprocs; ++i)
-        list[i] = comm->translate_to_MPI_COMM_WORLD(i);
-    p_handle = GA_Pgroup_create(list, comm->nprocs);
+    p_handle = GA_Pgroup_create(comm->ranks_in_MPI_COMM_WORLD(), comm->nprocs);
 
-    memory->free_int(&list);
+    /// Workers in the numbering of MPI_COMM_WORLD for GA_Set_restricted()
+    worker_world = memory->alloc_int(instance->num_worker);
+    for(i = 0; i < instance->num_worker; ++i)
+        worker_world[i] = comm->translate_to_MPI_COMM_WORLD(instance->worker[i]);
     /// ----------------------------------------------------------------------
 
-    i_ga = GA_Create_handle();
-    GA_Set_data(i_ga, 1, &i_ndims, i_type);
-    GA_Set_pgroup(i_ga, p_handle);
-    
-    if(use_irreg_distr)
+    if(not use_irreg_distr and instance->pe_is_worker)
     {
-        nblocks = instance->num_worker;
-        map     = memory->alloc_int(instance->num_worker);
-        for(i = 0; i < instance->num_worker; ++i)
-            map[i] = i_start[instance->worker[i]];
-        
-        GA_Set_irreg_distr(i_ga, map, &nblocks);
+        i_buf = memory->alloc_char(job->i_N*job_i_extent);
+        o_buf = memory->alloc_char(job->o_N*job_o_extent);
+    }
 
-        worker  = memory->alloc_int(instance->num_worker);
-        for(i = 0; i < instance->num_worker; ++i)
-            worker[i] = comm->translate_to_MPI_COMM_WORLD(instance->worker[i]);
+    i_width = 0;
+    o_width = 0;
 
-        GA_Set_restricted (i_ga, worker, instance->num_worker);
-        
-        memory->free_int(&map);
-        memory->free_int(&worker);
+    /// The row width is not known before the first call
+    if(not rows)
+    {
+        char i_ga_name[] = "i_ga";
+        i_ga = create_array(i_ga_name, i_ga_type, i_ndims, 0, i_start);
+
+        char o_ga_name[] = "o_ga";
+        o_ga = create_array(o_ga_name, o_ga_type, o_ndims, 0, o_start);
     }
-    else
+}
+
+mexico::RuntimeImpl_GA_Common::~RuntimeImpl_GA_Common()
+{
+    GA_Print_stats();
+
+    if(not rows or i_width > 0)
     {
-        if(instance->pe_is_worker)
-            i_buf = memory->alloc_char(job->i_N*job_i_extent);
+        GA_Destroy(i_ga);
+        GA_Destroy(o_ga);
     }
 
-    char i_ga_name[] = "i_ga";
-    GA_Set_array_name(i_ga, i_ga_name);
+    if(!use_irreg_distr and instance->pe_is_worker)
+    {
+        memory->free_char((char** )&i_buf);
+        memory->free_char((char** )&o_buf);
+    }
 
-    GA_Allocate(i_ga);
-    GA_Print_distribution(i_ga);
+    memory->free_int(&i_start);
+    memory->free_int(&o_start);
+    memory->free_int(&worker_world);
 
+    memory->free_char((char** )&nb_handles);
+}
 
-    o_ga = GA_Create_handle();
-    GA_Set_data(o_ga, 1, &o_ndims, o_type);
-    GA_Set_pgroup(o_ga, p_handle);
+int mexico::RuntimeImpl_GA_Common::create_array(char* name, int type, int N, int width, int* start)
+{
+    int ga, ndim, dims[2], nblocks[2], *map, i;
 
-    if(use_irreg_distr)
-    {
-        nblocks = instance->num_worker;
-        map     = memory->alloc_int(instance->num_worker);
-        for(i = 0; i < instance->num_worker; ++i)
-            map[i] = o_start[instance->worker[i]];
+    ndim    = (width > 0) ? 2 : 1;
+    dims[0] = (width > 0) ? N/width : N;
+    dims[1] = width;
 
-        GA_Set_irreg_distr(o_ga, map, &nblocks);
+    ga = GA_Create_handle();
+    GA_Set_data(ga, ndim, dims, type);
+    GA_Set_pgroup(ga, p_handle);
 
-        worker  = memory->alloc_int(instance->num_worker);
+    if(use_irreg_distr)
+    {
+        /// The rows of a worker form one block. The second dimension
+        /// is not split
+        nblocks[0] = instance->num_worker;
+        nblocks[1] = 1;
+        map        = memory->alloc_int(instance->num_worker + 1);
         for(i = 0; i < instance->num_worker; ++i)
-            worker[i] = comm->translate_to_MPI_COMM_WORLD(instance->worker[i]);
+            map[i] = (width > 0) ? start[instance->worker[i]]/width : start[instance->worker[i]];
+        map[instance->num_worker] = 0;
 
-        GA_Set_restricted (o_ga, worker, instance->num_worker);
+        GA_Set_irreg_distr(ga, map, nblocks);
+        GA_Set_restricted (ga, worker_world, instance->num_worker);
 
         memory->free_int(&map);
-        memory->free_int(&worker);
-    }
-    else
-    {
-        if(instance->pe_is_worker)
-            o_buf = memory->alloc_char(job->o_N*job_o_extent);
     }
 
-    char o_ga_name[] = "o_ga";
-    GA_Set_array_name(o_ga, o_ga_name);
+    GA_Set_array_name(ga, name);
+
+    GA_Allocate(ga);
 
-    GA_Allocate(o_ga);
-    GA_Print_distribution(o_ga);
+    if(log->debug >= Log::DEBUG)
+        GA_Print_distribution(ga);
+
+    return ga;
 }
 
-mexico::RuntimeImpl_GA_Common::~RuntimeImpl_GA_Common()
+void mexico::RuntimeImpl_GA_Common::set_row_width(int i_cnt, int o_cnt)
 {
-    GA_Print_stats();
-    
-    GA_Destroy(i_ga);
-    GA_Destroy(o_ga);
+    if(not rows or (i_cnt == i_width and o_cnt == o_width))
+        return;
 
-    if(!use_irreg_distr and instance->pe_is_worker)
+    if(instance->pe_is_worker and (0 != job->i_N%i_cnt or 0 != job->o_N%o_cnt))
+        MEXICO_FATAL("The job buffers must hold a whole number of values.");
+
+    if(i_width > 0)
     {
-        memory->free_char((char** )&i_buf);
-        memory->free_char((char** )&o_buf);
+        GA_Destroy(i_ga);
+        GA_Destroy(o_ga);
     }
 
-    memory->free_int(&i_start);
-    memory->free_int(&o_start);
+    i_width = i_cnt;
+    o_width = o_cnt;
+
+    char i_ga_name[] = "i_ga";
+    i_ga = create_array(i_ga_name, i_ga_type, i_ndims, i_width, i_start);
+
+    char o_ga_name[] = "o_ga";
+    o_ga = create_array(o_ga_name, o_ga_type, o_ndims, o_width, o_start);
 }
 
 int mexico::RuntimeImpl_GA_Common::convert_mpi_type_to_ga_type(MPI_Datatype type)
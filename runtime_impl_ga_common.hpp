@@ -71,8 +71,95 @@ protected:
     int *i_start, *o_start;
     /// Processor group handle
     int p_handle;
+    /// Ranks of the workers in MPI_COMM_WORLD
+    int* worker_world;
     /// Whether or not to use GA_Set_irreg_distr()
     bool use_irreg_distr;
+    /// Lay out the global arrays as two-dimensional arrays with one row
+    /// per value and i_cnt (o_cnt) columns so that each value is
+    /// addressed by a single patch. The arrays are created in
+    /// set_row_width() on the first call
+    bool rows;
+    /// Number of columns of i_ga and o_ga or zero if the arrays are
+    /// one-dimensional
+    int i_width, o_width;
+    /// Total number of elements and GA types of the global arrays
+    int i_ndims, o_ndims;
+    int i_ga_type, o_ga_type;
+
+    /// Create a global array with N elements of the given type. If width
+    /// is positive the array has N/width rows and width columns. start
+    /// holds the first element of each worker. The function is
+    /// collective
+    int create_array(char* name, int type, int N, int width, int* start);
+
+    /// If rows is true, (re)create the global arrays for values with
+    /// i_cnt and o_cnt elements. The counts must be the same on all
+    /// processing elements. The function is collective
+    void set_row_width(int i_cnt, int o_cnt);
+
+    /// Compute the subscripts of the patch which holds the elements
+    /// lo, ..., lo + cnt - 1 of ga. If ga is two-dimensional the range
+    /// must consist of whole rows
+    inline void patch(int ga, int lo, int cnt, int* plo, int* phi, int* ld)
+    {
+        int w;
+
+        w = (ga == i_ga) ? i_width : o_width;
+
+        if(0 == w)
+        {
+            plo[0] = lo;
+            phi[0] = lo + cnt - 1;
+            ld[0]  = cnt;
+            return;
+        }
+
+        plo[0] = lo/w;
+        plo[1] = 0;
+        phi[0] = (lo + cnt)/w - 1;
+        phi[1] = w - 1;
+        ld[0]  = w;
+    }
+
+    /// Maximal number of outstanding non-blocking puts and gets. If
+    /// zero, NGA_Put and NGA_Get are used. Defaults to 16 if rows is set
+    int nb_window;
+    /// Handles of the outstanding operations (a ring buffer of length
+    /// nb_window), their number and the next slot
+    ga_nbhdl_t* nb_handles;
+    int nb_num;
+    int nb_next;
+
+    /// Return the handle for the next non-blocking operation. If nb_window
+    /// operations are outstanding, the oldest one is completed first
+    inline ga_nbhdl_t* nb_handle()
+    {
+        ga_nbhdl_t* h;
+
+        h = &nb_handles[nb_next];
+
+        if(nb_num == nb_window)
+            NGA_NbWait(h);
+        else
+            ++nb_num;
+
+        nb_next = (nb_next + 1)%nb_window;
+
+        return h;
+    }
+
+    /// Complete all outstanding non-blocking operations
+    inline void wait_all()
+    {
+        int k;
+
+        for(k = 0; k < nb_num; ++k)
+            NGA_NbWait(&nb_handles[k]);
+
+        nb_num  = 0;
+        nb_next = 0;
+    }
 
     /// Convert from an MPI_Datatype to a GA type
     int convert_mpi_type_to_ga_type(MPI_Datatype type);
@@ -90,13 +177,18 @@ protected:
           get_num;
     float get_avg_cnt;
 
-    /// Simplified interface for NGA_Put
+    /// Simplified interface for NGA_Put and NGA_NbPut. The buffer must
+    /// not be modified before wait_all() is called
     inline void put(int ga, int lo, int cnt, void* buf)
     {
-        int hi;
+        int plo[2], phi[2], ld[1];
 
-        hi = lo + cnt - 1;
-        NGA_Put(ga, &lo, &hi, buf, NULL);
+        patch(ga, lo, cnt, plo, phi, ld);
+
+        if(nb_window > 0)
+            NGA_NbPut(ga, plo, phi, buf, ld, nb_handle());
+        else
+            NGA_Put(ga, plo, phi, buf, ld);
 
         put_min_cnt = std::min(put_min_cnt, cnt);
         put_max_cnt = std::max(put_max_cnt, cnt);
@@ -105,13 +197,18 @@ protected:
         put_num += 1;    
     }
 
-    /// Simplified interface for NGA_Get
+    /// Simplified interface for NGA_Get and NGA_NbGet. The buffer must
+    /// not be accessed before wait_all() is called
     inline void get(int ga, int lo, int cnt, void* buf)
     {
-        int hi;
+        int plo[2], phi[2], ld[1];
+
+        patch(ga, lo, cnt, plo, phi, ld);
 
-        hi = lo + cnt - 1;
-        NGA_Get(ga, &lo, &hi, buf, NULL);
+        if(nb_window > 0)
+            NGA_NbGet(ga, plo, phi, buf, ld, nb_handle());
+        else
+            NGA_Get(ga, plo, phi, buf, ld);
 
         get_min_cnt = std::min(get_min_cnt, cnt);
         get_max_cnt = std::max(get_max_cnt, cnt);
@@ -123,28 +220,28 @@ protected:
     /// Simplified interface for NGA_Access
     inline void access(int ga, int lo, int cnt, void* ptr)
     {
-        int hi;
+        int plo[2], phi[2], ld[1];
 
-        hi = lo + cnt - 1;
-        NGA_Access(ga, &lo, &hi, ptr, NULL);
+        patch(ga, lo, cnt, plo, phi, ld);
+        NGA_Access(ga, plo, phi, ptr, ld);
     }
 
     /// Simplified interface for NGA_Release
     inline void release(int ga, int lo, int cnt)
     {
-        int hi;
+        int plo[2], phi[2], ld[1];
 
-        hi = lo + cnt - 1;
-        NGA_Release(ga, &lo, &hi);
+        patch(ga, lo, cnt, plo, phi, ld);
+        NGA_Release(ga, plo, phi);
     }
 
     /// Simplified interface for NGA_Release_update
     inline void release_update(int ga, int lo, int cnt)
     {
-        int hi;
+        int plo[2], phi[2], ld[1];
 
-        hi = lo + cnt - 1;
-        NGA_Release_update(ga, &lo, &hi);
+        patch(ga, lo, cnt, plo, phi, ld);
+        NGA_Release_update(ga, plo, phi);
     }
 
 };
@@ -44,6 +44,7 @@
 #include "assert.hpp"
 #include "utils.hpp"
 #include "log.hpp"
+#include "runs.hpp"
 
 
 #ifdef MEXICO_HAVE_GA
@@ -53,6 +54,9 @@ mexico::RuntimeImpl_GA_gs::RuntimeImpl_GA_gs(Instance* ptr, const std::string& h
     spots = 0;
     subsarray = 0;
     vals = 0;
+
+    i_runs = (rows) ? new Runs(instance) : 0;
+    o_runs = (rows) ? new Runs(instance) : 0;
 }
 
 mexico::RuntimeImpl_GA_gs::~RuntimeImpl_GA_gs()
@@ -60,6 +64,9 @@ mexico::RuntimeImpl_GA_gs::~RuntimeImpl_GA_gs()
     memory->free_char((char** )&vals);
     memory->free_int(&spots);
     memory->free_ptr((void*** )&subsarray);
+
+    delete i_runs;
+    delete o_runs;
 }
 
 void mexico::RuntimeImpl_GA_gs::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
@@ -67,50 +74,68 @@ void mexico::RuntimeImpl_GA_gs::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_
                                           void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
                                           int* o_worker, int* o_offsets)
 {
-    int i, j, k, w, lo, num_vals_to_send, ii;
+    int i, j, k, w, lo, num_vals_to_send, ii, r;
     MPI_Aint i_extent;
 
     /// ----------------------------------------------------------------------
     /// Exchange the data
     MPI_Type_extent(i_type, &i_extent);
 
-    num_vals_to_send = 0;
-    for(j = 0; j < i_max_worker_per_val; ++j)
-        for(i = 0; i < i_num_vals; ++i)
-        {
-            if(-1 == (w = i_worker[i + i_num_vals*j]))
-                continue;
+    set_row_width(i_cnt, o_cnt);
+
+    if(rows)
+    {
+        /// Each value is a single row of i_ga. Values with consecutive
+        /// offsets on the same worker form a run of rows which is moved
+        /// with a single patch put
+        i_runs->build(i_num_vals, i_max_worker_per_val, i_worker, i_offsets, false);
+        i_runs->gather(i_buf, i_cnt*i_extent);
+
+        for(r = 0; r < i_runs->num_runs; ++r)
+            put(i_ga, i_start[i_runs->run_worker[r]] + i_cnt*i_runs->run_offset[r], i_cnt*i_runs->run_len[r],
+                i_runs->staging + i_runs->run_first[r]*i_cnt*i_extent);
+    }
+    else
+    {
+        num_vals_to_send = 0;
+        for(j = 0; j < i_max_worker_per_val; ++j)
+            for(i = 0; i < i_num_vals; ++i)
+            {
+                if(-1 == (w = i_worker[i + i_num_vals*j]))
+                    continue;
 #ifndef NDEBUG
-            if(w < 0 || w >= comm->nprocs)
-                MEXICO_FATAL("Invalid worker w = %d", w);
+                if(w < 0 || w >= comm->nprocs)
+                    MEXICO_FATAL("Invalid worker w = %d", w);
 #endif
 
-            num_vals_to_send += i_cnt;
-        }
+                num_vals_to_send += i_cnt;
+            }
 
-    memory->realloc_char((char** )&vals, num_vals_to_send*i_extent);
-    memory->realloc_int(&spots, num_vals_to_send);
-    memory->realloc_ptr((void*** )&subsarray, num_vals_to_send);
+        memory->realloc_char((char** )&vals, num_vals_to_send*i_extent);
+        memory->realloc_int(&spots, num_vals_to_send);
+        memory->realloc_ptr((void*** )&subsarray, num_vals_to_send);
 
-    ii = 0;
-    for(j = 0; j < i_max_worker_per_val; ++j)
-        for(i = 0; i < i_num_vals; ++i)
-        {
-            if(-1 == (w = i_worker[i + i_num_vals*j]))
-                continue;
-            
-            lo = i_start[w] + i_cnt*i_offsets[i + i_num_vals*j];
-            
-            std::copy(&((char* )i_buf)[i_cnt*i_extent*i],
-                      &((char* )i_buf)[i_cnt*i_extent*i]+i_cnt*i_extent,
-                      &((char* )vals)[ii*i_extent]);
-
-            for(k = 0; k < i_cnt; ++k, ++ii)
-                subsarray[ii] = &(spots[ii] = lo + k);
-        }
+        ii = 0;
+        for(j = 0; j < i_max_worker_per_val; ++j)
+            for(i = 0; i < i_num_vals; ++i)
+            {
+                if(-1 == (w = i_worker[i + i_num_vals*j]))
+                    continue;
+
+                lo = i_start[w] + i_cnt*i_offsets[i + i_num_vals*j];
+
+                std::copy(&((char* )i_buf)[i_cnt*i_extent*i],
+                          &((char* )i_buf)[i_cnt*i_extent*i]+i_cnt*i_extent,
+                          &((char* )vals)[ii*i_extent]);
 
-    NGA_Scatter(i_ga, vals, subsarray, num_vals_to_send); 
+                for(k = 0; k < i_cnt; ++k, ++ii)
+                    subsarray[ii] = &(spots[ii] = lo + k);
+            }
 
+        NGA_Scatter(i_ga, vals, subsarray, num_vals_to_send); 
+    }
+
+    wait_all();
     GA_Pgroup_sync(p_handle);
     MEXICO_WRITE(Log::DEBUG, "Finished exchange of data");
     /// ----------------------------------------------------------------------
@@ -131,6 +156,7 @@ void mexico::RuntimeImpl_GA_gs::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_
         if(instance->pe_is_worker)
             get(i_ga, i_start[comm->myrank], job->i_N, this->i_buf);
 
+        wait_all();
         GA_Pgroup_sync(p_handle);
         MEXICO_WRITE(Log::DEBUG, "Finished copy to local buffer");
     }
@@ -142,7 +168,7 @@ void mexico::RuntimeImpl_GA_gs::post_comm(void* i_buf, int i_cnt, MPI_Datatype i
                                            void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
                                            int* o_worker, int* o_offsets)
 {
-    int i, j, k, w, lo, num_vals_to_recv, ii;
+    int i, j, k, w, lo, num_vals_to_recv, ii, r;
     MPI_Aint o_extent;
     
     MPI_Type_extent(o_type, &o_extent);
@@ -167,6 +193,7 @@ void mexico::RuntimeImpl_GA_gs::post_comm(void* i_buf, int i_cnt, MPI_Datatype i
         if(instance->pe_is_worker)
             put(o_ga, o_start[comm->myrank], job->o_N, this->o_buf);
 
+        wait_all();
         GA_Pgroup_sync(p_handle);
         MEXICO_WRITE(Log::DEBUG, "Finished copy to global array");
     }
@@ -175,38 +202,56 @@ void mexico::RuntimeImpl_GA_gs::post_comm(void* i_buf, int i_cnt, MPI_Datatype i
     /// ----------------------------------------------------------------------
     /// Exchange the data
 
-    num_vals_to_recv = 0;
-    for(j = 0; j < o_max_worker_per_val; ++j)
-        for(i = 0; i < o_num_vals; ++i)
-        {
-            if(-1 == (w = o_worker[i + o_num_vals*j]))
-                continue;
+    if(rows)
+    {
+        /// Each value is a single row of o_ga (see pre_comm())
+        o_runs->build(o_num_vals, o_max_worker_per_val, o_worker, o_offsets, true);
+        o_runs->alloc_staging(o_cnt*o_extent);
+
+        for(r = 0; r < o_runs->num_runs; ++r)
+            get(o_ga, o_start[o_runs->run_worker[r]] + o_cnt*o_runs->run_offset[r], o_cnt*o_runs->run_len[r],
+                o_runs->staging + o_runs->run_first[r]*o_cnt*o_extent);
+
+        /// The gets must complete before the staging buffer is read
+        wait_all();
+        o_runs->scatter(o_buf, o_cnt*o_extent);
+    }
+    else
+    {
+        num_vals_to_recv = 0;
+        for(j = 0; j < o_max_worker_per_val; ++j)
+            for(i = 0; i < o_num_vals; ++i)
+            {
+                if(-1 == (w = o_worker[i + o_num_vals*j]))
+                    continue;
 #ifndef NDEBUG
-            if(w < 0 || w >= comm->nprocs)
-                MEXICO_FATAL("Invalid worker w = %d", w);
+                if(w < 0 || w >= comm->nprocs)
+                    MEXICO_FATAL("Invalid worker w = %d", w);
 #endif
 
-            num_vals_to_recv += o_cnt;
-        }
+                num_vals_to_recv += o_cnt;
+            }
 
-    memory->realloc_char((char** )&vals, num_vals_to_recv*o_extent);
-    memory->realloc_int(&spots, num_vals_to_recv);
-    memory->realloc_ptr((void*** )&subsarray, num_vals_to_recv);
+        memory->realloc_char((char** )&vals, num_vals_to_recv*o_extent);
+        memory->realloc_int(&spots, num_vals_to_recv);
+        memory->realloc_ptr((void*** )&subsarray, num_vals_to_recv);
 
-    ii = 0;
-    for(j = 0; j < o_max_worker_per_val; ++j)
-        for(i = 0; i < o_num_vals; ++i)
-        {
-            if(-1 == (w = o_worker[i + o_num_vals*j]))
-                continue;
+        ii = 0;
+        for(j = 0; j < o_max_worker_per_val; ++j)
+            for(i = 0; i < o_num_vals; ++i)
+            {
+                if(-1 == (w = o_worker[i + o_num_vals*j]))
+                    continue;
 
-            lo = o_start[w] + o_cnt*o_offsets[i + o_num_vals*j];
-            for(k = 0; k < o_cnt; ++k, ++ii)
-                subsarray[ii] = &(spots[ii] = lo + k);
-        }
+                lo = o_start[w] + o_cnt*o_offsets[i + o_num_vals*j];
+                for(k = 0; k < o_cnt; ++k, ++ii)
+                    subsarray[ii] = &(spots[ii] = lo + k);
+            }
 
-    NGA_Gather(o_ga, o_buf, subsarray, num_vals_to_recv); 
+        NGA_Gather(o_ga, o_buf, subsarray, num_vals_to_recv); 
+    }
 
+    wait_all();
     GA_Pgroup_sync(p_handle);
     MEXICO_WRITE(Log::DEBUG, "Finished exchange of data");
     /// ----------------------------------------------------------------------
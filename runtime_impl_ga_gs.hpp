@@ -41,6 +41,8 @@
 namespace mexico
 {
 
+class Runs;
+
 /// RuntimeImpl_GA_gs: Runtime implementation based on the Global Arrays
 ///                    library which uses gather/scatter mechanisms
 class RuntimeImpl_GA_gs : public RuntimeImpl_GA_Common
@@ -93,6 +95,10 @@ private:
     int** subsarray;
     /// The value array
     char* vals;
+    /// If rows is true, the runs of consecutive rows for each put or
+    /// get (see Runs)
+    Runs* i_runs;
+    Runs* o_runs;
 
 };
 
@@ -39,6 +39,7 @@
 #include "runtime_impl_mpi_alltoall.hpp"
 #include "job.hpp"
 #include "runtime.hpp"
+#include "plan.hpp"
 #include "memory.hpp"
 #include "comm.hpp"
 #include "assert.hpp"
@@ -52,6 +53,9 @@ mexico::RuntimeImpl_MPI_Alltoall::RuntimeImpl_MPI_Alltoall(Instance* ptr, const
     /// Read the hints
     MEXICO_READ_HINT(hints, "pack", pack);
     MEXICO_READ_HINT(hints, "exch_with_pt2pt", exch_with_pt2pt);
+    MEXICO_READ_HINT(hints, "cache_plan", cache_plan);
+    MEXICO_READ_HINT(hints, "counts_nbx", counts_nbx);
+    MEXICO_READ_HINT(hints, "counts_reduce_scatter", counts_reduce_scatter);
 
     if(instance->pe_is_worker)
     {
@@ -85,20 +89,17 @@ mexico::RuntimeImpl_MPI_Alltoall::RuntimeImpl_MPI_Alltoall(Instance* ptr, const
     comm_send_buf = 0;
     comm_recv_buf = 0;
 
-    if(exch_with_pt2pt)
-    {
-        send_req = (MPI_Request* )memory->alloc_char(comm->nprocs*sizeof(MPI_Request));
-        recv_req = (MPI_Request* )memory->alloc_char(comm->nprocs*sizeof(MPI_Request));
-    }
+    /// Sized to the number of peers on demand
+    send_req = 0;
+    recv_req = 0;
+    num_send_req = 0;
+    num_recv_req = 0;
 }
 
 mexico::RuntimeImpl_MPI_Alltoall::~RuntimeImpl_MPI_Alltoall()
 {
-    if(exch_with_pt2pt)
-    {  
-        memory->free_char((char** )&send_req);
-        memory->free_char((char** )&recv_req);
-    }        
+    memory->free_char((char** )&send_req);
+    memory->free_char((char** )&recv_req);
     
     memory->free_int(&offsets_send_buf);
     memory->free_int(&offsets_recv_buf);
@@ -151,6 +152,14 @@ void mexico::RuntimeImpl_MPI_Alltoall::pre_comm(void* i_buf, int i_cnt, MPI_Data
     long N, stride;
     MPI_Datatype packed;
 
+    if(cache_plan)
+    {
+        pre_comm(update_cached_plan(i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                                    o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets),
+                 i_buf, o_buf);
+        return;
+    }
+
     /// ----------------------------------------------------------------------
     /// Count the number of messages to be send and received
     std::fill(num_msgs_to_send, num_msgs_to_send+comm->nprocs, 0);
@@ -169,7 +178,7 @@ void mexico::RuntimeImpl_MPI_Alltoall::pre_comm(void* i_buf, int i_cnt, MPI_Data
             num_msgs_to_send[w] += 1;
         }
     
-    comm->alltoall(num_msgs_to_send, 1, MPI_INT, num_msgs_to_recv, 1, MPI_INT);
+    exchange_counts(num_msgs_to_send, num_msgs_to_recv);
 
     MEXICO_WRITE(Log::DEBUG, "num_msgs_to_[send,recv] = [ %d, %d ]",
                     std::accumulate(num_msgs_to_send, num_msgs_to_send+comm->nprocs, 0),
@@ -309,6 +318,13 @@ void mexico::RuntimeImpl_MPI_Alltoall::post_comm(void* i_buf, int i_cnt, MPI_Dat
     int i, j, k, w;
     MPI_Aint o_extent;
 
+    /// The plan has been updated in pre_comm()
+    if(cache_plan)
+    {
+        post_comm(cached_plan, i_buf, o_buf);
+        return;
+    }
+
     /// ----------------------------------------------------------------------
     /// Count the number of messages to be send and received
     std::fill(num_msgs_to_recv, num_msgs_to_recv+comm->nprocs, 0);
@@ -327,7 +343,7 @@ void mexico::RuntimeImpl_MPI_Alltoall::post_comm(void* i_buf, int i_cnt, MPI_Dat
             num_msgs_to_recv[w] += 1;
         }
 
-    comm->alltoall(num_msgs_to_recv, 1, MPI_INT, num_msgs_to_send, 1, MPI_INT);
+    exchange_counts(num_msgs_to_recv, num_msgs_to_send);
 
     MEXICO_WRITE(Log::DEBUG, "num_msgs_to_[send,recv] = [ %d, %d ]",
                     std::accumulate(num_msgs_to_send, num_msgs_to_send+comm->nprocs, 0),
@@ -419,6 +435,184 @@ void mexico::RuntimeImpl_MPI_Alltoall::post_comm(void* i_buf, int i_cnt, MPI_Dat
     /// ----------------------------------------------------------------------
 }
 
+mexico::Plan* mexico::RuntimeImpl_MPI_Alltoall::create_plan(int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                            int* i_worker, int* i_offsets,
+                                                            int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                            int* o_worker, int* o_offsets)
+{
+    return new Plan_MPI_Common(instance, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                               o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets);
+}
+
+void mexico::RuntimeImpl_MPI_Alltoall::pre_comm(Plan* plan, void* i_buf, void* o_buf)
+{
+    Plan_MPI_Common* p = static_cast<Plan_MPI_Common*>(plan);
+    int k, m, w, i_cnt;
+    MPI_Aint i_extent;
+    long n;
+
+    i_cnt = p->i_cnt;
+    MPI_Type_extent(p->i_type, &i_extent);
+
+    /// ----------------------------------------------------------------------
+    /// Pack the data in the order of the plan
+    memory->realloc_char((char** )&comm_send_buf, p->i_total_send*i_cnt*    i_extent);
+    memory->realloc_char((char** )&comm_recv_buf, p->i_total_recv*i_cnt*job_i_extent);
+
+    n = 0;
+    for(m = 0; m < p->i_num_send_peers; ++m)
+    {
+        w = p->i_send_peers[m];
+
+        for(k = 0; k < p->i_num_msgs_to_send[w]; ++k, ++n)
+            std::copy(&((char* )i_buf)[i_cnt*i_extent*p->i_send_idx[w][k]],
+                      &((char* )i_buf)[i_cnt*i_extent*p->i_send_idx[w][k]]+i_cnt*i_extent,
+                      &((char* )comm_send_buf)[n*i_cnt*i_extent]);
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Communicate the values
+    if(instance->pe_is_worker)  /// No job pointer on non-worker processing elements
+        exchange(comm_send_buf, p->i_num_send_peers, p->i_send_peers, p->i_num_vals_to_send, p->i_send_displs,    p->i_type,
+                 comm_recv_buf, p->i_num_recv_peers, p->i_recv_peers, p->i_num_vals_to_recv, p->i_recv_displs, job->i_type);
+    else
+        exchange(comm_send_buf, p->i_num_send_peers, p->i_send_peers, p->i_num_vals_to_send, p->i_send_displs, p->i_type,
+                 comm_recv_buf, p->i_num_recv_peers, p->i_recv_peers, p->i_num_vals_to_recv, p->i_recv_displs, p->i_type /* Type doesn't matter */);
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Reorder the data
+    n = 0;
+    for(m = 0; m < p->i_num_recv_peers; ++m)
+    {
+        w = p->i_recv_peers[m];
+
+        for(k = 0; k < p->i_num_msgs_to_recv[w]; ++k, ++n)
+        {
+            MEXICO_ASSERT(p->i_recv_offsets[w][k]*i_cnt < job->i_N);
+
+            /// Caution: Need to use the i_buf member variable here!
+            std::copy(&((char* )comm_recv_buf)[n*i_cnt*job_i_extent],
+                      &((char* )comm_recv_buf)[n*i_cnt*job_i_extent]+i_cnt*job_i_extent,
+                      &((char* )this->i_buf)[p->i_recv_offsets[w][k]*i_cnt*job_i_extent]);
+        }
+    }
+    /// ----------------------------------------------------------------------
+}
+
+void mexico::RuntimeImpl_MPI_Alltoall::post_comm(Plan* plan, void* i_buf, void* o_buf)
+{
+    post_comm_begin(plan, i_buf, o_buf);
+    post_comm_wait();
+}
+
+void mexico::RuntimeImpl_MPI_Alltoall::post_comm_begin(Plan* plan, void* i_buf, void* o_buf)
+{
+    Plan_MPI_Common* p = static_cast<Plan_MPI_Common*>(plan);
+    int k, m, w, o_cnt;
+    MPI_Aint o_extent;
+    long n;
+
+    o_cnt = p->o_cnt;
+    MPI_Type_extent(p->o_type, &o_extent);
+
+    memory->realloc_char((char** )&comm_send_buf, p->o_total_send*o_cnt*job_o_extent);
+    memory->realloc_char((char** )&comm_recv_buf, p->o_total_recv*o_cnt*    o_extent);
+
+    /// ----------------------------------------------------------------------
+    /// Gather the output data on the worker
+    n = 0;
+    for(m = 0; m < p->o_num_send_peers; ++m)
+    {
+        w = p->o_send_peers[m];
+
+        for(k = 0; k < p->o_num_msgs_to_send[w]; ++k, ++n)
+        {
+            MEXICO_ASSERT(p->o_send_offsets[w][k]*o_cnt < job->o_N);
+
+            /// Caution: Need to use the o_buf member variable here!
+            std::copy(&((char* )this->o_buf)[p->o_send_offsets[w][k]*o_cnt*job_o_extent],
+                      &((char* )this->o_buf)[p->o_send_offsets[w][k]*o_cnt*job_o_extent]+o_cnt*job_o_extent,
+                      &((char* )comm_send_buf)[n*o_cnt*job_o_extent]);
+        }
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Start communicating the values
+    if(instance->pe_is_worker)  /// No job pointer on non-worker processing elements
+        exchange_begin(comm_send_buf, p->o_num_send_peers, p->o_send_peers, p->o_num_vals_to_send, p->o_send_displs, job->o_type,
+                       comm_recv_buf, p->o_num_recv_peers, p->o_recv_peers, p->o_num_vals_to_recv, p->o_recv_displs,    p->o_type);
+    else
+        exchange_begin(comm_send_buf, p->o_num_send_peers, p->o_send_peers, p->o_num_vals_to_send, p->o_send_displs, p->o_type /* Type doesn't matter */,
+                       comm_recv_buf, p->o_num_recv_peers, p->o_recv_peers, p->o_num_vals_to_recv, p->o_recv_displs, p->o_type);
+    /// ----------------------------------------------------------------------
+
+    pending_plan  = plan;
+    pending_i_buf = i_buf;
+    pending_o_buf = o_buf;
+}
+
+bool mexico::RuntimeImpl_MPI_Alltoall::post_comm_test()
+{
+    if(!pending_plan)
+        return true;
+
+    if(!exchange_test())
+        return false;
+
+    post_comm_finish();
+    return true;
+}
+
+void mexico::RuntimeImpl_MPI_Alltoall::post_comm_wait()
+{
+    if(!pending_plan)
+        return;
+
+    exchange_wait();
+    post_comm_finish();
+}
+
+void mexico::RuntimeImpl_MPI_Alltoall::post_comm_finish()
+{
+    Plan_MPI_Common* p = static_cast<Plan_MPI_Common*>(pending_plan);
+    int k, m, w, o_cnt;
+    MPI_Aint o_extent;
+    long n;
+
+    o_cnt = p->o_cnt;
+    MPI_Type_extent(p->o_type, &o_extent);
+
+    /// ----------------------------------------------------------------------
+    /// Reorder the data
+    n = 0;
+    for(m = 0; m < p->o_num_recv_peers; ++m)
+    {
+        w = p->o_recv_peers[m];
+
+        for(k = 0; k < p->o_num_msgs_to_recv[w]; ++k, ++n)
+            std::copy(&((char* )comm_recv_buf)[n*o_cnt*o_extent],
+                      &((char* )comm_recv_buf)[n*o_cnt*o_extent]+o_cnt*o_extent,
+                      &((char* )pending_o_buf)[o_cnt*o_extent*p->o_recv_idx[w][k]]);
+    }
+    /// ----------------------------------------------------------------------
+
+    pending_plan = 0;
+}
+
+void mexico::RuntimeImpl_MPI_Alltoall::exchange_counts(int* sendcnts, int* recvcnts)
+{
+    if(counts_nbx)
+        comm->alltoall_counts_nbx(sendcnts, recvcnts);
+    else
+    if(counts_reduce_scatter)
+        comm->alltoall_counts_reduce_scatter(sendcnts, recvcnts);
+    else
+        comm->alltoall(sendcnts, 1, MPI_INT, recvcnts, 1, MPI_INT);
+}
+
 void mexico::RuntimeImpl_MPI_Alltoall::exchange(void* send_buf, int* num_msgs_to_send, MPI_Datatype send_type,
                                                 void* recv_buf, int* num_msgs_to_recv, MPI_Datatype recv_type)
 {   
@@ -429,25 +623,28 @@ void mexico::RuntimeImpl_MPI_Alltoall::exchange(void* send_buf, int* num_msgs_to
     {
         MPI_Type_extent(recv_type, &recv_extent);
 
+        memory->realloc_char((char** )&recv_req, count_positive(num_msgs_to_recv, num_msgs_to_recv+comm->nprocs)*sizeof(MPI_Request));
+        memory->realloc_char((char** )&send_req, count_positive(num_msgs_to_send, num_msgs_to_send+comm->nprocs)*sizeof(MPI_Request));
+
         /// Prepost the receives
         incl_scan(num_msgs_to_recv, num_msgs_to_recv+comm->nprocs, displs);
+
+        num_recv_req = 0;
         for(w = 0; w < comm->nprocs; ++w)
             if(num_msgs_to_recv[w] > 0)
-                recv_req[w] = comm->irecv((char* )recv_buf + displs[w]*recv_extent, num_msgs_to_recv[w], recv_type, w, 0);
-            else
-                recv_req[w] = MPI_REQUEST_NULL;
+                recv_req[num_recv_req++] = comm->irecv((char* )recv_buf + displs[w]*recv_extent, num_msgs_to_recv[w], recv_type, w, 0);
 
         MPI_Type_extent(send_type, &send_extent);
 
         incl_scan(num_msgs_to_send, num_msgs_to_send+comm->nprocs, displs);
+
+        num_send_req = 0;
         for(w = 0; w < comm->nprocs; ++w)
             if(num_msgs_to_send[w] > 0)
-                send_req[w] = comm->isend((char* )send_buf + displs[w]*send_extent, num_msgs_to_send[w], send_type, w, 0);
-            else
-                send_req[w] = MPI_REQUEST_NULL;
+                send_req[num_send_req++] = comm->isend((char* )send_buf + displs[w]*send_extent, num_msgs_to_send[w], send_type, w, 0);
 
-        MPI_Waitall(comm->nprocs, recv_req, MPI_STATUSES_IGNORE);
-        MPI_Waitall(comm->nprocs, send_req, MPI_STATUSES_IGNORE);
+        MPI_Waitall(num_recv_req, recv_req, MPI_STATUSES_IGNORE);
+        MPI_Waitall(num_send_req, send_req, MPI_STATUSES_IGNORE);
     }
     else
     {
@@ -456,3 +653,77 @@ void mexico::RuntimeImpl_MPI_Alltoall::exchange(void* send_buf, int* num_msgs_to
     }
 }
 
+void mexico::RuntimeImpl_MPI_Alltoall::exchange(void* send_buf, int num_send_peers, int* send_peers, int* num_msgs_to_send, int* send_displs, MPI_Datatype send_type,
+                                                void* recv_buf, int num_recv_peers, int* recv_peers, int* num_msgs_to_recv, int* recv_displs, MPI_Datatype recv_type)
+{
+    exchange_begin(send_buf, num_send_peers, send_peers, num_msgs_to_send, send_displs, send_type,
+                   recv_buf, num_recv_peers, recv_peers, num_msgs_to_recv, recv_displs, recv_type);
+    exchange_wait();
+}
+
+void mexico::RuntimeImpl_MPI_Alltoall::exchange_begin(void* send_buf, int num_send_peers, int* send_peers, int* num_msgs_to_send, int* send_displs, MPI_Datatype send_type,
+                                                      void* recv_buf, int num_recv_peers, int* recv_peers, int* num_msgs_to_recv, int* recv_displs, MPI_Datatype recv_type)
+{
+    MPI_Aint send_extent, recv_extent;
+    int m, w;
+
+    if(exch_with_pt2pt)
+    {
+        memory->realloc_char((char** )&recv_req, num_recv_peers*sizeof(MPI_Request));
+        memory->realloc_char((char** )&send_req, num_send_peers*sizeof(MPI_Request));
+
+        MPI_Type_extent(recv_type, &recv_extent);
+
+        /// Prepost the receives
+        for(m = 0; m < num_recv_peers; ++m)
+        {
+            w = recv_peers[m];
+            recv_req[m] = comm->irecv((char* )recv_buf + recv_displs[w]*recv_extent, num_msgs_to_recv[w], recv_type, w, 0);
+        }
+        num_recv_req = num_recv_peers;
+
+        MPI_Type_extent(send_type, &send_extent);
+
+        for(m = 0; m < num_send_peers; ++m)
+        {
+            w = send_peers[m];
+            send_req[m] = comm->isend((char* )send_buf + send_displs[w]*send_extent, num_msgs_to_send[w], send_type, w, 0);
+        }
+        num_send_req = num_send_peers;
+    }
+    else
+    {
+        exch_req = comm->ialltoallv(send_buf, num_msgs_to_send, send_displs, send_type,
+                                    recv_buf, num_msgs_to_recv, recv_displs, recv_type);
+    }
+}
+
+bool mexico::RuntimeImpl_MPI_Alltoall::exchange_test()
+{
+    int flag;
+
+    if(exch_with_pt2pt)
+    {
+        MPI_Testall(num_recv_req, recv_req, &flag, MPI_STATUSES_IGNORE);
+        if(!flag)
+            return false;
+
+        MPI_Testall(num_send_req, send_req, &flag, MPI_STATUSES_IGNORE);
+    }
+    else
+        MPI_Test(&exch_req, &flag, MPI_STATUS_IGNORE);
+
+    return flag;
+}
+
+void mexico::RuntimeImpl_MPI_Alltoall::exchange_wait()
+{
+    if(exch_with_pt2pt)
+    {
+        MPI_Waitall(num_recv_req, recv_req, MPI_STATUSES_IGNORE);
+        MPI_Waitall(num_send_req, send_req, MPI_STATUSES_IGNORE);
+    }
+    else
+        MPI_Wait(&exch_req, MPI_STATUS_IGNORE);
+}
+
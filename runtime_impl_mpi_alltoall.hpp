@@ -82,6 +82,34 @@ public:
                    int* o_worker,
                    int* o_offsets);
 
+    /// See RuntimeImpl::create_plan(). Returns a Plan_MPI_Common
+    Plan* create_plan(int i_cnt,
+                      MPI_Datatype i_type,
+                      int i_num_vals,
+                      int i_max_worker_per_val,
+                      int* i_worker,
+                      int* i_offsets,
+                      int o_cnt,
+                      MPI_Datatype o_type,
+                      int o_num_vals,
+                      int o_max_worker_per_val,
+                      int* o_worker,
+                      int* o_offsets);
+
+    /// Plan-based pre_comm(): Only the payload is exchanged
+    void pre_comm(Plan* plan, void* i_buf, void* o_buf);
+
+    /// Plan-based post_comm(): Only the payload is exchanged
+    void post_comm(Plan* plan, void* i_buf, void* o_buf);
+
+    /// Split-phase plan-based post_comm(): post_comm_begin() gathers the
+    /// output on the workers and starts the non-blocking exchange.
+    /// post_comm_test() and post_comm_wait() scatter the data into o_buf once
+    /// it has arrived
+    void post_comm_begin(Plan* plan, void* i_buf, void* o_buf);
+    bool post_comm_test();
+    void post_comm_wait();
+
 
 private:    
     /// Number of messages to receive and send
@@ -107,21 +135,53 @@ private:
     int* displs;
 
     /// Send/recv requests. These are only used if exch_with_pt2pt
-    /// is true.
+    /// is true. One per peer, reallocated as needed
     MPI_Request* send_req;
     MPI_Request* recv_req;
+    int num_send_req;
+    int num_recv_req;
 
     /// Whether or not to pack offsets and data together in
     /// the pre_comm and post_comm routine. This only works if job->i_type 
     /// equals i_type
     bool pack;
+    /// Reuse the routing of the previous call if the pattern did not
+    /// change (see RuntimeImpl_MPI_Common::update_cached_plan())
+    bool cache_plan;
     /// Use point-to-point non-blocking communication in the
     /// exchange() routine or collective communication.
     bool exch_with_pt2pt;
+    /// Exchange the number of messages with Comm::alltoall_counts_nbx()
+    /// or Comm::alltoall_counts_reduce_scatter() instead of a dense 
+    /// alltoall. Pays off if the number of workers is small compared to
+    /// the number of processing elements
+    bool counts_nbx;
+    bool counts_reduce_scatter;
+
+    /// Exchange the number of messages (one integer per rank)
+    void exchange_counts(int* sendcnts, int* recvcnts);
 
     /// alltoallv() or point-to-point communication
     void exchange(void*, int*, MPI_Datatype, void*, int*, MPI_Datatype);
 
+    /// Same as above but with precomputed displacements and the lists
+    /// of peers with nonzero counts (see Plan_MPI_Common). The peer lists
+    /// are only used for point-to-point communication
+    void exchange(void*, int, int*, int*, int*, MPI_Datatype, void*, int, int*, int*, int*, MPI_Datatype);
+
+    /// Non-blocking variant of exchange() with precomputed displacements.
+    /// The exchange is finished by exchange_test() or exchange_wait()
+    void exchange_begin(void*, int, int*, int*, int*, MPI_Datatype, void*, int, int*, int*, int*, MPI_Datatype);
+    bool exchange_test();
+    void exchange_wait();
+
+    /// Request of the non-blocking alltoallv
+    MPI_Request exch_req;
+
+    /// Scatter the received output into o_buf and clear the pending
+    /// post_comm
+    void post_comm_finish();
+
 };
 
 }
@@ -29,16 +29,27 @@
  */
 
 #include "mexico_config.hpp"
+
+#include <numeric>
+#include <algorithm>
+
 #include "runtime_impl_mpi_common.hpp"
+#include "job.hpp"
+#include "memory.hpp"
+#include "comm.hpp"
+#include "assert.hpp"
+#include "utils.hpp"
+#include "log.hpp"
 
 
 mexico::RuntimeImpl_MPI_Common::RuntimeImpl_MPI_Common(Instance* ptr, const std::string& hints)
-: RuntimeImpl(ptr)
+: RuntimeImpl(ptr), cached_plan(0)
 {
 }
 
 mexico::RuntimeImpl_MPI_Common::~RuntimeImpl_MPI_Common()
 {
+    delete cached_plan;
 }
 
 MPI_Datatype mexico::RuntimeImpl_MPI_Common::create_struct_int_type(int cnt, MPI_Datatype type)
@@ -62,3 +73,576 @@ MPI_Datatype mexico::RuntimeImpl_MPI_Common::create_struct_int_type(int cnt, MPI
     return newtype;
 }
 
+mexico::Plan_MPI_Common* mexico::RuntimeImpl_MPI_Common::update_cached_plan(int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                                             int* i_worker, int* i_offsets,
+                                                                             int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                                             int* o_worker, int* o_offsets)
+{
+    int changed, any_changed;
+    long i_len, o_len;
+    Plan_MPI_Common* plan;
+
+    i_len = ((long )i_num_vals)*i_max_worker_per_val;
+    o_len = ((long )o_num_vals)*o_max_worker_per_val;
+
+    if(cached_plan)
+    {
+        changed = !(cached_plan->i_cnt                == i_cnt                &&
+                    cached_plan->i_type               == i_type               &&
+                    cached_plan->i_num_vals           == i_num_vals           &&
+                    cached_plan->i_max_worker_per_val == i_max_worker_per_val &&
+                    cached_plan->o_cnt                == o_cnt                &&
+                    cached_plan->o_type               == o_type               &&
+                    cached_plan->o_num_vals           == o_num_vals           &&
+                    cached_plan->o_max_worker_per_val == o_max_worker_per_val &&
+                    std::equal(i_worker , i_worker +i_len, cached_plan->i_worker ) &&
+                    std::equal(i_offsets, i_offsets+i_len, cached_plan->i_offsets) &&
+                    std::equal(o_worker , o_worker +o_len, cached_plan->o_worker ) &&
+                    std::equal(o_offsets, o_offsets+o_len, cached_plan->o_offsets));
+    }
+    else
+        changed = 1;
+
+    comm->allreduce(&changed, &any_changed, 1, MPI_INT, MPI_MAX);
+
+    if(any_changed)
+    {
+        MEXICO_WRITE(Log::DEBUG, "pattern changed, creating a new plan");
+
+        plan = create_cached_plan(cached_plan, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                                  o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets);
+
+        delete cached_plan;
+        cached_plan = plan;
+    }
+
+    return cached_plan;
+}
+
+mexico::Plan_MPI_Common* mexico::RuntimeImpl_MPI_Common::create_cached_plan(Plan_MPI_Common* prev,
+                                                                             int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                                             int* i_worker, int* i_offsets,
+                                                                             int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                                             int* o_worker, int* o_offsets)
+{
+    return new Plan_MPI_Common(instance, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                               o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets);
+}
+
+mexico::Plan_MPI_Common::Plan_MPI_Common(Instance* ptr, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                         int* i_worker, int* i_offsets,
+                                         int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                         int* o_worker, int* o_offsets)
+: Plan(ptr, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+       o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets)
+{
+    i_num_msgs_to_send = memory->alloc_int(comm->nprocs);
+    i_num_msgs_to_recv = memory->alloc_int(comm->nprocs);
+    i_num_vals_to_send = memory->alloc_int(comm->nprocs);
+    i_num_vals_to_recv = memory->alloc_int(comm->nprocs);
+    i_send_displs      = memory->alloc_int(comm->nprocs);
+    i_recv_displs      = memory->alloc_int(comm->nprocs);
+    i_send_idx         = (int** )memory->alloc_ptr(comm->nprocs);
+    i_recv_offsets     = (int** )memory->alloc_ptr(comm->nprocs);
+
+    o_num_msgs_to_send = memory->alloc_int(comm->nprocs);
+    o_num_msgs_to_recv = memory->alloc_int(comm->nprocs);
+    o_num_vals_to_send = memory->alloc_int(comm->nprocs);
+    o_num_vals_to_recv = memory->alloc_int(comm->nprocs);
+    o_send_displs      = memory->alloc_int(comm->nprocs);
+    o_recv_displs      = memory->alloc_int(comm->nprocs);
+    o_send_offsets     = (int** )memory->alloc_ptr(comm->nprocs);
+    o_recv_idx         = (int** )memory->alloc_ptr(comm->nprocs);
+
+    /// Allocated in layout()
+    i_send_peers = 0;
+    i_recv_peers = 0;
+    o_send_peers = 0;
+    o_recv_peers = 0;
+
+    /// ----------------------------------------------------------------------
+    /// Routing for pre_comm(): We send the values to the workers
+    route(i_num_vals, i_max_worker_per_val, this->i_worker, this->i_offsets, false,
+          i_num_msgs_to_send, i_num_msgs_to_recv, i_send_idx, i_recv_offsets);
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Routing for post_comm(): We send the offsets of the values we want to
+    /// receive, hence the roles of send and recv are swapped
+    route(o_num_vals, o_max_worker_per_val, this->o_worker, this->o_offsets, true,
+          o_num_msgs_to_recv, o_num_msgs_to_send, o_recv_idx, o_send_offsets);
+    /// ----------------------------------------------------------------------
+
+    layout();
+
+    /// Built on demand in update()
+    i_pos      = 0;
+    o_pos      = 0;
+    i_send_key = 0;
+}
+
+void mexico::Plan_MPI_Common::layout()
+{
+    i_total_send = std::accumulate(i_num_msgs_to_send, i_num_msgs_to_send+comm->nprocs, 0L);
+    i_total_recv = std::accumulate(i_num_msgs_to_recv, i_num_msgs_to_recv+comm->nprocs, 0L);
+
+    scal(i_num_msgs_to_send, i_num_msgs_to_send+comm->nprocs, i_cnt, i_num_vals_to_send);
+    scal(i_num_msgs_to_recv, i_num_msgs_to_recv+comm->nprocs, i_cnt, i_num_vals_to_recv);
+
+    incl_scan(i_num_vals_to_send, i_num_vals_to_send+comm->nprocs, i_send_displs);
+    incl_scan(i_num_vals_to_recv, i_num_vals_to_recv+comm->nprocs, i_recv_displs);
+
+    o_total_send = std::accumulate(o_num_msgs_to_send, o_num_msgs_to_send+comm->nprocs, 0L);
+    o_total_recv = std::accumulate(o_num_msgs_to_recv, o_num_msgs_to_recv+comm->nprocs, 0L);
+
+    scal(o_num_msgs_to_send, o_num_msgs_to_send+comm->nprocs, o_cnt, o_num_vals_to_send);
+    scal(o_num_msgs_to_recv, o_num_msgs_to_recv+comm->nprocs, o_cnt, o_num_vals_to_recv);
+
+    incl_scan(o_num_vals_to_send, o_num_vals_to_send+comm->nprocs, o_send_displs);
+    incl_scan(o_num_vals_to_recv, o_num_vals_to_recv+comm->nprocs, o_recv_displs);
+
+    i_num_send_peers = find_peers(i_num_msgs_to_send, &i_send_peers);
+    i_num_recv_peers = find_peers(i_num_msgs_to_recv, &i_recv_peers);
+    o_num_send_peers = find_peers(o_num_msgs_to_send, &o_send_peers);
+    o_num_recv_peers = find_peers(o_num_msgs_to_recv, &o_recv_peers);
+
+    MEXICO_WRITE(Log::DEBUG, "plan: i_total_[send,recv] = [ %ld, %ld ], o_total_[send,recv] = [ %ld, %ld ]",
+                 i_total_send, i_total_recv, o_total_send, o_total_recv);
+    MEXICO_WRITE(Log::DEBUG, "plan: i_num_[send,recv]_peers = [ %d, %d ], o_num_[send,recv]_peers = [ %d, %d ]",
+                 i_num_send_peers, i_num_recv_peers, o_num_send_peers, o_num_recv_peers);
+}
+
+int mexico::Plan_MPI_Common::find_peers(int* num_msgs, int** list)
+{
+    int w, n;
+
+    memory->realloc_int(list, count_positive(num_msgs, num_msgs+comm->nprocs));
+
+    n = 0;
+    for(w = 0; w < comm->nprocs; ++w)
+        if(num_msgs[w] > 0)
+            (*list)[n++] = w;
+
+    return n;
+}
+
+mexico::Plan_MPI_Common::~Plan_MPI_Common()
+{
+    if(i_send_key)
+    {
+        free_lists(i_send_key);
+        memory->free_ptr((void*** )&i_send_key);
+    }
+    memory->free_int(&i_pos);
+    memory->free_int(&o_pos);
+
+    free_lists(i_send_idx);
+    free_lists(i_recv_offsets);
+    free_lists(o_send_offsets);
+    free_lists(o_recv_idx);
+
+    memory->free_ptr((void*** )&i_send_idx);
+    memory->free_ptr((void*** )&i_recv_offsets);
+    memory->free_ptr((void*** )&o_send_offsets);
+    memory->free_ptr((void*** )&o_recv_idx);
+
+    memory->free_int(&i_send_peers);
+    memory->free_int(&i_recv_peers);
+    memory->free_int(&o_send_peers);
+    memory->free_int(&o_recv_peers);
+
+    memory->free_int(&i_num_msgs_to_send);
+    memory->free_int(&i_num_msgs_to_recv);
+    memory->free_int(&i_num_vals_to_send);
+    memory->free_int(&i_num_vals_to_recv);
+    memory->free_int(&i_send_displs);
+    memory->free_int(&i_recv_displs);
+
+    memory->free_int(&o_num_msgs_to_send);
+    memory->free_int(&o_num_msgs_to_recv);
+    memory->free_int(&o_num_vals_to_send);
+    memory->free_int(&o_num_vals_to_recv);
+    memory->free_int(&o_send_displs);
+    memory->free_int(&o_recv_displs);
+}
+
+void mexico::Plan_MPI_Common::free_lists(int** lists)
+{
+    int w;
+
+    for(w = 0; w < comm->nprocs; ++w)
+        memory->free_int(&lists[w]);
+}
+
+void mexico::Plan_MPI_Common::route(int num_vals, int max_worker_per_val, int* worker, int* offsets, bool per_column,
+                                    int* num_msgs_to_worker, int* num_msgs_from_peer, int** idx, int** peer_offsets)
+{
+    int i, j, w, k;
+    int *displs, *fill, *offsets_send_buf, *offsets_recv_buf;
+
+    /// ----------------------------------------------------------------------
+    /// Count the number of messages
+    std::fill(num_msgs_to_worker, num_msgs_to_worker+comm->nprocs, 0);
+
+    for(j = 0; j < max_worker_per_val; ++j)
+        for(i = 0; i < num_vals; ++i)
+        {
+            if(-1 == (w = worker[i + num_vals*j]))
+                continue;
+
+#ifndef NDEBUG
+            if(w < 0 || w >= comm->nprocs)
+                MEXICO_FATAL("Invalid worker w = %d", w);
+#endif
+
+            num_msgs_to_worker[w] += 1;
+        }
+
+    comm->alltoall(num_msgs_to_worker, 1, MPI_INT, num_msgs_from_peer, 1, MPI_INT);
+
+    if(!instance->pe_is_worker and 0 != std::accumulate(num_msgs_from_peer, num_msgs_from_peer+comm->nprocs, 0))
+        MEXICO_FATAL("Should not happen: Non-worker receives messages!");
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Build the index lists and pack the offsets
+    displs = memory->alloc_int(comm->nprocs);
+    fill   = memory->alloc_int(comm->nprocs);
+
+    offsets_send_buf = memory->alloc_int(std::accumulate(num_msgs_to_worker, num_msgs_to_worker+comm->nprocs, 0L));
+    offsets_recv_buf = memory->alloc_int(std::accumulate(num_msgs_from_peer, num_msgs_from_peer+comm->nprocs, 0L));
+
+    for(w = 0; w < comm->nprocs; ++w)
+        idx[w] = (num_msgs_to_worker[w] > 0) ? memory->alloc_int(num_msgs_to_worker[w]) : 0;
+
+    incl_scan(num_msgs_to_worker, num_msgs_to_worker+comm->nprocs, displs);
+    std::fill(fill, fill+comm->nprocs, 0);
+
+    for(j = 0; j < max_worker_per_val; ++j)
+        for(i = 0; i < num_vals; ++i)
+        {
+            if(-1 == (w = worker[i + num_vals*j]))
+                continue;
+
+            idx[w][fill[w]] = per_column ? i + num_vals*j : i;
+            offsets_send_buf[displs[w] + fill[w]] = offsets[i + num_vals*j];
+
+            fill[w] += 1;
+        }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Deliver the offsets and split them by peer
+    comm->alltoallv(offsets_send_buf, num_msgs_to_worker, MPI_INT,
+                    offsets_recv_buf, num_msgs_from_peer, MPI_INT);
+
+    incl_scan(num_msgs_from_peer, num_msgs_from_peer+comm->nprocs, displs);
+
+    for(w = 0; w < comm->nprocs; ++w)
+    {
+        peer_offsets[w] = 0;
+
+        if(0 == num_msgs_from_peer[w])
+            continue;
+
+        peer_offsets[w] = memory->alloc_int(num_msgs_from_peer[w]);
+        for(k = 0; k < num_msgs_from_peer[w]; ++k)
+        {
+            MEXICO_ASSERT(offsets_recv_buf[displs[w] + k] >= 0);
+            peer_offsets[w][k] = offsets_recv_buf[displs[w] + k];
+        }
+    }
+    /// ----------------------------------------------------------------------
+
+    memory->free_int(&offsets_send_buf);
+    memory->free_int(&offsets_recv_buf);
+    memory->free_int(&fill);
+    memory->free_int(&displs);
+}
+
+void mexico::Plan_MPI_Common::update(int i_num_changed, int* i_idx, int* i_worker, int* i_offsets,
+                                     int o_num_changed, int* o_idx, int* o_worker, int* o_offsets)
+{
+    int j, k, w, op, key, num_ops, code, pos;
+    int *ops, *fill, *num_ints_to_send, *num_ints_to_recv, *send_displs, *recv_displs, *ops_send_buf, *ops_recv_buf;
+    int **lists, *sizes;
+
+    if(!i_pos)
+        init_update();
+
+    /// ----------------------------------------------------------------------
+    /// Patch the lists on the sending side and record the operations which
+    /// need to be replayed on the worker side. Each operation is stored as
+    /// ( destination, code, position, offset ). At most two operations are
+    /// generated per changed entry
+    ops = memory->alloc_int(8L*(((long )i_num_changed)*i_max_worker_per_val + ((long )o_num_changed)*o_max_worker_per_val) + 1);
+    num_ops = 0;
+
+    for(j = 0; j < i_max_worker_per_val; ++j)
+        for(k = 0; k < i_num_changed; ++k)
+        {
+            MEXICO_ASSERT(i_idx[k] >= 0 && i_idx[k] < i_num_vals);
+
+            key = i_idx[k] + i_num_vals*j;
+            num_ops = move(0, key, i_idx[k], i_worker[k + i_num_changed*j], i_offsets[k + i_num_changed*j],
+                           this->i_worker, this->i_offsets, i_pos, i_send_idx, i_send_key, i_num_msgs_to_send,
+                           ops, num_ops);
+        }
+
+    for(j = 0; j < o_max_worker_per_val; ++j)
+        for(k = 0; k < o_num_changed; ++k)
+        {
+            MEXICO_ASSERT(o_idx[k] >= 0 && o_idx[k] < o_num_vals);
+
+            key = o_idx[k] + o_num_vals*j;
+            num_ops = move(1, key, key, o_worker[k + o_num_changed*j], o_offsets[k + o_num_changed*j],
+                           this->o_worker, this->o_offsets, o_pos, o_recv_idx, o_recv_idx, o_num_msgs_to_recv,
+                           ops, num_ops);
+        }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Deliver the operations to the workers. The order of the operations
+    /// for each worker must be preserved. Only the workers with operations
+    /// receive a message (see Comm::alltoallv_nbx())
+    num_ints_to_send = memory->alloc_int(comm->nprocs);
+    num_ints_to_recv = memory->alloc_int(comm->nprocs);
+    send_displs      = memory->alloc_int(comm->nprocs);
+    recv_displs      = memory->alloc_int(comm->nprocs);
+    fill             = memory->alloc_int(comm->nprocs);
+
+    std::fill(num_ints_to_send, num_ints_to_send+comm->nprocs, 0);
+    for(op = 0; op < num_ops; ++op)
+        num_ints_to_send[ops[4*op]] += 3;
+
+    incl_scan(num_ints_to_send, num_ints_to_send+comm->nprocs, send_displs);
+
+    ops_send_buf = memory->alloc_int(3L*num_ops + 1);
+    /// Reallocated by alltoallv_nbx()
+    ops_recv_buf = 0;
+
+    std::fill(fill, fill+comm->nprocs, 0);
+    for(op = 0; op < num_ops; ++op)
+    {
+        w = ops[4*op];
+        std::copy(&ops[4*op+1], &ops[4*op+4], &ops_send_buf[send_displs[w] + fill[w]]);
+        fill[w] += 3;
+    }
+
+    comm->alltoallv_nbx(ops_send_buf, num_ints_to_send, send_displs,
+                        &ops_recv_buf, num_ints_to_recv, recv_displs);
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Replay the operations
+    for(w = 0; w < comm->nprocs; ++w)
+        for(op = recv_displs[w]; op < recv_displs[w] + num_ints_to_recv[w]; op += 3)
+        {
+            code = ops_recv_buf[op];
+            pos  = ops_recv_buf[op+1];
+
+            if(code < UPDATE_NUM_OPS)
+            {
+                lists = i_recv_offsets;
+                sizes = i_num_msgs_to_recv;
+            }
+            else
+            {
+                lists = o_send_offsets;
+                sizes = o_num_msgs_to_send;
+                code -= UPDATE_NUM_OPS;
+            }
+
+            switch(code)
+            {
+            case UPDATE_SET:
+                MEXICO_ASSERT(pos >= 0 && pos < sizes[w]);
+                lists[w][pos] = ops_recv_buf[op+2];
+                break;
+            case UPDATE_REMOVE:
+                MEXICO_ASSERT(pos >= 0 && pos < sizes[w]);
+                lists[w][pos] = lists[w][sizes[w]-1];
+                sizes[w] -= 1;
+                break;
+            case UPDATE_APPEND:
+                if(!instance->pe_is_worker)
+                    MEXICO_FATAL("Should not happen: Non-worker receives messages!");
+
+                MEXICO_ASSERT(ops_recv_buf[op+2] >= 0);
+                append(&lists[w], sizes[w], ops_recv_buf[op+2]);
+                sizes[w] += 1;
+                break;
+            default:
+                MEXICO_FATAL("Invalid update operation %d", code);
+            }
+        }
+    /// ----------------------------------------------------------------------
+
+    layout();
+
+    memory->free_int(&ops_send_buf);
+    memory->free_int(&ops_recv_buf);
+    memory->free_int(&fill);
+    memory->free_int(&recv_displs);
+    memory->free_int(&send_displs);
+    memory->free_int(&num_ints_to_recv);
+    memory->free_int(&num_ints_to_send);
+    memory->free_int(&ops);
+}
+
+int mexico::Plan_MPI_Common::move(int side, int key, int val, int w_new, int off_new,
+                                  int* worker, int* offsets, int* pos, int** lists, int** keys, int* sizes,
+                                  int* ops, int num_ops)
+{
+    int w_old, k, last;
+
+    w_old = worker[key];
+
+    if(w_old == w_new && (-1 == w_new || offsets[key] == off_new))
+        return num_ops;
+
+#ifndef NDEBUG
+    if(w_new < -1 || w_new >= comm->nprocs)
+        MEXICO_FATAL("Invalid worker w = %d", w_new);
+#endif
+
+    if(w_old == w_new)
+    {
+        ops[4*num_ops  ] = w_old;
+        ops[4*num_ops+1] = UPDATE_SET + side*UPDATE_NUM_OPS;
+        ops[4*num_ops+2] = pos[key];
+        ops[4*num_ops+3] = off_new;
+        ++num_ops;
+    }
+    else
+    {
+        if(-1 != w_old)
+        {
+            k    = pos[key];
+            last = sizes[w_old] - 1;
+
+            lists[w_old][k] = lists[w_old][last];
+            keys [w_old][k] = keys [w_old][last];
+            pos[keys[w_old][k]] = k;
+
+            sizes[w_old] -= 1;
+
+            ops[4*num_ops  ] = w_old;
+            ops[4*num_ops+1] = UPDATE_REMOVE + side*UPDATE_NUM_OPS;
+            ops[4*num_ops+2] = k;
+            ops[4*num_ops+3] = -1;
+            ++num_ops;
+        }
+
+        if(-1 != w_new)
+        {
+            append(&lists[w_new], sizes[w_new], val);
+            if(keys != lists)
+                append(&keys[w_new], sizes[w_new], key);
+            pos[key] = sizes[w_new];
+
+            sizes[w_new] += 1;
+
+            ops[4*num_ops  ] = w_new;
+            ops[4*num_ops+1] = UPDATE_APPEND + side*UPDATE_NUM_OPS;
+            ops[4*num_ops+2] = pos[key];
+            ops[4*num_ops+3] = off_new;
+            ++num_ops;
+        }
+        else
+            pos[key] = -1;
+    }
+
+    worker [key] = w_new;
+    offsets[key] = off_new;
+
+    return num_ops;
+}
+
+void mexico::Plan_MPI_Common::init_update()
+{
+    int i, j, w, size;
+    int* fill;
+
+    /// ----------------------------------------------------------------------
+    /// The lists are traversed in the same order as in route() so the
+    /// positions can be recovered without communication
+    i_pos = memory->alloc_int(((long )i_num_vals)*i_max_worker_per_val + 1);
+    o_pos = memory->alloc_int(((long )o_num_vals)*o_max_worker_per_val + 1);
+
+    i_send_key = (int** )memory->alloc_ptr(comm->nprocs);
+    for(w = 0; w < comm->nprocs; ++w)
+        i_send_key[w] = (i_num_msgs_to_send[w] > 0) ? memory->alloc_int(i_num_msgs_to_send[w]) : 0;
+
+    fill = memory->alloc_int(comm->nprocs);
+
+    std::fill(fill, fill+comm->nprocs, 0);
+    for(j = 0; j < i_max_worker_per_val; ++j)
+        for(i = 0; i < i_num_vals; ++i)
+        {
+            if(-1 == (w = i_worker[i + i_num_vals*j]))
+            {
+                i_pos[i + i_num_vals*j] = -1;
+                continue;
+            }
+
+            i_send_key[w][fill[w]] = i + i_num_vals*j;
+            i_pos[i + i_num_vals*j] = fill[w];
+            fill[w] += 1;
+        }
+
+    std::fill(fill, fill+comm->nprocs, 0);
+    for(j = 0; j < o_max_worker_per_val; ++j)
+        for(i = 0; i < o_num_vals; ++i)
+        {
+            if(-1 == (w = o_worker[i + o_num_vals*j]))
+            {
+                o_pos[i + o_num_vals*j] = -1;
+                continue;
+            }
+
+            o_pos[i + o_num_vals*j] = fill[w];
+            fill[w] += 1;
+        }
+
+    memory->free_int(&fill);
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// The lists have been allocated with the exact size. Round the capacity
+    /// up to the next power of two as expected by append()
+    for(w = 0; w < comm->nprocs; ++w)
+    {
+        for(size = 1; size < i_num_msgs_to_send[w]; size *= 2);
+        if(i_num_msgs_to_send[w] > 0)
+        {
+            memory->realloc_int(&i_send_idx[w], size);
+            memory->realloc_int(&i_send_key[w], size);
+        }
+
+        for(size = 1; size < i_num_msgs_to_recv[w]; size *= 2);
+        if(i_num_msgs_to_recv[w] > 0)
+            memory->realloc_int(&i_recv_offsets[w], size);
+
+        for(size = 1; size < o_num_msgs_to_send[w]; size *= 2);
+        if(o_num_msgs_to_send[w] > 0)
+            memory->realloc_int(&o_send_offsets[w], size);
+
+        for(size = 1; size < o_num_msgs_to_recv[w]; size *= 2);
+        if(o_num_msgs_to_recv[w] > 0)
+            memory->realloc_int(&o_recv_idx[w], size);
+    }
+    /// ----------------------------------------------------------------------
+}
+
+void mexico::Plan_MPI_Common::append(int** list, int size, int val)
+{
+    /// The capacity of a list is the smallest power of two which is larger
+    /// or equal to size. Hence we need to grow if size is zero or a power of
+    /// two
+    if(0 == size || 0 == (size & (size-1)))
+        memory->realloc_int(list, 2*size + (0 == size));
+
+    (*list)[size] = val;
+}
+
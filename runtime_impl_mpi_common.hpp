@@ -35,11 +35,14 @@
 
 #include "pointers.hpp"
 #include "runtime_impl.hpp"
+#include "plan.hpp"
 
 
 namespace mexico
 {
 
+class Plan_MPI_Common;
+
 /// RuntimeImpl_MPI_Common: Base class for all MPI based runtime 
 ///                         implementations
 class RuntimeImpl_MPI_Common : public RuntimeImpl
@@ -61,6 +64,47 @@ protected:
     /// The returned type is already committed
     MPI_Datatype create_struct_int_type(int cnt, MPI_Datatype type);
 
+    /// Plan used by the runtime implementations which reuse the routing
+    /// between consecutive calls with the same pattern. Zero if no plan
+    /// has been created yet
+    Plan_MPI_Common* cached_plan;
+
+    /// Return a plan for the given pattern. The plan of the previous call
+    /// is reused if the pattern (matrices, counts and types) did not change
+    /// on any rank. Otherwise a new plan is created. Detecting the change
+    /// costs a comparison with the copy of the matrices stored in the plan
+    /// and a single integer allreduce.
+    /// The function is collective.
+    Plan_MPI_Common* update_cached_plan(int i_cnt,
+                                        MPI_Datatype i_type,
+                                        int i_num_vals,
+                                        int i_max_worker_per_val,
+                                        int* i_worker,
+                                        int* i_offsets,
+                                        int o_cnt,
+                                        MPI_Datatype o_type,
+                                        int o_num_vals,
+                                        int o_max_worker_per_val,
+                                        int* o_worker,
+                                        int* o_offsets);
+
+    /// Create the plan for update_cached_plan(). prev is the previous
+    /// cached plan (or zero) which is deleted afterwards so that derived
+    /// classes can take over resources from it. The function is collective.
+    virtual Plan_MPI_Common* create_cached_plan(Plan_MPI_Common* prev,
+                                                int i_cnt,
+                                                MPI_Datatype i_type,
+                                                int i_num_vals,
+                                                int i_max_worker_per_val,
+                                                int* i_worker,
+                                                int* i_offsets,
+                                                int o_cnt,
+                                                MPI_Datatype o_type,
+                                                int o_num_vals,
+                                                int o_max_worker_per_val,
+                                                int* o_worker,
+                                                int* o_offsets);
+
     /// Number of calls to MPI_Put and the minimal, maximal and
     /// average count
     int   put_min_cnt, 
@@ -98,6 +142,180 @@ protected:
         get_num += 1;    
     }
 
+    /// Interface to MPI_Put with derived origin and target datatypes
+    /// which describe cnt elements in total. cnt is only used for the
+    /// statistics
+    inline void put(void* addr, MPI_Datatype origin_type, int rank, MPI_Datatype target_type, int cnt, MPI_Win win)
+    {
+        MPI_Put(addr, 1, origin_type, rank, 0, 1, target_type, win);
+
+        put_min_cnt = std::min(put_min_cnt, cnt);
+        put_max_cnt = std::max(put_max_cnt, cnt);
+        put_avg_cnt = put_avg_cnt + cnt;
+
+        put_num += 1;
+    }
+
+    /// Interface to MPI_Get with derived origin and target datatypes
+    inline void get(void* addr, MPI_Datatype origin_type, int rank, MPI_Datatype target_type, int cnt, MPI_Win win)
+    {
+        MPI_Get(addr, 1, origin_type, rank, 0, 1, target_type, win);
+
+        get_min_cnt = std::min(get_min_cnt, cnt);
+        get_max_cnt = std::max(get_max_cnt, cnt);
+        get_avg_cnt = get_avg_cnt + cnt;
+
+        get_num += 1;
+    }
+
+};
+
+/// Plan_MPI_Common: Communication plan for the message based MPI runtime
+///                  implementations. On construction the offsets are
+///                  delivered to the workers once so that a plan-based exec
+///                  only needs to move the payload.
+///
+/// All per-rank arrays have size comm->nprocs. The lists are grouped by
+/// peer: i_send_idx[w] holds the indices (into the user i_buf) of the
+/// messages sent to worker w, i_recv_offsets[w] the offsets in the worker
+/// i_buf of the messages received from rank w, and so on.
+class Plan_MPI_Common : public Plan
+{
+
+public:
+    /// Create the plan. The function is collective.
+    Plan_MPI_Common(Instance* ptr,
+                    int i_cnt,
+                    MPI_Datatype i_type,
+                    int i_num_vals,
+                    int i_max_worker_per_val,
+                    int* i_worker,
+                    int* i_offsets,
+                    int o_cnt,
+                    MPI_Datatype o_type,
+                    int o_num_vals,
+                    int o_max_worker_per_val,
+                    int* o_worker,
+                    int* o_offsets);
+
+    /// Destructor
+    ~Plan_MPI_Common();
+
+    /// See Plan::update(). The per-peer lists are patched in place and
+    /// only the changes are send to the affected workers. Entries which
+    /// move to another worker are removed from the list of the old worker
+    /// by moving the last entry into their slot and appended to the list
+    /// of the new one.
+    void update(int i_num_changed,
+                int* i_idx,
+                int* i_worker,
+                int* i_offsets,
+                int o_num_changed,
+                int* o_idx,
+                int* o_worker,
+                int* o_offsets);
+
+    /// Number of messages to send and receive in pre_comm()
+    int* i_num_msgs_to_send;
+    int* i_num_msgs_to_recv;
+    /// Counts and displacements in units of i_type
+    int* i_num_vals_to_send;
+    int* i_num_vals_to_recv;
+    int* i_send_displs;
+    int* i_recv_displs;
+    /// Total number of messages to send and receive
+    long i_total_send;
+    long i_total_recv;
+    /// Index in the user i_buf of each message to send (by target)
+    int** i_send_idx;
+    /// Offsets in the worker i_buf of each message received (by source)
+    int** i_recv_offsets;
+    /// Ranks with a nonzero number of messages to send and receive in
+    /// ascending order. Loops and request arrays only need to cover these
+    int  i_num_send_peers;
+    int  i_num_recv_peers;
+    int* i_send_peers;
+    int* i_recv_peers;
+
+    /// Number of messages to send and receive in post_comm()
+    int* o_num_msgs_to_send;
+    int* o_num_msgs_to_recv;
+    /// Counts and displacements in units of o_type
+    int* o_num_vals_to_send;
+    int* o_num_vals_to_recv;
+    int* o_send_displs;
+    int* o_recv_displs;
+    /// Total number of messages to send and receive
+    long o_total_send;
+    long o_total_recv;
+    /// Offsets in the worker o_buf of each message to send (by requester)
+    int** o_send_offsets;
+    /// Position in the user o_buf of each message received (by worker)
+    int** o_recv_idx;
+    /// Ranks with a nonzero number of messages to send and receive in
+    /// ascending order
+    int  o_num_send_peers;
+    int  o_num_recv_peers;
+    int* o_send_peers;
+    int* o_recv_peers;
+
+private:
+    /// Operations on the per-peer lists which are send from the
+    /// requester to the workers in update()
+    enum
+    {
+        UPDATE_SET     = 0,
+        UPDATE_REMOVE  = 1,
+        UPDATE_APPEND  = 2,
+        UPDATE_NUM_OPS = 3
+    };
+
+    /// Position of each entry of the i and o matrices in the per-peer
+    /// list of its worker or -1. Built on the first call to update()
+    int* i_pos;
+    int* o_pos;
+    /// Matrix entry (i + i_num_vals*j) of each message in i_send_idx. For
+    /// the o side o_recv_idx already stores the matrix entry. Built on
+    /// the first call to update()
+    int** i_send_key;
+
+    /// Compute totals, counts, displacements and peers from the number
+    /// of messages
+    void layout();
+
+    /// Store the ranks with a nonzero number of messages in the 
+    /// (reallocated) list and return their number
+    int find_peers(int* num_msgs, int** list);
+
+    /// Build the position maps and round up the capacity of the lists
+    void init_update();
+
+    /// Move matrix entry key to worker w_new with offset off_new and
+    /// record the list operations for the workers in ops. Returns the new
+    /// number of operations
+    int move(int side, int key, int val, int w_new, int off_new,
+             int* worker, int* offsets, int* pos, int** lists, int** keys, int* sizes,
+             int* ops, int num_ops);
+
+    /// Append val to a list with size entries, growing it if necessary
+    void append(int** list, int size, int val);
+
+    /// Count the messages per worker, build the per-worker index lists
+    /// and deliver the offsets to the workers. If per_column is true
+    /// the index is i + num_vals*j, otherwise it is i.
+    void route(int num_vals,
+               int max_worker_per_val,
+               int* worker,
+               int* offsets,
+               bool per_column,
+               int* num_msgs_to_worker,
+               int* num_msgs_from_peer,
+               int** idx,
+               int** peer_offsets);
+
+    /// Free the per-peer lists
+    void free_lists(int** lists);
+
 };
 
 }
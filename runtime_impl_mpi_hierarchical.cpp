@@ -0,0 +1,670 @@
+
+/// vi: tabstop=4:expandtab
+
+/* Copyright 2010 University of Lugano. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the University of Lugano.
+ */
+
+#include "mexico_config.hpp"
+
+#include <stdlib.h>
+#ifdef MEXICO_HAVE_MPI_H
+#include <mpi.h>
+#endif
+#include <algorithm>
+#include <numeric>
+
+#include "runtime_impl_mpi_hierarchical.hpp"
+#include "job.hpp"
+#include "runtime.hpp"
+#include "memory.hpp"
+#include "comm.hpp"
+#include "assert.hpp"
+#include "utils.hpp"
+#include "log.hpp"
+
+
+mexico::RuntimeImpl_MPI_Hierarchical::RuntimeImpl_MPI_Hierarchical(Instance* ptr, const std::string& hints)
+: RuntimeImpl_MPI_Common(ptr, hints)
+{
+    int r, l, n, my_leader;
+    int pair[2];
+    int *pairs, *cnts, *displs;
+    long* keys;
+    MPI_Aint size;
+    int disp_unit;
+
+    if(instance->pe_is_worker)
+    {
+        MPI_Type_extent(job->i_type, &job_i_extent);
+        MPI_Type_extent(job->o_type, &job_o_extent);
+
+        i_buf = memory->alloc_char(job->i_N*job_i_extent);
+        o_buf = memory->alloc_char(job->o_N*job_o_extent);
+    }
+    else
+    {
+        job_i_extent = 0;
+        job_o_extent = 0;
+
+        i_buf = 0;
+        o_buf = 0;
+    }
+
+    /// ----------------------------------------------------------------------
+    /// Create the node and leader communicators
+    comm->split_type_shared(&node_comm);
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+
+    comm->split((0 == node_rank) ? 0 : MPI_UNDEFINED, comm->myrank, &leader_comm);
+    if(MPI_COMM_NULL != leader_comm)
+    {
+        MPI_Comm_rank(leader_comm, &leader_rank);
+        MPI_Comm_size(leader_comm, &num_leaders);
+    }
+    else
+    {
+        leader_rank = -1;
+        num_leaders = 0;
+    }
+
+    my_leader = leader_rank;
+    MPI_Bcast(&my_leader, 1, MPI_INT, 0, node_comm);
+    MPI_Bcast(&num_leaders, 1, MPI_INT, 0, node_comm);
+
+    MEXICO_WRITE(Log::DEBUG, "node_rank = %d, node_size = %d, leader = %d, num_leaders = %d",
+                 node_rank, node_size, my_leader, num_leaders);
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Only the leaders sort records by target worker. A leader needs the
+    /// ranks on its node and the leader of each worker, but nothing per
+    /// processing element: The ranks and workers of each node are
+    /// gathered on its leader and exchanged between the leaders
+    pair[0] = comm->myrank;
+    pair[1] = instance->pe_is_worker;
+
+    pairs = (0 == node_rank) ? memory->alloc_int(2*node_size) : 0;
+    MPI_Gather(pair, 2, MPI_INT, pairs, 2, MPI_INT, 0, node_comm);
+
+    node_ranks     = 0;
+    num_workers    = 0;
+    worker_ranks   = 0;
+    worker_leaders = 0;
+
+    if(0 == node_rank)
+    {
+        /// node_comm is split with the rank as key, so node_ranks is sorted
+        node_ranks = memory->alloc_int(node_size);
+
+        n = 0;
+        for(r = 0; r < node_size; ++r)
+        {
+            node_ranks[r] = pairs[2*r];
+            if(pairs[2*r+1])
+                pairs[n++] = pairs[2*r];
+        }
+
+        cnts   = memory->alloc_int(num_leaders);
+        displs = memory->alloc_int(num_leaders);
+
+        MPI_Allgather(&n, 1, MPI_INT, cnts, 1, MPI_INT, leader_comm);
+        incl_scan(cnts, cnts+num_leaders, displs);
+
+        num_workers  = std::accumulate(cnts, cnts+num_leaders, 0);
+        worker_ranks = memory->alloc_int(num_workers);
+
+        MPI_Allgatherv(pairs, n, MPI_INT, worker_ranks, cnts, displs, MPI_INT, leader_comm);
+
+        /// Sort the workers by rank. The key combines the rank (high bits)
+        /// and the leader (low bits)
+        keys = memory->alloc_long(num_workers);
+        for(l = 0; l < num_leaders; ++l)
+            for(r = displs[l]; r < displs[l] + cnts[l]; ++r)
+                keys[r] = (((long )worker_ranks[r]) << 32) | (long )l;
+
+        std::sort(keys, keys+num_workers);
+
+        worker_leaders = memory->alloc_int(num_workers);
+        for(r = 0; r < num_workers; ++r)
+        {
+            worker_ranks  [r] = (int )(keys[r] >> 32);
+            worker_leaders[r] = (int )(keys[r] & 0xffffffffL);
+        }
+
+        memory->free_long(&keys);
+        memory->free_int(&displs);
+        memory->free_int(&cnts);
+    }
+
+    memory->free_int(&pairs);
+
+    MEXICO_WRITE(Log::DEBUG, "num_workers = %d", num_workers);
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Create the shared window for stage_need. The staging window itself
+    /// is allocated on demand in reserve()
+    MPI_Win_allocate_shared((0 == node_rank) ? node_size*sizeof(long) : 0, sizeof(long), MPI_INFO_NULL, node_comm, &stage_need, &need_win);
+    MPI_Win_shared_query(need_win, 0, &size, &disp_unit, &stage_need);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, need_win);
+
+    /// Each processing element only initializes its own entry. Otherwise
+    /// the leader could overwrite the entry of a processing element which
+    /// already entered the first reserve()
+    stage_need[node_rank] = 0;
+
+    stage_win  = MPI_WIN_NULL;
+    stage_base = (char** )memory->alloc_ptr(node_size);
+    stage_cap  = memory->alloc_long(node_size);
+    std::fill(stage_base, stage_base+node_size, (char* )0);
+    std::fill(stage_cap, stage_cap+node_size, 0L);
+    /// ----------------------------------------------------------------------
+
+    gather_cnts        = memory->alloc_int(node_size);
+    scatter_cnts       = memory->alloc_int(node_size);
+    leader_send_cnts   = memory->alloc_int(num_leaders);
+    leader_recv_cnts   = memory->alloc_int(num_leaders);
+    leader_send_bytes  = memory->alloc_int(num_leaders);
+    leader_recv_bytes  = memory->alloc_int(num_leaders);
+    leader_send_displs = memory->alloc_int(num_leaders);
+    leader_recv_displs = memory->alloc_int(num_leaders);
+
+    /// Allocated on demand
+    send_buf   = 0;
+    recv_buf   = 0;
+    node_buf   = 0;
+    leader_buf = 0;
+    src_perm   = 0;
+    dst_perm   = 0;
+}
+
+mexico::RuntimeImpl_MPI_Hierarchical::~RuntimeImpl_MPI_Hierarchical()
+{
+    memory->free_int(&src_perm);
+    memory->free_int(&dst_perm);
+
+    memory->free_char(&send_buf);
+    memory->free_char(&recv_buf);
+    memory->free_char(&node_buf);
+    memory->free_char(&leader_buf);
+
+    memory->free_int(&gather_cnts);
+    memory->free_int(&scatter_cnts);
+    memory->free_int(&leader_send_cnts);
+    memory->free_int(&leader_recv_cnts);
+    memory->free_int(&leader_send_bytes);
+    memory->free_int(&leader_recv_bytes);
+    memory->free_int(&leader_send_displs);
+    memory->free_int(&leader_recv_displs);
+
+    /// Frees the sections and stage_need
+    if(MPI_WIN_NULL != stage_win)
+    {
+        MPI_Win_unlock_all(stage_win);
+        MPI_Win_free(&stage_win);
+    }
+    MPI_Win_unlock_all(need_win);
+    MPI_Win_free(&need_win);
+
+    memory->free_ptr((void*** )&stage_base);
+    memory->free_long(&stage_cap);
+
+    memory->free_int(&worker_leaders);
+    memory->free_int(&worker_ranks);
+    memory->free_int(&node_ranks);
+
+    if(MPI_COMM_NULL != leader_comm)
+        MPI_Comm_free(&leader_comm);
+    MPI_Comm_free(&node_comm);
+
+    if(instance->pe_is_worker)
+    {
+        memory->free_char((char** )&i_buf);
+        memory->free_char((char** )&o_buf);
+    }
+}
+
+void mexico::RuntimeImpl_MPI_Hierarchical::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                    int* i_worker, int* i_offsets,
+                                                    void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                    int* o_worker, int* o_offsets)
+{
+    int i, j, w, off;
+    MPI_Aint i_extent;
+    long k, num, stride;
+
+    MPI_Type_extent(i_type, &i_extent);
+
+    /// A record consists of the target worker, the offset on the worker and
+    /// the payload
+    stride = 2*sizeof(int) + i_cnt*i_extent;
+
+    /// ----------------------------------------------------------------------
+    /// Pack the records
+    num = 0;
+    for(j = 0; j < i_max_worker_per_val; ++j)
+        for(i = 0; i < i_num_vals; ++i)
+            if(-1 != i_worker[i + i_num_vals*j])
+                ++num;
+
+    memory->realloc_char(&send_buf, num*stride);
+
+    k = 0;
+    for(j = 0; j < i_max_worker_per_val; ++j)
+        for(i = 0; i < i_num_vals; ++i)
+        {
+            if(-1 == (w = i_worker[i + i_num_vals*j]))
+                continue;
+
+#ifndef NDEBUG
+            if(w < 0 || w >= comm->nprocs)
+                MEXICO_FATAL("Invalid worker w = %d", w);
+#endif
+
+            *((int* )&send_buf[k*stride              ]) = w;
+            *((int* )&send_buf[k*stride + sizeof(int)]) = i_offsets[i + i_num_vals*j];
+            std::copy(&((char* )i_buf)[i_cnt*i_extent*i],
+                      &((char* )i_buf)[i_cnt*i_extent*i]+i_cnt*i_extent,
+                      &send_buf[k*stride + 2*sizeof(int)]);
+            ++k;
+        }
+    /// ----------------------------------------------------------------------
+
+    num = forward(num, stride, false);
+
+    if(!instance->pe_is_worker and num > 0)
+        MEXICO_FATAL("Should not happen: Non-worker receives messages!");
+
+    /// ----------------------------------------------------------------------
+    /// Scatter the data
+    for(k = 0; k < num; ++k)
+    {
+        MEXICO_ASSERT(comm->myrank == *((int* )&recv_buf[k*stride]));
+
+        off = *((int* )&recv_buf[k*stride + sizeof(int)]);
+        MEXICO_ASSERT(off >= 0 && off*i_cnt < job->i_N);
+
+        /// Caution: Need to use the i_buf member variable here!
+        std::copy(&recv_buf[k*stride + 2*sizeof(int)],
+                  &recv_buf[k*stride + 2*sizeof(int)]+i_cnt*job_i_extent,
+                  &((char* )this->i_buf)[off*i_cnt*job_i_extent]);
+    }
+    /// ----------------------------------------------------------------------
+}
+
+void mexico::RuntimeImpl_MPI_Hierarchical::post_comm(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                     int* i_worker, int* i_offsets,
+                                                     void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                     int* o_worker, int* o_offsets)
+{
+    int i, j, w, off;
+    MPI_Aint o_extent;
+    long k, num_sent, num_recv, stride, rstride;
+
+    MPI_Type_extent(o_type, &o_extent);
+
+    /// A request consists of the worker and the offset on the worker. The
+    /// reply is the payload
+    stride  = 2*sizeof(int);
+    rstride = o_cnt*o_extent;
+
+    /// ----------------------------------------------------------------------
+    /// Pack the requests
+    num_sent = 0;
+    for(j = 0; j < o_max_worker_per_val; ++j)
+        for(i = 0; i < o_num_vals; ++i)
+            if(-1 != o_worker[i + o_num_vals*j])
+                ++num_sent;
+
+    memory->realloc_char(&send_buf, num_sent*stride);
+
+    k = 0;
+    for(j = 0; j < o_max_worker_per_val; ++j)
+        for(i = 0; i < o_num_vals; ++i)
+        {
+            if(-1 == (w = o_worker[i + o_num_vals*j]))
+                continue;
+
+#ifndef NDEBUG
+            if(w < 0 || w >= comm->nprocs)
+                MEXICO_FATAL("Invalid worker w = %d", w);
+#endif
+
+            *((int* )&send_buf[k*stride              ]) = w;
+            *((int* )&send_buf[k*stride + sizeof(int)]) = o_offsets[i + o_num_vals*j];
+            ++k;
+        }
+    /// ----------------------------------------------------------------------
+
+    num_recv = forward(num_sent, stride, true);
+
+    if(!instance->pe_is_worker and num_recv > 0)
+        MEXICO_FATAL("Should not happen: Non-worker receives messages!");
+
+    /// ----------------------------------------------------------------------
+    /// Gather the replies on the worker
+    memory->realloc_char(&send_buf, num_recv*rstride);
+
+    for(k = 0; k < num_recv; ++k)
+    {
+        MEXICO_ASSERT(comm->myrank == *((int* )&recv_buf[k*stride]));
+
+        off = *((int* )&recv_buf[k*stride + sizeof(int)]);
+        MEXICO_ASSERT(off >= 0 && off*o_cnt < job->o_N);
+
+        /// Caution: Need to use the o_buf member variable here!
+        std::copy(&((char* )this->o_buf)[off*o_cnt*job_o_extent],
+                  &((char* )this->o_buf)[off*o_cnt*job_o_extent]+o_cnt*job_o_extent,
+                  &send_buf[k*rstride]);
+    }
+    /// ----------------------------------------------------------------------
+
+    backward(num_recv, num_sent, rstride);
+
+    /// ----------------------------------------------------------------------
+    /// Reorder the data. The replies arrive in the order of the requests
+    k = 0;
+    for(j = 0; j < o_max_worker_per_val; ++j)
+        for(i = 0; i < o_num_vals; ++i)
+        {
+            if(-1 == o_worker[i + o_num_vals*j])
+                continue;
+
+            std::copy(&recv_buf[k*rstride],
+                      &recv_buf[k*rstride]+rstride,
+                      &((char* )o_buf)[rstride*(i + o_num_vals*j)]);
+            ++k;
+        }
+    /// ----------------------------------------------------------------------
+}
+
+long mexico::RuntimeImpl_MPI_Hierarchical::forward(long num, long stride, bool perms)
+{
+    int r;
+    long n, num_gathered, num_exchanged;
+
+    /// ----------------------------------------------------------------------
+    /// Gather the records on the leader
+    stage_need[node_rank] = num*stride;
+    reserve();
+
+    std::copy(send_buf, send_buf+num*stride, stage_base[node_rank]);
+    publish();
+
+    if(0 == node_rank)
+    {
+        for(r = 0; r < node_size; ++r)
+            gather_cnts[r] = stage_need[r]/stride;
+
+        num_gathered = std::accumulate(gather_cnts, gather_cnts+node_size, 0L);
+        memory->realloc_char(&node_buf, num_gathered*stride);
+
+        collect(node_buf);
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Exchange the records between the leaders and sort them by target
+    /// processing element
+    if(0 == node_rank)
+    {
+        memory->realloc_char(&leader_buf, num_gathered*stride);
+        if(perms)
+            memory->realloc_int(&src_perm, num_gathered);
+
+        bucket(node_buf, num_gathered, stride, worker_ranks, num_workers, worker_leaders, num_leaders, leader_send_cnts, leader_buf, perms ? src_perm : 0);
+
+        MPI_Alltoall(leader_send_cnts, 1, MPI_INT, leader_recv_cnts, 1, MPI_INT, leader_comm);
+
+        bytes(leader_send_cnts, num_leaders, stride, leader_send_bytes, leader_send_displs);
+        bytes(leader_recv_cnts, num_leaders, stride, leader_recv_bytes, leader_recv_displs);
+
+        num_exchanged = std::accumulate(leader_recv_cnts, leader_recv_cnts+num_leaders, 0L);
+        memory->realloc_char(&node_buf, num_exchanged*stride);
+
+        MPI_Alltoallv(leader_buf, leader_send_bytes, leader_send_displs, MPI_BYTE,
+                      node_buf, leader_recv_bytes, leader_recv_displs, MPI_BYTE, leader_comm);
+
+        memory->realloc_char(&leader_buf, num_exchanged*stride);
+        if(perms)
+            memory->realloc_int(&dst_perm, num_exchanged);
+
+        bucket(node_buf, num_exchanged, stride, node_ranks, node_size, 0, node_size, scatter_cnts, leader_buf, perms ? dst_perm : 0);
+
+        for(r = 0; r < node_size; ++r)
+            stage_need[r] = scatter_cnts[r]*stride;
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Scatter the records to the processing elements on the node
+    reserve();
+
+    if(0 == node_rank)
+        distribute(leader_buf);
+
+    publish();
+
+    n = stage_need[node_rank]/stride;
+    memory->realloc_char(&recv_buf, n*stride);
+
+    std::copy(stage_base[node_rank], stage_base[node_rank]+n*stride, recv_buf);
+    /// ----------------------------------------------------------------------
+
+    return n;
+}
+
+void mexico::RuntimeImpl_MPI_Hierarchical::backward(long num_recv, long num_sent, long rstride)
+{
+    int r;
+    long k, num_exchanged, num_gathered;
+
+    /// ----------------------------------------------------------------------
+    /// Gather the replies on the leader of the worker and restore the order
+    /// in which the records arrived from the other leaders
+    stage_need[node_rank] = num_recv*rstride;
+    reserve();
+
+    std::copy(send_buf, send_buf+num_recv*rstride, stage_base[node_rank]);
+    publish();
+
+    if(0 == node_rank)
+    {
+        num_exchanged = std::accumulate(leader_recv_cnts, leader_recv_cnts+num_leaders, 0L);
+        memory->realloc_char(&leader_buf, num_exchanged*rstride);
+
+        collect(leader_buf);
+
+        memory->realloc_char(&node_buf, num_exchanged*rstride);
+
+        for(k = 0; k < num_exchanged; ++k)
+            std::copy(&leader_buf[dst_perm[k]*rstride],
+                      &leader_buf[dst_perm[k]*rstride]+rstride,
+                      &node_buf[k*rstride]);
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Send the replies back to the leader of the requester and restore the
+    /// order in which the records have been gathered
+    if(0 == node_rank)
+    {
+        bytes(leader_send_cnts, num_leaders, rstride, leader_send_bytes, leader_send_displs);
+        bytes(leader_recv_cnts, num_leaders, rstride, leader_recv_bytes, leader_recv_displs);
+
+        num_gathered = std::accumulate(leader_send_cnts, leader_send_cnts+num_leaders, 0L);
+        memory->realloc_char(&leader_buf, num_gathered*rstride);
+
+        MPI_Alltoallv(node_buf, leader_recv_bytes, leader_recv_displs, MPI_BYTE,
+                      leader_buf, leader_send_bytes, leader_send_displs, MPI_BYTE, leader_comm);
+
+        memory->realloc_char(&node_buf, num_gathered*rstride);
+
+        for(k = 0; k < num_gathered; ++k)
+            std::copy(&leader_buf[src_perm[k]*rstride],
+                      &leader_buf[src_perm[k]*rstride]+rstride,
+                      &node_buf[k*rstride]);
+
+        for(r = 0; r < node_size; ++r)
+            stage_need[r] = gather_cnts[r]*rstride;
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Scatter the replies to the requesters on the node
+    reserve();
+
+    if(0 == node_rank)
+        distribute(node_buf);
+
+    publish();
+
+    MEXICO_ASSERT(stage_need[node_rank] == num_sent*rstride);
+
+    memory->realloc_char(&recv_buf, num_sent*rstride);
+
+    std::copy(stage_base[node_rank], stage_base[node_rank]+num_sent*rstride, recv_buf);
+    /// ----------------------------------------------------------------------
+}
+
+void mexico::RuntimeImpl_MPI_Hierarchical::reserve()
+{
+    int r, disp_unit;
+    bool grow;
+    MPI_Aint size;
+    void* base;
+
+    MPI_Win_sync(need_win);
+    MPI_Barrier(node_comm);
+    MPI_Win_sync(need_win);
+
+    grow = false;
+    for(r = 0; r < node_size; ++r)
+        if(stage_need[r] > stage_cap[r])
+            grow = true;
+
+    if(!grow)
+        return;
+
+    /// All processing elements see the same stage_need and reallocate the
+    /// window together. A growing section at least doubles its size
+    for(r = 0; r < node_size; ++r)
+        if(stage_need[r] > stage_cap[r])
+            stage_cap[r] = std::max(stage_need[r], 2*stage_cap[r]);
+
+    MEXICO_WRITE(Log::DEBUG, "growing the staging window to %ld bytes", stage_cap[node_rank]);
+
+    if(MPI_WIN_NULL != stage_win)
+    {
+        MPI_Win_unlock_all(stage_win);
+        MPI_Win_free(&stage_win);
+    }
+
+    MPI_Win_allocate_shared(stage_cap[node_rank], 1, MPI_INFO_NULL, node_comm, &base, &stage_win);
+
+    for(r = 0; r < node_size; ++r)
+        MPI_Win_shared_query(stage_win, r, &size, &disp_unit, &stage_base[r]);
+
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, stage_win);
+}
+
+void mexico::RuntimeImpl_MPI_Hierarchical::publish()
+{
+    if(MPI_WIN_NULL != stage_win)
+        MPI_Win_sync(stage_win);
+
+    MPI_Barrier(node_comm);
+
+    if(MPI_WIN_NULL != stage_win)
+        MPI_Win_sync(stage_win);
+}
+
+void mexico::RuntimeImpl_MPI_Hierarchical::collect(char* out)
+{
+    int r;
+
+    for(r = 0; r < node_size; ++r)
+        out = std::copy(stage_base[r], stage_base[r]+stage_need[r], out);
+}
+
+void mexico::RuntimeImpl_MPI_Hierarchical::distribute(char* in)
+{
+    int r;
+
+    for(r = 0; r < node_size; ++r)
+    {
+        std::copy(in, in+stage_need[r], stage_base[r]);
+        in += stage_need[r];
+    }
+}
+
+void mexico::RuntimeImpl_MPI_Hierarchical::bucket(char* in, long num, long stride, int* ranks, int num_ranks, int* key_of, int num_keys,
+                                                  int* cnts, char* out, int* perm)
+{
+    int i, w;
+    long k, pos;
+    int *fill, *key;
+
+    /// Look up the key of each record once
+    key = memory->alloc_int(num);
+
+    std::fill(cnts, cnts+num_keys, 0);
+    for(k = 0; k < num; ++k)
+    {
+        w = *((int* )&in[k*stride]);
+        i = std::lower_bound(ranks, ranks+num_ranks, w) - ranks;
+
+        if(i == num_ranks || ranks[i] != w)
+            MEXICO_FATAL("Should not happen: No bucket for rank %d", w);
+
+        key[k] = (key_of) ? key_of[i] : i;
+        cnts[key[k]] += 1;
+    }
+
+    fill = memory->alloc_int(num_keys);
+    incl_scan(cnts, cnts+num_keys, fill);
+
+    for(k = 0; k < num; ++k)
+    {
+        pos = fill[key[k]]++;
+
+        std::copy(&in[k*stride], &in[k*stride]+stride, &out[pos*stride]);
+        if(perm)
+            perm[k] = pos;
+    }
+
+    memory->free_int(&fill);
+    memory->free_int(&key);
+}
+
+void mexico::RuntimeImpl_MPI_Hierarchical::bytes(int* cnts, int n, long stride, int* bytes, int* displs)
+{
+    scal(cnts, cnts+n, (int )stride, bytes);
+    incl_scan(bytes, bytes+n, displs);
+}
+
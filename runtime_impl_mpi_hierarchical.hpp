@@ -0,0 +1,201 @@
+
+/// vi: tabstop=4:expandtab
+
+/* Copyright 2010 University of Lugano. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the University of Lugano.
+ */
+
+#ifndef MEXICO_RUNTIME_IMPL_MPI_HIERARCHICAL_HPP_INCLUDED
+#define MEXICO_RUNTIME_IMPL_MPI_HIERARCHICAL_HPP_INCLUDED 1
+
+#include <string>
+
+#include "pointers.hpp"
+#include "runtime_impl_mpi_common.hpp"
+
+
+namespace mexico
+{
+
+/// RuntimeImpl_MPI_Hierarchical: Runtime implementation with node-aware
+///                               two-level aggregation. The values of all
+///                               processing elements on a node are gathered
+///                               at a node leader, the leaders exchange one
+///                               combined message per pair of nodes and
+///                               scatter the values to the workers on their
+///                               node. post_comm() reverses the process.
+///                               The number of messages between nodes is
+///                               reduced by the number of processing
+///                               elements per node.
+///
+/// On the node the values move through a window allocated with
+/// MPI_Win_allocate_shared: Each processing element writes into its own
+/// section and the leader reads all sections directly (and vice versa),
+/// separated by a barrier on the node.
+class RuntimeImpl_MPI_Hierarchical : public RuntimeImpl_MPI_Common
+{
+
+public:
+    RuntimeImpl_MPI_Hierarchical(Instance* ptr, const std::string& hints);
+
+    /// Destructor
+    ~RuntimeImpl_MPI_Hierarchical();
+
+    /// See Runtime::pre_comm()
+    void pre_comm(void* i_buf,
+                  int i_cnt,
+                  MPI_Datatype i_type,
+                  int i_num_vals,
+                  int i_max_worker_per_val,
+                  int* i_worker,
+                  int* i_offsets,
+                  void* o_buf,
+                  int o_cnt,
+                  MPI_Datatype o_type,
+                  int o_num_vals,
+                  int o_max_worker_per_val,
+                  int* o_worker,
+                  int* o_offsets);
+
+    /// See Runtime::post_comm()
+    void post_comm(void* i_buf,
+                   int i_cnt,
+                   MPI_Datatype i_type,
+                   int i_num_vals,
+                   int i_max_worker_per_val,
+                   int* i_worker,
+                   int* i_offsets,
+                   void* o_buf,
+                   int o_cnt,
+                   MPI_Datatype o_type,
+                   int o_num_vals,
+                   int o_max_worker_per_val,
+                   int* o_worker,
+                   int* o_offsets);
+
+
+private:
+    /// Communicator of the processing elements on the same node
+    MPI_Comm node_comm;
+    int node_rank;
+    int node_size;
+
+    /// Communicator of the node leaders (node_rank == 0). MPI_COMM_NULL
+    /// on all other processing elements
+    MPI_Comm leader_comm;
+    int leader_rank;
+    int num_leaders;
+
+    /// Ranks of the processing elements on the node, sorted (the index
+    /// is the rank in node_comm). Significant on the leader only
+    int* node_ranks;
+    /// Sorted ranks of the workers and the rank in leader_comm of their
+    /// leader. Significant on the leader only
+    int num_workers;
+    int* worker_ranks;
+    int* worker_leaders;
+
+    /// Shared memory window on the node. Processing element r owns the
+    /// section of stage_cap[r] bytes at stage_base[r]. MPI_WIN_NULL until
+    /// the first section is needed
+    MPI_Win stage_win;
+    char** stage_base;
+    long* stage_cap;
+    /// Number of bytes written into the section of each processing
+    /// element in the current step. Lives in a shared window of the leader
+    MPI_Win need_win;
+    long* stage_need;
+
+    /// Number of records gathered from and scattered to each processing
+    /// element on the node (significant on the leader only) and number of
+    /// records sent to and received from each leader. The *_bytes and
+    /// *_displs arrays hold the corresponding counts and displacements
+    /// in bytes
+    int* gather_cnts;
+    int* scatter_cnts;
+    int* leader_send_cnts;
+    int* leader_recv_cnts;
+    int* leader_send_bytes;
+    int* leader_recv_bytes;
+    int* leader_send_displs;
+    int* leader_recv_displs;
+
+    /// Buffers. Reallocated as needed
+    char* send_buf;
+    char* recv_buf;
+    char* node_buf;
+    char* leader_buf;
+    /// Permutations applied by the leader when sorting the gathered
+    /// records by target leader (src_perm) and the received records by
+    /// target processing element (dst_perm)
+    int* src_perm;
+    int* dst_perm;
+
+    /// Sort num records of stride bytes into buckets. The first integer
+    /// in a record is a rank which is searched in the sorted array ranks
+    /// of length num_ranks. The bucket of the record is key_of[i] where i
+    /// is the position of the rank, or i itself if key_of is zero.
+    /// cnts[b] is set to the number of records in bucket b. If perm is
+    /// nonzero, record k is stored at position perm[k] of out
+    void bucket(char* in, long num, long stride, int* ranks, int num_ranks, int* key_of, int num_keys, int* cnts, char* out, int* perm);
+
+    /// Make sure that the section of each processing element holds at
+    /// least stage_need[r] bytes. stage_need must be written before the
+    /// call. The function is collective on node_comm
+    void reserve();
+
+    /// Make the writes to the sections visible on the node. The function
+    /// is collective on node_comm
+    void publish();
+
+    /// Concatenate the first stage_need[r] bytes of all sections in out
+    /// (collect) or split in into the sections (distribute)
+    void collect(char* out);
+    void distribute(char* in);
+
+    /// Compute byte counts and displacements from record counts
+    void bytes(int* cnts, int n, long stride, int* bytes, int* displs);
+
+    /// Move the records on the node to the leader, between the leaders
+    /// and from the leader to the workers on the node. On input send_buf
+    /// holds num records of stride bytes starting with the target worker.
+    /// On output recv_buf holds the records for this processing element.
+    /// If perms is true, the permutations are stored in src_perm and
+    /// dst_perm. Returns the number of received records
+    long forward(long num, long stride, bool perms);
+
+    /// Reverse a forward(..., true) call: send_buf holds num_recv replies
+    /// of rstride bytes, one per record received in forward(). On output
+    /// recv_buf holds num_sent replies in the order of the records passed
+    /// to forward()
+    void backward(long num_recv, long num_sent, long rstride);
+
+};
+
+}
+
+#endif
+
@@ -0,0 +1,455 @@
+
+/// vi: tabstop=4:expandtab
+
+/* Copyright 2010 University of Lugano. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the University of Lugano.
+ */
+
+#include "mexico_config.hpp"
+
+#include <stdlib.h>
+#ifdef MEXICO_HAVE_MPI_H
+#include <mpi.h>
+#endif
+#include <algorithm>
+
+#include "runtime_impl_mpi_neighborhood.hpp"
+#include "job.hpp"
+#include "runtime.hpp"
+#include "plan.hpp"
+#include "memory.hpp"
+#include "comm.hpp"
+#include "assert.hpp"
+#include "utils.hpp"
+#include "log.hpp"
+
+
+mexico::RuntimeImpl_MPI_Neighborhood::RuntimeImpl_MPI_Neighborhood(Instance* ptr, const std::string& hints)
+: RuntimeImpl_MPI_Common(ptr, hints)
+{
+    if(instance->pe_is_worker)
+    {
+        MPI_Type_extent(job->i_type, &job_i_extent);
+        MPI_Type_extent(job->o_type, &job_o_extent);
+
+        i_buf = memory->alloc_char(job->i_N*job_i_extent);
+        o_buf = memory->alloc_char(job->o_N*job_o_extent);
+    }
+    else
+    {
+        job_i_extent = 0;
+        job_o_extent = 0;
+
+        i_buf = 0;
+        o_buf = 0;
+    }
+}
+
+mexico::RuntimeImpl_MPI_Neighborhood::~RuntimeImpl_MPI_Neighborhood()
+{
+    if(instance->pe_is_worker)
+    {
+        memory->free_char((char** )&i_buf);
+        memory->free_char((char** )&o_buf);
+    }
+}
+
+void mexico::RuntimeImpl_MPI_Neighborhood::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                    int* i_worker, int* i_offsets,
+                                                    void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                    int* o_worker, int* o_offsets)
+{
+    pre_comm(update_cached_plan(i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                                o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets),
+             i_buf, o_buf);
+}
+
+void mexico::RuntimeImpl_MPI_Neighborhood::post_comm(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                     int* i_worker, int* i_offsets,
+                                                     void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                     int* o_worker, int* o_offsets)
+{
+    /// The plan has been updated in pre_comm()
+    post_comm(cached_plan, i_buf, o_buf);
+}
+
+mexico::Plan* mexico::RuntimeImpl_MPI_Neighborhood::create_plan(int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                                int* i_worker, int* i_offsets,
+                                                                int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                                int* o_worker, int* o_offsets)
+{
+    return new Plan_MPI_Neighborhood(instance, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                                     o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets);
+}
+
+mexico::Plan_MPI_Common* mexico::RuntimeImpl_MPI_Neighborhood::create_cached_plan(Plan_MPI_Common* prev,
+                                                                                  int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                                                  int* i_worker, int* i_offsets,
+                                                                                  int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                                                  int* o_worker, int* o_offsets)
+{
+    return new Plan_MPI_Neighborhood(instance, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                                     o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets,
+                                     static_cast<Plan_MPI_Neighborhood*>(prev));
+}
+
+void mexico::RuntimeImpl_MPI_Neighborhood::pre_comm(Plan* plan, void* i_buf, void* o_buf)
+{
+    Plan_MPI_Neighborhood* p = static_cast<Plan_MPI_Neighborhood*>(plan);
+    int k, m, w, i_cnt;
+    MPI_Aint i_extent;
+    long n;
+
+    i_cnt = p->i_cnt;
+    MPI_Type_extent(p->i_type, &i_extent);
+
+    /// ----------------------------------------------------------------------
+    /// Pack the data in the order of the plan
+    n = 0;
+    for(m = 0; m < p->num_peers; ++m)
+    {
+        w = p->peers[m];
+
+        for(k = 0; k < p->i_num_msgs_to_send[w]; ++k, ++n)
+            std::copy(&((char* )i_buf)[i_cnt*i_extent*p->i_send_idx[w][k]],
+                      &((char* )i_buf)[i_cnt*i_extent*p->i_send_idx[w][k]]+i_cnt*i_extent,
+                      &p->i_send_buf[n*i_cnt*i_extent]);
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Communicate the values
+#ifdef MEXICO_HAVE_MPI_NEIGHBOR_ALLTOALLV_INIT
+    MPI_Start(&p->i_req);
+    MPI_Wait(&p->i_req, MPI_STATUS_IGNORE);
+#else
+    MPI_Neighbor_alltoallv(p->i_send_buf, p->i_peer_send_cnts, p->i_peer_send_displs, p->i_type,
+                           p->i_recv_buf, p->i_peer_recv_cnts, p->i_peer_recv_displs, p->i_recv_type, p->graph);
+#endif
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Reorder the data
+    for(m = 0; m < p->num_peers; ++m)
+    {
+        w = p->peers[m];
+
+        for(k = 0; k < p->i_num_msgs_to_recv[w]; ++k)
+        {
+            MEXICO_ASSERT(p->i_recv_offsets[w][k]*i_cnt < job->i_N);
+
+            /// Caution: Need to use the i_buf member variable here!
+            std::copy(&p->i_recv_buf[(p->i_recv_displs[w] + k*i_cnt)*job_i_extent],
+                      &p->i_recv_buf[(p->i_recv_displs[w] + k*i_cnt)*job_i_extent]+i_cnt*job_i_extent,
+                      &((char* )this->i_buf)[p->i_recv_offsets[w][k]*i_cnt*job_i_extent]);
+        }
+    }
+    /// ----------------------------------------------------------------------
+}
+
+void mexico::RuntimeImpl_MPI_Neighborhood::post_comm(Plan* plan, void* i_buf, void* o_buf)
+{
+    post_comm_begin(plan, i_buf, o_buf);
+    post_comm_wait();
+}
+
+void mexico::RuntimeImpl_MPI_Neighborhood::post_comm_begin(Plan* plan, void* i_buf, void* o_buf)
+{
+    Plan_MPI_Neighborhood* p = static_cast<Plan_MPI_Neighborhood*>(plan);
+    int k, m, w, o_cnt;
+
+    o_cnt = p->o_cnt;
+
+    /// ----------------------------------------------------------------------
+    /// Gather the output data on the worker
+    for(m = 0; m < p->num_peers; ++m)
+    {
+        w = p->peers[m];
+
+        for(k = 0; k < p->o_num_msgs_to_send[w]; ++k)
+        {
+            MEXICO_ASSERT(p->o_send_offsets[w][k]*o_cnt < job->o_N);
+
+            /// Caution: Need to use the o_buf member variable here!
+            std::copy(&((char* )this->o_buf)[p->o_send_offsets[w][k]*o_cnt*job_o_extent],
+                      &((char* )this->o_buf)[p->o_send_offsets[w][k]*o_cnt*job_o_extent]+o_cnt*job_o_extent,
+                      &p->o_send_buf[(p->o_send_displs[w] + k*o_cnt)*job_o_extent]);
+        }
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Start communicating the values
+#ifdef MEXICO_HAVE_MPI_NEIGHBOR_ALLTOALLV_INIT
+    MPI_Start(&p->o_req);
+#else
+    MPI_Ineighbor_alltoallv(p->o_send_buf, p->o_peer_send_cnts, p->o_peer_send_displs, p->o_send_type,
+                            p->o_recv_buf, p->o_peer_recv_cnts, p->o_peer_recv_displs, p->o_type, p->graph, &p->o_req);
+#endif
+    /// ----------------------------------------------------------------------
+
+    pending_plan  = plan;
+    pending_i_buf = i_buf;
+    pending_o_buf = o_buf;
+}
+
+bool mexico::RuntimeImpl_MPI_Neighborhood::post_comm_test()
+{
+    Plan_MPI_Neighborhood* p = static_cast<Plan_MPI_Neighborhood*>(pending_plan);
+    int flag;
+
+    if(!p)
+        return true;
+
+    MPI_Test(&p->o_req, &flag, MPI_STATUS_IGNORE);
+    if(!flag)
+        return false;
+
+    post_comm_finish();
+    return true;
+}
+
+void mexico::RuntimeImpl_MPI_Neighborhood::post_comm_wait()
+{
+    Plan_MPI_Neighborhood* p = static_cast<Plan_MPI_Neighborhood*>(pending_plan);
+
+    if(!p)
+        return;
+
+    MPI_Wait(&p->o_req, MPI_STATUS_IGNORE);
+    post_comm_finish();
+}
+
+void mexico::RuntimeImpl_MPI_Neighborhood::post_comm_finish()
+{
+    Plan_MPI_Neighborhood* p = static_cast<Plan_MPI_Neighborhood*>(pending_plan);
+    int k, m, w, o_cnt;
+    MPI_Aint o_extent;
+
+    o_cnt = p->o_cnt;
+    MPI_Type_extent(p->o_type, &o_extent);
+
+    /// ----------------------------------------------------------------------
+    /// Reorder the data
+    for(m = 0; m < p->num_peers; ++m)
+    {
+        w = p->peers[m];
+
+        for(k = 0; k < p->o_num_msgs_to_recv[w]; ++k)
+            std::copy(&p->o_recv_buf[(p->o_recv_displs[w] + k*o_cnt)*o_extent],
+                      &p->o_recv_buf[(p->o_recv_displs[w] + k*o_cnt)*o_extent]+o_cnt*o_extent,
+                      &((char* )pending_o_buf)[o_cnt*o_extent*p->o_recv_idx[w][k]]);
+    }
+    /// ----------------------------------------------------------------------
+
+    pending_plan = 0;
+}
+
+mexico::Plan_MPI_Neighborhood::Plan_MPI_Neighborhood(Instance* ptr, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                     int* i_worker, int* i_offsets,
+                                                     int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                     int* o_worker, int* o_offsets,
+                                                     Plan_MPI_Neighborhood* prev)
+: Plan_MPI_Common(ptr, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                  o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets),
+  graph(MPI_COMM_NULL), num_peers(0), peers(0),
+  i_peer_send_cnts(0), i_peer_recv_cnts(0), i_peer_send_displs(0), i_peer_recv_displs(0),
+  o_peer_send_cnts(0), o_peer_recv_cnts(0), o_peer_send_displs(0), o_peer_recv_displs(0),
+  i_send_buf(0), i_recv_buf(0), o_send_buf(0), o_recv_buf(0),
+  i_req(MPI_REQUEST_NULL), o_req(MPI_REQUEST_NULL)
+{
+    /// The per-neighbor arrays are allocated in topology() and compact()
+    /// once the number of neighbors is known
+
+    /// No job pointer on non-worker processing elements. These do not
+    /// receive in pre_comm() and do not send in post_comm() anyway
+    i_recv_type = (instance->pe_is_worker) ? job->i_type : i_type;
+    o_send_type = (instance->pe_is_worker) ? job->o_type : o_type;
+
+    topology(prev);
+    compact();
+}
+
+mexico::Plan_MPI_Neighborhood::~Plan_MPI_Neighborhood()
+{
+    free_requests();
+
+    if(MPI_COMM_NULL != graph)
+        MPI_Comm_free(&graph);
+
+    memory->free_char(&i_send_buf);
+    memory->free_char(&i_recv_buf);
+    memory->free_char(&o_send_buf);
+    memory->free_char(&o_recv_buf);
+
+    memory->free_int(&i_peer_send_cnts);
+    memory->free_int(&i_peer_recv_cnts);
+    memory->free_int(&i_peer_send_displs);
+    memory->free_int(&i_peer_recv_displs);
+
+    memory->free_int(&o_peer_send_cnts);
+    memory->free_int(&o_peer_recv_cnts);
+    memory->free_int(&o_peer_send_displs);
+    memory->free_int(&o_peer_recv_displs);
+
+    memory->free_int(&peers);
+}
+
+void mexico::Plan_MPI_Neighborhood::update(int i_num_changed, int* i_idx, int* i_worker, int* i_offsets,
+                                           int o_num_changed, int* o_idx, int* o_worker, int* o_offsets)
+{
+    free_requests();
+
+    Plan_MPI_Common::update(i_num_changed, i_idx, i_worker, i_offsets,
+                            o_num_changed, o_idx, o_worker, o_offsets);
+
+    topology(this);
+    compact();
+}
+
+int mexico::Plan_MPI_Neighborhood::find_neighbors(int** list) const
+{
+    int* end;
+
+    memory->realloc_int(list, i_num_send_peers + i_num_recv_peers + o_num_send_peers + o_num_recv_peers);
+
+    end = *list;
+    end = std::copy(i_send_peers, i_send_peers + i_num_send_peers, end);
+    end = std::copy(i_recv_peers, i_recv_peers + i_num_recv_peers, end);
+    end = std::copy(o_send_peers, o_send_peers + o_num_send_peers, end);
+    end = std::copy(o_recv_peers, o_recv_peers + o_num_recv_peers, end);
+
+    /// A rank may appear in several lists
+    std::sort(*list, end);
+
+    return std::unique(*list, end) - *list;
+}
+
+void mexico::Plan_MPI_Neighborhood::topology(Plan_MPI_Neighborhood* prev)
+{
+    int n, changed, any_changed;
+    int* list;
+
+    list = 0;
+    n = find_neighbors(&list);
+
+    if(prev and MPI_COMM_NULL != prev->graph)
+        changed = !(n == prev->num_peers and std::equal(list, list+n, prev->peers));
+    else
+        changed = 1;
+
+    comm->allreduce(&changed, &any_changed, 1, MPI_INT, MPI_MAX);
+
+    /// list becomes the new peers
+    memory->free_int(&peers);
+    peers     = list;
+    num_peers = n;
+
+    if(any_changed)
+    {
+        if(MPI_COMM_NULL != graph)
+            MPI_Comm_free(&graph);
+
+        /// The graph is symmetric since every message in pre_comm() and
+        /// post_comm() is counted on both ends
+        comm->dist_graph_create_adjacent(num_peers, peers, num_peers, peers, &graph);
+    }
+    else
+    if(prev != this)
+    {
+        graph = prev->graph;
+        prev->graph = MPI_COMM_NULL;
+    }
+
+    MEXICO_WRITE(Log::DEBUG, "num_peers = %d, topology %s", num_peers, (any_changed) ? "created" : "reused");
+}
+
+void mexico::Plan_MPI_Neighborhood::compact()
+{
+    int m, w;
+    MPI_Aint i_extent, o_extent, i_recv_extent, o_send_extent;
+
+    free_requests();
+
+    memory->realloc_int(&i_peer_send_cnts  , num_peers);
+    memory->realloc_int(&i_peer_recv_cnts  , num_peers);
+    memory->realloc_int(&i_peer_send_displs, num_peers);
+    memory->realloc_int(&i_peer_recv_displs, num_peers);
+
+    memory->realloc_int(&o_peer_send_cnts  , num_peers);
+    memory->realloc_int(&o_peer_recv_cnts  , num_peers);
+    memory->realloc_int(&o_peer_send_displs, num_peers);
+    memory->realloc_int(&o_peer_recv_displs, num_peers);
+
+    /// ----------------------------------------------------------------------
+    /// Counts and displacements per neighbor. The lists in the plan are
+    /// packed in the order of the ranks so the displacements carry over
+    for(m = 0; m < num_peers; ++m)
+    {
+        w = peers[m];
+
+        i_peer_send_cnts  [m] = i_num_vals_to_send[w];
+        i_peer_recv_cnts  [m] = i_num_vals_to_recv[w];
+        i_peer_send_displs[m] = i_send_displs[w];
+        i_peer_recv_displs[m] = i_recv_displs[w];
+
+        o_peer_send_cnts  [m] = o_num_vals_to_send[w];
+        o_peer_recv_cnts  [m] = o_num_vals_to_recv[w];
+        o_peer_send_displs[m] = o_send_displs[w];
+        o_peer_recv_displs[m] = o_recv_displs[w];
+    }
+    /// ----------------------------------------------------------------------
+
+    MPI_Type_extent(i_type, &i_extent);
+    MPI_Type_extent(o_type, &o_extent);
+    MPI_Type_extent(i_recv_type, &i_recv_extent);
+    MPI_Type_extent(o_send_type, &o_send_extent);
+
+    memory->realloc_char(&i_send_buf, i_total_send*i_cnt*i_extent);
+    memory->realloc_char(&i_recv_buf, i_total_recv*i_cnt*i_recv_extent);
+    memory->realloc_char(&o_send_buf, o_total_send*o_cnt*o_send_extent);
+    memory->realloc_char(&o_recv_buf, o_total_recv*o_cnt*o_extent);
+
+#ifdef MEXICO_HAVE_MPI_NEIGHBOR_ALLTOALLV_INIT
+    MPI_Neighbor_alltoallv_init(i_send_buf, i_peer_send_cnts, i_peer_send_displs, i_type,
+                                i_recv_buf, i_peer_recv_cnts, i_peer_recv_displs, i_recv_type,
+                                graph, MPI_INFO_NULL, &i_req);
+    MPI_Neighbor_alltoallv_init(o_send_buf, o_peer_send_cnts, o_peer_send_displs, o_send_type,
+                                o_recv_buf, o_peer_recv_cnts, o_peer_recv_displs, o_type,
+                                graph, MPI_INFO_NULL, &o_req);
+#endif
+}
+
+void mexico::Plan_MPI_Neighborhood::free_requests()
+{
+#ifdef MEXICO_HAVE_MPI_NEIGHBOR_ALLTOALLV_INIT
+    if(MPI_REQUEST_NULL != i_req)
+        MPI_Request_free(&i_req);
+    if(MPI_REQUEST_NULL != o_req)
+        MPI_Request_free(&o_req);
+#endif
+}
+
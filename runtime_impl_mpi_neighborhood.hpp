@@ -0,0 +1,255 @@
+
+/// vi: tabstop=4:expandtab
+
+/* Copyright 2010 University of Lugano. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the University of Lugano.
+ */
+
+#ifndef MEXICO_RUNTIME_IMPL_MPI_NEIGHBORHOOD_HPP_INCLUDED
+#define MEXICO_RUNTIME_IMPL_MPI_NEIGHBORHOOD_HPP_INCLUDED 1
+
+#include <string>
+
+#include "pointers.hpp"
+#include "runtime_impl_mpi_common.hpp"
+
+/// MPI-4 adds persistent neighborhood collectives
+#if defined(MPI_VERSION) && MPI_VERSION >= 4
+#define MEXICO_HAVE_MPI_NEIGHBOR_ALLTOALLV_INIT 1
+#endif
+
+
+namespace mexico
+{
+
+class Plan_MPI_Neighborhood;
+
+/// RuntimeImpl_MPI_Neighborhood: Runtime implementation based on 
+///                               neighborhood collectives. A distributed
+///                               graph topology is created from the actual
+///                               edges between sources and workers so that
+///                               each exchange only involves the peers of
+///                               a processing element instead of the whole
+///                               communicator. The topology is stored in the
+///                               plan and recreated only if the set of
+///                               edges changes.
+class RuntimeImpl_MPI_Neighborhood : public RuntimeImpl_MPI_Common
+{
+
+public:
+    RuntimeImpl_MPI_Neighborhood(Instance* ptr, const std::string& hints);
+
+    /// Destructor
+    ~RuntimeImpl_MPI_Neighborhood();
+
+    /// See Runtime::pre_comm(). The routing is cached between calls
+    /// (see RuntimeImpl_MPI_Common::update_cached_plan())
+    void pre_comm(void* i_buf,
+                  int i_cnt,
+                  MPI_Datatype i_type,
+                  int i_num_vals,
+                  int i_max_worker_per_val,
+                  int* i_worker,
+                  int* i_offsets,
+                  void* o_buf,
+                  int o_cnt,
+                  MPI_Datatype o_type,
+                  int o_num_vals,
+                  int o_max_worker_per_val,
+                  int* o_worker,
+                  int* o_offsets);
+
+    /// See Runtime::post_comm()
+    void post_comm(void* i_buf,
+                   int i_cnt,
+                   MPI_Datatype i_type,
+                   int i_num_vals,
+                   int i_max_worker_per_val,
+                   int* i_worker,
+                   int* i_offsets,
+                   void* o_buf,
+                   int o_cnt,
+                   MPI_Datatype o_type,
+                   int o_num_vals,
+                   int o_max_worker_per_val,
+                   int* o_worker,
+                   int* o_offsets);
+
+    /// See RuntimeImpl::create_plan(). Returns a Plan_MPI_Neighborhood
+    Plan* create_plan(int i_cnt,
+                      MPI_Datatype i_type,
+                      int i_num_vals,
+                      int i_max_worker_per_val,
+                      int* i_worker,
+                      int* i_offsets,
+                      int o_cnt,
+                      MPI_Datatype o_type,
+                      int o_num_vals,
+                      int o_max_worker_per_val,
+                      int* o_worker,
+                      int* o_offsets);
+
+    /// Plan-based pre_comm(): Only the payload is exchanged
+    void pre_comm(Plan* plan, void* i_buf, void* o_buf);
+
+    /// Plan-based post_comm(): Only the payload is exchanged
+    void post_comm(Plan* plan, void* i_buf, void* o_buf);
+
+    /// Split-phase plan-based post_comm(). See 
+    /// RuntimeImpl_MPI_Alltoall::post_comm_begin()
+    void post_comm_begin(Plan* plan, void* i_buf, void* o_buf);
+    bool post_comm_test();
+    void post_comm_wait();
+
+protected:
+    /// See RuntimeImpl_MPI_Common::create_cached_plan(). The topology
+    /// of prev is reused if the edges did not change
+    Plan_MPI_Common* create_cached_plan(Plan_MPI_Common* prev,
+                                        int i_cnt,
+                                        MPI_Datatype i_type,
+                                        int i_num_vals,
+                                        int i_max_worker_per_val,
+                                        int* i_worker,
+                                        int* i_offsets,
+                                        int o_cnt,
+                                        MPI_Datatype o_type,
+                                        int o_num_vals,
+                                        int o_max_worker_per_val,
+                                        int* o_worker,
+                                        int* o_offsets);
+
+private:
+    /// Scatter the received output into o_buf and clear the pending
+    /// post_comm
+    void post_comm_finish();
+
+};
+
+/// Plan_MPI_Neighborhood: Plan_MPI_Common plus the distributed graph
+///                        topology and the per-neighbor counts and
+///                        displacements for MPI_Neighbor_alltoallv. The
+///                        communication buffers are owned by the plan so
+///                        that persistent requests can be used if 
+///                        available.
+///
+/// The graph is symmetric: The neighbors of a processing element are all
+/// ranks it exchanges messages with in pre_comm() or post_comm(), in
+/// ascending order. Neighbors which are only used in one direction get
+/// zero counts in the other.
+class Plan_MPI_Neighborhood : public Plan_MPI_Common
+{
+
+public:
+    /// Create the plan. If prev is not zero and its neighbors are the
+    /// same on all ranks the topology is taken over from prev. The
+    /// function is collective.
+    Plan_MPI_Neighborhood(Instance* ptr,
+                          int i_cnt,
+                          MPI_Datatype i_type,
+                          int i_num_vals,
+                          int i_max_worker_per_val,
+                          int* i_worker,
+                          int* i_offsets,
+                          int o_cnt,
+                          MPI_Datatype o_type,
+                          int o_num_vals,
+                          int o_max_worker_per_val,
+                          int* o_worker,
+                          int* o_offsets,
+                          Plan_MPI_Neighborhood* prev = 0);
+
+    /// Destructor
+    ~Plan_MPI_Neighborhood();
+
+    /// See Plan_MPI_Common::update(). The topology is recreated if the
+    /// set of edges changed on any rank
+    void update(int i_num_changed,
+                int* i_idx,
+                int* i_worker,
+                int* i_offsets,
+                int o_num_changed,
+                int* o_idx,
+                int* o_worker,
+                int* o_offsets);
+
+    /// Distributed graph communicator
+    MPI_Comm graph;
+    /// Number of neighbors and their ranks in the communicator
+    int num_peers;
+    int* peers;
+
+    /// Counts and displacements per neighbor in units of i_type. The
+    /// arrays have num_peers entries
+    int* i_peer_send_cnts;
+    int* i_peer_recv_cnts;
+    int* i_peer_send_displs;
+    int* i_peer_recv_displs;
+    /// Counts and displacements per neighbor in units of o_type
+    int* o_peer_send_cnts;
+    int* o_peer_recv_cnts;
+    int* o_peer_send_displs;
+    int* o_peer_recv_displs;
+
+    /// Types of the received values in pre_comm() and of the send values
+    /// in post_comm(). These are the job types on workers
+    MPI_Datatype i_recv_type;
+    MPI_Datatype o_send_type;
+
+    /// Communication buffers
+    char* i_send_buf;
+    char* i_recv_buf;
+    char* o_send_buf;
+    char* o_recv_buf;
+
+    /// Requests for the exchange in pre_comm() and post_comm(). These
+    /// are persistent if MEXICO_HAVE_MPI_NEIGHBOR_ALLTOALLV_INIT is
+    /// defined
+    MPI_Request i_req;
+    MPI_Request o_req;
+
+private:
+    /// Compute the neighbors by merging the peer lists of the plan.
+    /// Returns the number of neighbors, the ranks are stored in the
+    /// (reallocated) list
+    int find_neighbors(int** list) const;
+
+    /// Create the topology or take it over from prev. The function is
+    /// collective
+    void topology(Plan_MPI_Neighborhood* prev);
+
+    /// Resize and fill the per-neighbor counts and displacements, resize
+    /// the buffers and create the persistent requests
+    void compact();
+
+    /// Free the persistent requests
+    void free_requests();
+
+};
+
+}
+
+#endif
+
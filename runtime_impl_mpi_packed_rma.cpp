@@ -0,0 +1,376 @@
+
+/// vi: tabstop=4:expandtab
+
+/* Copyright 2010 University of Lugano. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the University of Lugano.
+ */
+
+
+#include "mexico_config.hpp"
+
+#include <stdlib.h>
+#ifdef MEXICO_HAVE_MPI_H
+#include <mpi.h>
+#endif
+#include <algorithm>
+#include <limits.h>
+
+#include "runtime_impl_mpi_packed_rma.hpp"
+#include "runs.hpp"
+#include "job.hpp"
+#include "runtime.hpp"
+#include "memory.hpp"
+#include "comm.hpp"
+#include "assert.hpp"
+#include "utils.hpp"
+#include "log.hpp"
+
+
+mexico::RuntimeImpl_MPI_Packed_RMA::RuntimeImpl_MPI_Packed_RMA(Instance* ptr, const std::string& hints)
+: RuntimeImpl_MPI_Common(ptr, hints)
+{
+    MPI_Aint stage_size, o_size;
+    void* o_base;
+
+    if(instance->pe_is_worker)
+    {
+        MPI_Type_extent(job->i_type, &job_i_extent);
+        MPI_Type_extent(job->o_type, &job_o_extent);
+
+        i_buf = memory->alloc_char(job->i_N*job_i_extent);
+
+        /// Enough space for one record per element (i_cnt = 1)
+        stage_size = job->i_N*(sizeof(int) + job_i_extent);
+        o_size     = job->o_N*job_o_extent;
+    }
+    else
+    {
+        job_i_extent = 0;
+        job_o_extent = 0;
+
+        i_buf = 0;
+        o_buf = 0;
+
+        stage_size = 0;
+        o_size     = 0;
+    }
+
+    MEXICO_WRITE(Log::MEDIUM, "stage_size = %ld, o_size = %ld", (long )stage_size, (long )o_size);
+
+    /// Sources check the write position against the size of the staging
+    /// window of the worker
+    stage_sizes = (MPI_Aint* )memory->alloc_char(comm->nprocs*sizeof(MPI_Aint));
+    comm->allgather(&stage_size, sizeof(MPI_Aint), MPI_BYTE, stage_sizes, sizeof(MPI_Aint), MPI_BYTE);
+
+    /// ----------------------------------------------------------------------
+    /// Create the windows and open the passive target epochs
+    comm->win_allocate(stage_size, 1, MPI_INFO_NULL, &stage_buf, &stage_win);
+    comm->win_allocate(o_size, 1, MPI_INFO_NULL, &o_base, &o_win);
+    comm->win_allocate(SYNC_NUM*sizeof(int), sizeof(int), MPI_INFO_NULL, &sync_buf, &sync_win);
+
+    if(instance->pe_is_worker)
+        o_buf = o_base;
+
+    std::fill(sync_buf, sync_buf+SYNC_NUM, 0);
+
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, stage_win);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, o_win);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, sync_win);
+
+    /// Make sure nobody increments a counter before it is initialized
+    MPI_Win_sync(sync_win);
+    comm->barrier();
+    /// ----------------------------------------------------------------------
+
+    num_calls = 0;
+
+    num_vals_to_send = memory->alloc_int(comm->nprocs);
+    displs           = memory->alloc_int(comm->nprocs);
+
+    peers   = memory->alloc_int(comm->nprocs);
+    slots   = memory->alloc_int(comm->nprocs);
+    pending = memory->alloc_int(comm->nprocs);
+
+    /// Reallocated as needed
+    comm_send_buf = 0;
+
+    o_runs = new Runs(instance);
+}
+
+mexico::RuntimeImpl_MPI_Packed_RMA::~RuntimeImpl_MPI_Packed_RMA()
+{
+    MPI_Win_unlock_all(stage_win);
+    MPI_Win_unlock_all(o_win);
+    MPI_Win_unlock_all(sync_win);
+
+    /// Frees stage_buf, o_buf and sync_buf
+    MPI_Win_free(&stage_win);
+    MPI_Win_free(&o_win);
+    MPI_Win_free(&sync_win);
+
+    delete o_runs;
+
+    memory->free_char(&comm_send_buf);
+
+    memory->free_int(&pending);
+    memory->free_int(&slots);
+    memory->free_int(&peers);
+
+    memory->free_int(&displs);
+    memory->free_int(&num_vals_to_send);
+
+    memory->free_char((char** )&stage_sizes);
+
+    if(instance->pe_is_worker)
+        memory->free_char((char** )&i_buf);
+}
+
+void mexico::RuntimeImpl_MPI_Packed_RMA::wait_for(int num, int* ranks, int counter, int val)
+{
+    int m, n, zero = 0;
+
+    /// Poll all ranks at once and repeat only for those which are not
+    /// ready yet
+    std::copy(ranks, ranks+num, pending);
+
+    while(num > 0)
+    {
+        for(m = 0; m < num; ++m)
+            MPI_Fetch_and_op(&zero, &slots[m], MPI_INT, pending[m], counter, MPI_NO_OP, sync_win);
+
+        MPI_Win_flush_all(sync_win);
+
+        for(m = 0, n = 0; m < num; ++m)
+            if(slots[m] < val)
+                pending[n++] = pending[m];
+
+        num = n;
+    }
+}
+
+void mexico::RuntimeImpl_MPI_Packed_RMA::add(int rank, int counter, int val)
+{
+    MPI_Accumulate(&val, 1, MPI_INT, rank, counter, 1, MPI_INT, MPI_SUM, sync_win);
+    MPI_Win_flush(rank, sync_win);
+}
+
+void mexico::RuntimeImpl_MPI_Packed_RMA::done(int counter)
+{
+    int m, one = 1;
+
+    for(m = 0; m < instance->num_worker; ++m)
+        MPI_Accumulate(&one, 1, MPI_INT, instance->worker[m], counter, 1, MPI_INT, MPI_SUM, sync_win);
+
+    MPI_Win_flush_all(sync_win);
+}
+
+void mexico::RuntimeImpl_MPI_Packed_RMA::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                 int* i_worker, int* i_offsets,
+                                                 void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                 int* o_worker, int* o_offsets)
+{
+    int i, j, k, m, w, n, num_peers, zero = 0;
+    MPI_Aint i_extent, rec;
+    MPI_Datatype packed;
+    char* p;
+
+    MPI_Type_extent(i_type, &i_extent);
+
+    /// Declared in RuntimeImpl_MPI_Common
+    put_min_cnt = INT_MAX;
+    put_max_cnt = -1;
+    put_avg_cnt = 0;
+    put_num     = 0;
+
+    /// Size of a record (offset, payload)
+    rec = sizeof(int) + i_cnt*i_extent;
+
+    MPI_Type_contiguous(rec, MPI_BYTE, &packed);
+    MPI_Type_commit(&packed);
+
+    /// ----------------------------------------------------------------------
+    /// Pack the records by worker
+    std::fill(num_vals_to_send, num_vals_to_send+comm->nprocs, 0);
+
+    for(j = 0; j < i_max_worker_per_val; ++j)
+        for(i = 0; i < i_num_vals; ++i)
+            if(-1 != (w = i_worker[i + i_num_vals*j]))
+                ++num_vals_to_send[w];
+
+    num_peers = 0;
+    for(w = 0, n = 0; w < comm->nprocs; ++w)
+    {
+        displs[w] = n;
+        n += num_vals_to_send[w];
+
+        if(num_vals_to_send[w] > 0)
+            peers[num_peers++] = w;
+    }
+
+    memory->realloc_char(&comm_send_buf, n*rec);
+
+    /// num_vals_to_send is used as a cursor and restored afterwards
+    std::fill(num_vals_to_send, num_vals_to_send+comm->nprocs, 0);
+
+    for(j = 0; j < i_max_worker_per_val; ++j)
+        for(i = 0; i < i_num_vals; ++i)
+        {
+            if(-1 == (w = i_worker[i + i_num_vals*j]))
+                continue;
+
+            p = comm_send_buf + (displs[w] + num_vals_to_send[w]++)*rec;
+
+            std::copy((char* )&i_offsets[i + i_num_vals*j], (char* )&i_offsets[i + i_num_vals*j] + sizeof(int), p);
+            std::copy(&((char* )i_buf)[i*i_cnt*i_extent], &((char* )i_buf)[(i + 1)*i_cnt*i_extent], p + sizeof(int));
+        }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Deliver the records
+
+    /// All workers, not only our peers, must have unpacked the records of
+    /// the last call. Otherwise our done increment could be counted in
+    /// the last call
+    wait_for(instance->num_worker, instance->worker, SYNC_I_CONSUMED, num_calls);
+
+    for(m = 0; m < num_peers; ++m)
+        MPI_Fetch_and_op(&num_vals_to_send[peers[m]], &slots[m], MPI_INT, peers[m], SYNC_I_RESERVED, MPI_SUM, sync_win);
+
+    MPI_Win_flush_all(sync_win);
+
+    for(m = 0; m < num_peers; ++m)
+        if((slots[m] + num_vals_to_send[peers[m]])*rec > stage_sizes[peers[m]])
+            MEXICO_FATAL("Records [%d, %d) exceed the staging window of worker %d", slots[m], slots[m] + num_vals_to_send[peers[m]], peers[m]);
+
+    for(m = 0; m < num_peers; ++m)
+        put(comm_send_buf + displs[peers[m]]*rec, num_vals_to_send[peers[m]], packed, peers[m], slots[m]*rec, stage_win);
+
+    /// The records must be complete at the worker before we count them
+    MPI_Win_flush_all(stage_win);
+
+    /// The reservations are complete as well, so the workers can read the
+    /// number of records from SYNC_I_RESERVED after the done increments
+    done(SYNC_I_SOURCES);
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Unpack the records on the worker
+    if(instance->pe_is_worker)
+    {
+        /// All records must have arrived and all requesters of the last
+        /// call must be done with our o_buf before the job overwrites it
+        wait_for(1, &comm->myrank, SYNC_I_SOURCES, comm->nprocs);
+        if(slots[0] != comm->nprocs)
+            MEXICO_FATAL("Expected %d done increments for the input but got %d", comm->nprocs, slots[0]);
+
+        if(num_calls > 0)
+        {
+            wait_for(1, &comm->myrank, SYNC_O_SOURCES, comm->nprocs);
+            if(slots[0] != comm->nprocs)
+                MEXICO_FATAL("Expected %d done increments for the output but got %d", comm->nprocs, slots[0]);
+        }
+
+        /// Read the number of records and release the staging window for
+        /// the next call at once
+        MPI_Fetch_and_op(&zero, &n, MPI_INT, comm->myrank, SYNC_I_RESERVED, MPI_REPLACE, sync_win);
+        MPI_Win_flush(comm->myrank, sync_win);
+
+        MPI_Win_sync(stage_win);
+
+        for(k = 0; k < n; ++k)
+        {
+            p = stage_buf + k*rec;
+
+            std::copy(p, p + sizeof(int), (char* )&m);
+            std::copy(p + sizeof(int), p + rec, &((char* )this->i_buf)[m*i_cnt*i_extent]);
+        }
+
+        add(comm->myrank, SYNC_I_SOURCES, -comm->nprocs);
+        if(num_calls > 0)
+            add(comm->myrank, SYNC_O_SOURCES, -comm->nprocs);
+        add(comm->myrank, SYNC_I_CONSUMED, 1);
+    }
+    /// ----------------------------------------------------------------------
+
+    ++num_calls;
+
+    MPI_Type_free(&packed);
+
+    /// Compute the average
+    put_avg_cnt = put_avg_cnt/put_num;
+
+    MEXICO_WRITE(Log::DEBUG, "put cnt stats: num = %d, min = %d, max = %d, avg = %.3f", put_num, put_min_cnt, put_max_cnt, put_avg_cnt);
+}
+
+void mexico::RuntimeImpl_MPI_Packed_RMA::post_comm(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                  int* i_worker, int* i_offsets,
+                                                  void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                  int* o_worker, int* o_offsets)
+{
+    int r;
+    MPI_Aint o_extent;
+
+    MPI_Type_extent(o_type, &o_extent);
+
+    /// Declared in RuntimeImpl_MPI_Common
+    get_min_cnt = INT_MAX;
+    get_max_cnt = -1;
+    get_avg_cnt = 0;
+    get_num     = 0;
+
+    /// The job is done: Publish the o_buf
+    if(instance->pe_is_worker)
+    {
+        MPI_Win_sync(o_win);
+        add(comm->myrank, SYNC_O_READY, 1);
+    }
+
+    /// ----------------------------------------------------------------------
+    /// Read the output
+    o_runs->build(o_num_vals, o_max_worker_per_val, o_worker, o_offsets, true);
+    o_runs->alloc_staging(o_cnt*o_extent);
+
+    /// Waiting for all workers makes sure that they consumed the done
+    /// increments of the last call (see pre_comm())
+    wait_for(instance->num_worker, instance->worker, SYNC_O_READY, num_calls);
+
+    for(r = 0; r < o_runs->num_runs; ++r)
+        get(o_runs->staging + o_runs->run_first[r]*o_cnt*o_extent, o_cnt*o_runs->run_len[r], o_type,
+            o_runs->run_worker[r], o_cnt*o_runs->run_offset[r]*o_extent, o_win);
+
+    MPI_Win_flush_local_all(o_win);
+
+    done(SYNC_O_SOURCES);
+
+    o_runs->scatter(o_buf, o_cnt*o_extent);
+    /// ----------------------------------------------------------------------
+
+    /// Compute the average
+    get_avg_cnt = get_avg_cnt/get_num;
+
+    MEXICO_WRITE(Log::DEBUG, "get cnt stats: num = %d, min = %d, max = %d, avg = %.3f", get_num, get_min_cnt, get_max_cnt, get_avg_cnt);
+}
+
@@ -0,0 +1,170 @@
+
+/// vi: tabstop=4:expandtab
+
+/* Copyright 2010 University of Lugano. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the University of Lugano.
+ */
+
+
+#ifndef MEXICO_RUNTIME_IMPL_MPI_PACKED_RMA_HPP_INCLUDED
+#define MEXICO_RUNTIME_IMPL_MPI_PACKED_RMA_HPP_INCLUDED 1
+
+#include <string>
+
+#include "pointers.hpp"
+#include "runtime_impl_mpi_common.hpp"
+
+
+namespace mexico
+{
+
+class Runs;
+
+/// RuntimeImpl_MPI_Packed_RMA: Runtime implementation which packs the
+///                             values for a worker into (offset, payload)
+///                             records and delivers them with one-sided
+///                             communication. Each source reserves a
+///                             contiguous region in the staging window of
+///                             the worker with MPI_Fetch_and_op and writes
+///                             all its records with a single MPI_Put. The
+///                             worker unpacks the records into its i_buf
+///                             once all processing elements delivered
+///                             their records. The output is
+///                             read from the worker o_buf with one MPI_Get
+///                             per run of consecutive offsets (see Runs).
+///
+/// All windows are allocated with MPI_Win_allocate and stay in a passive
+/// target epoch for the lifetime of the runtime. There is no collective
+/// call per exchange: Each processing element adds a done increment to a
+/// counter of every worker once its records are delivered and once it
+/// read its output. A worker finds the number of records in the counter
+/// of reserved slots after the done increments of all processing elements
+/// arrived. Before sending a done increment, a processing element waits
+/// until all workers consumed the increments of the last call.
+class RuntimeImpl_MPI_Packed_RMA : public RuntimeImpl_MPI_Common
+{
+
+public:
+    RuntimeImpl_MPI_Packed_RMA(Instance* ptr, const std::string& hints);
+
+    /// Destructor
+    ~RuntimeImpl_MPI_Packed_RMA();
+
+    /// See Runtime::pre_comm()
+    void pre_comm(void* i_buf,
+                  int i_cnt,
+                  MPI_Datatype i_type,
+                  int i_num_vals,
+                  int i_max_worker_per_val,
+                  int* i_worker,
+                  int* i_offsets,
+                  void* o_buf,
+                  int o_cnt,
+                  MPI_Datatype o_type,
+                  int o_num_vals,
+                  int o_max_worker_per_val,
+                  int* o_worker,
+                  int* o_offsets);
+
+    /// See Runtime::post_comm()
+    void post_comm(void* i_buf,
+                   int i_cnt,
+                   MPI_Datatype i_type,
+                   int i_num_vals,
+                   int i_max_worker_per_val,
+                   int* i_worker,
+                   int* i_offsets,
+                   void* o_buf,
+                   int o_cnt,
+                   MPI_Datatype o_type,
+                   int o_num_vals,
+                   int o_max_worker_per_val,
+                   int* o_worker,
+                   int* o_offsets);
+
+private:
+    /// Counters in sync_win
+    enum
+    {
+        /// Number of records reserved in the staging window
+        SYNC_I_RESERVED = 0,
+        /// Number of processing elements which delivered their records
+        SYNC_I_SOURCES  = 1,
+        /// Number of calls for which the worker unpacked the records. The
+        /// staging window may be written again once it reaches the
+        /// number of calls of the source
+        SYNC_I_CONSUMED = 2,
+        /// Number of calls for which the o_buf of the worker is ready
+        SYNC_O_READY    = 3,
+        /// Number of processing elements which read their values from the
+        /// o_buf of the worker
+        SYNC_O_SOURCES  = 4,
+        SYNC_NUM        = 5
+    };
+
+    /// Staging window (records), output window (o_buf) and counters
+    MPI_Win stage_win, o_win, sync_win;
+    char* stage_buf;
+    int* sync_buf;
+
+    /// Size of the staging window of each rank in bytes
+    MPI_Aint* stage_sizes;
+
+    /// Number of calls to pre_comm()
+    int num_calls;
+
+    /// Number of values to send to each rank
+    int* num_vals_to_send;
+    /// Start of the records for each rank in comm_send_buf
+    int* displs;
+
+    /// List of peers, the reserved slots and scratch space for polling
+    /// the counters of the peers
+    int* peers;
+    int* slots;
+    int* pending;
+
+    /// Packed records
+    char* comm_send_buf;
+
+    /// Sorted entries of the output matrix
+    Runs* o_runs;
+
+    /// Wait until counter is at least val on each of the num ranks
+    void wait_for(int num, int* ranks, int counter, int val);
+
+    /// Add val to the counter of rank
+    void add(int rank, int counter, int val);
+
+    /// Add a done increment to the counter of all workers
+    void done(int counter);
+
+};
+
+}
+
+#endif
+
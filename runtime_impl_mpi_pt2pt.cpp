@@ -39,6 +39,7 @@
 #include "runtime_impl_mpi_pt2pt.hpp"
 #include "job.hpp"
 #include "runtime.hpp"
+#include "plan.hpp"
 #include "memory.hpp"
 #include "comm.hpp"
 #include "assert.hpp"
@@ -51,6 +52,12 @@ mexico::RuntimeImpl_MPI_Pt2Pt::RuntimeImpl_MPI_Pt2Pt(Instance* ptr, const std::s
 {
     int w;
 
+    /// Read the hints
+    MEXICO_READ_HINT(hints, "cache_plan", cache_plan);
+
+    /// All input is received in pre_comm() one source at a time
+    supports_streaming = true;
+
     if(instance->pe_is_worker)
     {
         MPI_Type_extent(job->i_type, &job_i_extent);
@@ -77,6 +84,15 @@ mexico::RuntimeImpl_MPI_Pt2Pt::RuntimeImpl_MPI_Pt2Pt(Instance* ptr, const std::s
     comm_recv_buf = 0;
     comm_send_buf = 0;
     offsets_send_buf = 0;
+    stream_offsets = 0;
+
+    active_plan  = 0;
+    emitting     = false;
+    emit_pending = 0;
+    emit_ptr     = 0;
+    emit_peer    = 0;
+    emit_pos     = 0;
+    emit_done    = 0;
     
     /// Splitted send buffer used in post_comm. Here we need to
     /// be able to reallocate the individual buffers and hence
@@ -85,8 +101,11 @@ mexico::RuntimeImpl_MPI_Pt2Pt::RuntimeImpl_MPI_Pt2Pt(Instance* ptr, const std::s
     for(w = 0; w < comm->nprocs; ++w)
         split_send_buf[w] = 0;
 
-    send_req = (MPI_Request* )memory->alloc_char(comm->nprocs*sizeof(MPI_Request));
-    recv_req = (MPI_Request* )memory->alloc_char(comm->nprocs*sizeof(MPI_Request));
+    /// Sized to the number of peers on demand
+    send_req = 0;
+    recv_req = 0;
+    num_send_req = 0;
+    num_recv_req = 0;
 }
 
 mexico::RuntimeImpl_MPI_Pt2Pt::~RuntimeImpl_MPI_Pt2Pt()
@@ -100,6 +119,12 @@ mexico::RuntimeImpl_MPI_Pt2Pt::~RuntimeImpl_MPI_Pt2Pt()
         memory->free_char(&split_send_buf[w]);
     
     memory->free_int (&offsets_send_buf);
+    memory->free_int (&stream_offsets);
+    memory->free_int (&emit_pending);
+    memory->free_int (&emit_ptr);
+    memory->free_int (&emit_peer);
+    memory->free_int (&emit_pos);
+    memory->free_char(&emit_done);
     memory->free_char(&comm_send_buf);
     memory->free_char(&comm_recv_buf);
 
@@ -114,6 +139,11 @@ mexico::RuntimeImpl_MPI_Pt2Pt::~RuntimeImpl_MPI_Pt2Pt()
     }
 }
 
+void mexico::RuntimeImpl_MPI_Pt2Pt::realloc_requests(MPI_Request** req, int n)
+{
+    memory->realloc_char((char** )req, n*sizeof(MPI_Request));
+}
+
 long mexico::RuntimeImpl_MPI_Pt2Pt::total_num_msgs_to_recv() const
 {       
     long N;
@@ -145,6 +175,14 @@ void mexico::RuntimeImpl_MPI_Pt2Pt::pre_comm(void* i_buf, int i_cnt, MPI_Datatyp
     MPI_Datatype packed;
     MPI_Status status;
 
+    if(cache_plan)
+    {
+        pre_comm(update_cached_plan(i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                                    o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets),
+                 i_buf, o_buf);
+        return;
+    }
+
     MPI_Type_extent(i_type, &i_extent);
     packed = create_struct_int_type(i_cnt, i_type);
     stride = sizeof(int) + i_cnt*i_extent;
@@ -193,11 +231,12 @@ void mexico::RuntimeImpl_MPI_Pt2Pt::pre_comm(void* i_buf, int i_cnt, MPI_Datatyp
     /// Send data
     incl_scan(num_msgs_to_send, num_msgs_to_send+comm->nprocs, displs);
 
+    realloc_requests(&send_req, count_positive(num_msgs_to_send, num_msgs_to_send+comm->nprocs));
+
+    num_send_req = 0;
     for(w = 0; w < comm->nprocs; ++w)
         if(num_msgs_to_send[w] > 0)
-            send_req[w] = comm->isend(comm_send_buf + displs[w]*stride, num_msgs_to_send[w], packed, w, 0);
-        else
-            send_req[w] = MPI_REQUEST_NULL;
+            send_req[num_send_req++] = comm->isend(comm_send_buf + displs[w]*stride, num_msgs_to_send[w], packed, w, 0);
     /// ----------------------------------------------------------------------
 
     /// ----------------------------------------------------------------------
@@ -217,6 +256,9 @@ void mexico::RuntimeImpl_MPI_Pt2Pt::pre_comm(void* i_buf, int i_cnt, MPI_Datatyp
             comm->recv(comm_recv_buf, count, packed, status.MPI_SOURCE, status.MPI_TAG);
 
             /// Scatter the data
+            if(job->streaming)
+                memory->realloc_int(&stream_offsets, count);
+
             for(i = 0; i < count; ++i)
             {
                 j = *((int* )&comm_recv_buf[i*stride]);
@@ -225,13 +267,19 @@ void mexico::RuntimeImpl_MPI_Pt2Pt::pre_comm(void* i_buf, int i_cnt, MPI_Datatyp
                 std::copy(&comm_recv_buf[i*stride + sizeof(int)],
                           &comm_recv_buf[i*stride + sizeof(int)]+i_cnt*job_i_extent,
                           &((char* )this->i_buf)[j*i_cnt*job_i_extent]);
+
+                if(job->streaming)
+                    stream_offsets[i] = j;
             }
+
+            /// The values from this source are complete
+            stream(i_cnt, count, stream_offsets);
             
             N += count*i_cnt;
         }
     }
 
-    MPI_Waitall(comm->nprocs, send_req, MPI_STATUSES_IGNORE);
+    MPI_Waitall(num_send_req, send_req, MPI_STATUSES_IGNORE);
     /// ----------------------------------------------------------------------
 
     MPI_Type_free(&packed);
@@ -247,6 +295,13 @@ void mexico::RuntimeImpl_MPI_Pt2Pt::post_comm(void* i_buf, int i_cnt, MPI_Dataty
     MPI_Status status;
     MPI_Aint o_extent;
 
+    /// The plan has been updated in pre_comm()
+    if(cache_plan)
+    {
+        post_comm(cached_plan, i_buf, o_buf);
+        return;
+    }
+
     MPI_Type_extent(o_type, &o_extent);
 
     /// ----------------------------------------------------------------------
@@ -285,11 +340,12 @@ void mexico::RuntimeImpl_MPI_Pt2Pt::post_comm(void* i_buf, int i_cnt, MPI_Dataty
     
     incl_scan(num_msgs_to_recv, num_msgs_to_recv+comm->nprocs, displs);
 
+    realloc_requests(&send_req, count_positive(num_msgs_to_recv, num_msgs_to_recv+comm->nprocs));
+
+    num_send_req = 0;
     for(w = 0; w < comm->nprocs; ++w)
-        if(num_msgs_to_send[w] > 0)
-            send_req[w] = comm->isend(offsets_send_buf + displs[w], num_msgs_to_recv[w], MPI_INT, w, 1);
-        else
-            send_req[w] = MPI_REQUEST_NULL;
+        if(num_msgs_to_recv[w] > 0)
+            send_req[num_send_req++] = comm->isend(offsets_send_buf + displs[w], num_msgs_to_recv[w], MPI_INT, w, 1);
     /// ----------------------------------------------------------------------
 
     /// ----------------------------------------------------------------------
@@ -330,7 +386,7 @@ void mexico::RuntimeImpl_MPI_Pt2Pt::post_comm(void* i_buf, int i_cnt, MPI_Dataty
         }
     }
 
-    MPI_Waitall(comm->nprocs, send_req, MPI_STATUSES_IGNORE);
+    MPI_Waitall(num_send_req, send_req, MPI_STATUSES_IGNORE);
     /// ----------------------------------------------------------------------
 
     /// ----------------------------------------------------------------------
@@ -338,20 +394,22 @@ void mexico::RuntimeImpl_MPI_Pt2Pt::post_comm(void* i_buf, int i_cnt, MPI_Dataty
     memory->realloc_char(&comm_recv_buf, total_num_msgs_to_recv()*o_cnt*o_extent);
 
     incl_scan(num_msgs_to_recv, num_msgs_to_recv+comm->nprocs, displs);
+
+    realloc_requests(&recv_req, count_positive(num_msgs_to_recv, num_msgs_to_recv+comm->nprocs));
+    realloc_requests(&send_req, count_positive(num_msgs_to_send, num_msgs_to_send+comm->nprocs));
+
+    num_recv_req = 0;
     for(w = 0; w < comm->nprocs; ++w)
         if(num_msgs_to_recv[w] > 0)
-            recv_req[w] = comm->irecv((char* )comm_recv_buf + displs[w]*o_cnt*o_extent, num_msgs_to_recv[w]*o_cnt, o_type, w, 2);
-        else
-            recv_req[w] = MPI_REQUEST_NULL;
+            recv_req[num_recv_req++] = comm->irecv((char* )comm_recv_buf + displs[w]*o_cnt*o_extent, num_msgs_to_recv[w]*o_cnt, o_type, w, 2);
 
+    num_send_req = 0;
     for(w = 0; w < comm->nprocs; ++w)
         if(num_msgs_to_send[w] > 0)
-            send_req[w] = comm->isend(split_send_buf[w], num_msgs_to_send[w]*o_cnt, job->o_type, w, 2);
-        else
-            send_req[w] = MPI_REQUEST_NULL;
+            send_req[num_send_req++] = comm->isend(split_send_buf[w], num_msgs_to_send[w]*o_cnt, job->o_type, w, 2);
 
-    MPI_Waitall(comm->nprocs, recv_req, MPI_STATUSES_IGNORE);
-    MPI_Waitall(comm->nprocs, send_req, MPI_STATUSES_IGNORE);
+    MPI_Waitall(num_recv_req, recv_req, MPI_STATUSES_IGNORE);
+    MPI_Waitall(num_send_req, send_req, MPI_STATUSES_IGNORE);
     /// ----------------------------------------------------------------------
 
     /// ----------------------------------------------------------------------
@@ -373,3 +431,311 @@ void mexico::RuntimeImpl_MPI_Pt2Pt::post_comm(void* i_buf, int i_cnt, MPI_Dataty
     /// ----------------------------------------------------------------------
 }
 
+mexico::Plan* mexico::RuntimeImpl_MPI_Pt2Pt::create_plan(int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                         int* i_worker, int* i_offsets,
+                                                         int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                         int* o_worker, int* o_offsets)
+{
+    return new Plan_MPI_Common(instance, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                               o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets);
+}
+
+void mexico::RuntimeImpl_MPI_Pt2Pt::pre_comm(Plan* plan, void* i_buf, void* o_buf)
+{
+    Plan_MPI_Common* p = static_cast<Plan_MPI_Common*>(plan);
+    int k, m, w, i_cnt;
+    MPI_Aint i_extent;
+    long n;
+
+    i_cnt = p->i_cnt;
+    MPI_Type_extent(p->i_type, &i_extent);
+
+    memory->realloc_char(&comm_send_buf, p->i_total_send*i_cnt*    i_extent);
+    memory->realloc_char(&comm_recv_buf, p->i_total_recv*i_cnt*job_i_extent);
+
+    realloc_requests(&send_req, p->i_num_send_peers);
+    realloc_requests(&recv_req, p->i_num_recv_peers);
+
+    /// ----------------------------------------------------------------------
+    /// Prepost the receives
+    for(m = 0; m < p->i_num_recv_peers; ++m)
+    {
+        w = p->i_recv_peers[m];
+        recv_req[m] = comm->irecv(comm_recv_buf + p->i_recv_displs[w]*job_i_extent, p->i_num_vals_to_recv[w], job->i_type, w, 0);
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Pack and send data
+    n = 0;
+    for(m = 0; m < p->i_num_send_peers; ++m)
+    {
+        w = p->i_send_peers[m];
+
+        for(k = 0; k < p->i_num_msgs_to_send[w]; ++k, ++n)
+            std::copy(&((char* )i_buf)[i_cnt*i_extent*p->i_send_idx[w][k]],
+                      &((char* )i_buf)[i_cnt*i_extent*p->i_send_idx[w][k]]+i_cnt*i_extent,
+                      &comm_send_buf[n*i_cnt*i_extent]);
+
+        send_req[m] = comm->isend(comm_send_buf + p->i_send_displs[w]*i_extent, p->i_num_vals_to_send[w], p->i_type, w, 0);
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Reorder data one source at a time as it arrives
+    while(1)
+    {
+        MPI_Waitany(p->i_num_recv_peers, recv_req, &m, MPI_STATUS_IGNORE);
+        if(MPI_UNDEFINED == m)
+            break;
+
+        w = p->i_recv_peers[m];
+
+        for(k = 0; k < p->i_num_msgs_to_recv[w]; ++k)
+        {
+            MEXICO_ASSERT(p->i_recv_offsets[w][k]*i_cnt < job->i_N);
+
+            /// Caution: Need to use the i_buf member variable here!
+            std::copy(&comm_recv_buf[(p->i_recv_displs[w] + k*i_cnt)*job_i_extent],
+                      &comm_recv_buf[(p->i_recv_displs[w] + k*i_cnt)*job_i_extent]+i_cnt*job_i_extent,
+                      &((char* )this->i_buf)[p->i_recv_offsets[w][k]*i_cnt*job_i_extent]);
+        }
+
+        /// The values from this source are complete
+        stream(i_cnt, p->i_num_msgs_to_recv[w], p->i_recv_offsets[w]);
+    }
+
+    MPI_Waitall(p->i_num_send_peers, send_req, MPI_STATUSES_IGNORE);
+    /// ----------------------------------------------------------------------
+
+    active_plan = p;
+}
+
+void mexico::RuntimeImpl_MPI_Pt2Pt::post_comm(Plan* plan, void* i_buf, void* o_buf)
+{
+    post_comm_begin(plan, i_buf, o_buf);
+    post_comm_wait();
+}
+
+void mexico::RuntimeImpl_MPI_Pt2Pt::post_comm_begin(Plan* plan, void* i_buf, void* o_buf)
+{
+    Plan_MPI_Common* p = static_cast<Plan_MPI_Common*>(plan);
+    int k, m, w, o_cnt;
+    MPI_Aint o_extent;
+
+    o_cnt = p->o_cnt;
+    MPI_Type_extent(p->o_type, &o_extent);
+
+    /// Messages emitted by the job may still be in flight from comm_send_buf
+    /// and send_req already holds their requests
+    if(!emitting)
+    {
+        memory->realloc_char(&comm_send_buf, p->o_total_send*o_cnt*job_o_extent);
+        realloc_requests(&send_req, p->o_num_send_peers);
+    }
+    memory->realloc_char(&comm_recv_buf, p->o_total_recv*o_cnt*    o_extent);
+    realloc_requests(&recv_req, p->o_num_recv_peers);
+
+    /// ----------------------------------------------------------------------
+    /// Prepost the receives
+    for(m = 0; m < p->o_num_recv_peers; ++m)
+    {
+        w = p->o_recv_peers[m];
+        recv_req[m] = comm->irecv(comm_recv_buf + p->o_recv_displs[w]*o_extent, p->o_num_vals_to_recv[w], p->o_type, w, 2);
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Gather and send the data back. Requesters whose messages have all
+    /// been emitted by the job are already served
+    for(m = 0; m < p->o_num_send_peers; ++m)
+    {
+        if(emitting and 0 == emit_pending[m])
+            continue;
+
+        w = p->o_send_peers[m];
+
+        for(k = 0; k < p->o_num_msgs_to_send[w]; ++k)
+        {
+            MEXICO_ASSERT(p->o_send_offsets[w][k]*o_cnt < job->o_N);
+
+            /// Caution: Need to use the o_buf member variable here!
+            std::copy(&((char* )this->o_buf)[p->o_send_offsets[w][k]*o_cnt*job_o_extent],
+                      &((char* )this->o_buf)[p->o_send_offsets[w][k]*o_cnt*job_o_extent]+o_cnt*job_o_extent,
+                      &comm_send_buf[(p->o_send_displs[w] + k*o_cnt)*job_o_extent]);
+        }
+
+        send_req[m] = comm->isend(comm_send_buf + p->o_send_displs[w]*job_o_extent, p->o_num_vals_to_send[w], job->o_type, w, 2);
+    }
+    /// ----------------------------------------------------------------------
+
+    active_plan = 0;
+    emitting    = false;
+
+    pending_plan  = plan;
+    pending_i_buf = i_buf;
+    pending_o_buf = o_buf;
+}
+
+bool mexico::RuntimeImpl_MPI_Pt2Pt::post_comm_test()
+{
+    Plan_MPI_Common* p = static_cast<Plan_MPI_Common*>(pending_plan);
+    int flag;
+
+    if(!p)
+        return true;
+
+    MPI_Testall(p->o_num_recv_peers, recv_req, &flag, MPI_STATUSES_IGNORE);
+    if(!flag)
+        return false;
+
+    MPI_Testall(p->o_num_send_peers, send_req, &flag, MPI_STATUSES_IGNORE);
+    if(!flag)
+        return false;
+
+    post_comm_finish();
+    return true;
+}
+
+void mexico::RuntimeImpl_MPI_Pt2Pt::post_comm_wait()
+{
+    Plan_MPI_Common* p = static_cast<Plan_MPI_Common*>(pending_plan);
+
+    if(!p)
+        return;
+
+    MPI_Waitall(p->o_num_recv_peers, recv_req, MPI_STATUSES_IGNORE);
+    MPI_Waitall(p->o_num_send_peers, send_req, MPI_STATUSES_IGNORE);
+
+    post_comm_finish();
+}
+
+void mexico::RuntimeImpl_MPI_Pt2Pt::post_comm_finish()
+{
+    Plan_MPI_Common* p = static_cast<Plan_MPI_Common*>(pending_plan);
+    int k, m, w, o_cnt;
+    MPI_Aint o_extent;
+    long n;
+
+    o_cnt = p->o_cnt;
+    MPI_Type_extent(p->o_type, &o_extent);
+
+    /// ----------------------------------------------------------------------
+    /// Reorder the data
+    n = 0;
+    for(m = 0; m < p->o_num_recv_peers; ++m)
+    {
+        w = p->o_recv_peers[m];
+
+        for(k = 0; k < p->o_num_msgs_to_recv[w]; ++k, ++n)
+            std::copy(&comm_recv_buf[n*o_cnt*o_extent],
+                      &comm_recv_buf[n*o_cnt*o_extent]+o_cnt*o_extent,
+                      &((char* )pending_o_buf)[o_cnt*o_extent*p->o_recv_idx[w][k]]);
+    }
+    /// ----------------------------------------------------------------------
+
+    pending_plan = 0;
+}
+
+void mexico::RuntimeImpl_MPI_Pt2Pt::emitted(int first, int count)
+{
+    Plan_MPI_Common* p = active_plan;
+    int s, e, k, m, w, o_cnt;
+
+    if(!p)
+        return;
+
+    if(!emitting)
+        emit_begin();
+
+    o_cnt = p->o_cnt;
+
+    /// Only messages which are completely contained in the range
+    for(s = (first + o_cnt - 1)/o_cnt; s < (first + count)/o_cnt; ++s)
+    {
+        MEXICO_ASSERT(s >= 0 && s*o_cnt < job->o_N);
+
+        if(emit_done[s])
+            continue;
+        emit_done[s] = 1;
+
+        for(e = emit_ptr[s]; e < emit_ptr[s+1]; ++e)
+        {
+            m = emit_peer[e];
+            k = emit_pos [e];
+            w = p->o_send_peers[m];
+
+            /// Caution: Need to use the o_buf member variable here!
+            std::copy(&((char* )this->o_buf)[s*o_cnt*job_o_extent],
+                      &((char* )this->o_buf)[s*o_cnt*job_o_extent]+o_cnt*job_o_extent,
+                      &comm_send_buf[(p->o_send_displs[w] + k*o_cnt)*job_o_extent]);
+
+            emit_pending[m] -= 1;
+            if(0 == emit_pending[m])
+                send_req[m] = comm->isend(comm_send_buf + p->o_send_displs[w]*job_o_extent, p->o_num_vals_to_send[w], job->o_type, w, 2);
+        }
+    }
+}
+
+void mexico::RuntimeImpl_MPI_Pt2Pt::emit_begin()
+{
+    Plan_MPI_Common* p = active_plan;
+    int s, k, m, w, num_slots;
+
+    num_slots = job->o_N/p->o_cnt;
+
+    memory->realloc_char(&comm_send_buf, p->o_total_send*p->o_cnt*job_o_extent);
+    realloc_requests(&send_req, p->o_num_send_peers);
+
+    memory->realloc_int (&emit_pending, p->o_num_send_peers);
+    memory->realloc_int (&emit_ptr    , num_slots + 1);
+    memory->realloc_int (&emit_peer   , p->o_total_send);
+    memory->realloc_int (&emit_pos    , p->o_total_send);
+    memory->realloc_char(&emit_done   , num_slots);
+
+    for(m = 0; m < p->o_num_send_peers; ++m)
+        emit_pending[m] = p->o_num_msgs_to_send[p->o_send_peers[m]];
+    std::fill(emit_done, emit_done+num_slots, 0);
+
+    /// ----------------------------------------------------------------------
+    /// Invert the o_send_offsets lists
+    std::fill(emit_ptr, emit_ptr+num_slots+1, 0);
+    for(m = 0; m < p->o_num_send_peers; ++m)
+    {
+        w = p->o_send_peers[m];
+
+        for(k = 0; k < p->o_num_msgs_to_send[w]; ++k)
+        {
+            MEXICO_ASSERT(p->o_send_offsets[w][k] < num_slots);
+            emit_ptr[p->o_send_offsets[w][k]+1] += 1;
+        }
+    }
+
+    std::partial_sum(emit_ptr, emit_ptr+num_slots+1, emit_ptr);
+
+    for(m = 0; m < p->o_num_send_peers; ++m)
+    {
+        w = p->o_send_peers[m];
+
+        for(k = 0; k < p->o_num_msgs_to_send[w]; ++k)
+        {
+            s = p->o_send_offsets[w][k];
+
+            emit_peer[emit_ptr[s]] = m;
+            emit_pos [emit_ptr[s]] = k;
+            emit_ptr[s] += 1;
+        }
+    }
+
+    /// Restore the row pointers
+    for(s = num_slots; s > 0; --s)
+        emit_ptr[s] = emit_ptr[s-1];
+    emit_ptr[0] = 0;
+    /// ----------------------------------------------------------------------
+
+    for(m = 0; m < p->o_num_send_peers; ++m)
+        send_req[m] = MPI_REQUEST_NULL;
+
+    emitting = true;
+}
+
@@ -82,6 +82,41 @@ public:
                    int* o_worker,
                    int* o_offsets);
 
+    /// See RuntimeImpl::create_plan(). Returns a Plan_MPI_Common
+    Plan* create_plan(int i_cnt,
+                      MPI_Datatype i_type,
+                      int i_num_vals,
+                      int i_max_worker_per_val,
+                      int* i_worker,
+                      int* i_offsets,
+                      int o_cnt,
+                      MPI_Datatype o_type,
+                      int o_num_vals,
+                      int o_max_worker_per_val,
+                      int* o_worker,
+                      int* o_offsets);
+
+    /// Plan-based pre_comm(): Only the payload is exchanged and the
+    /// receives are preposted since the counts are known
+    void pre_comm(Plan* plan, void* i_buf, void* o_buf);
+
+    /// Plan-based post_comm(): No offsets need to be send to the
+    /// workers
+    void post_comm(Plan* plan, void* i_buf, void* o_buf);
+
+    /// Send the output messages completely contained in the range to the
+    /// requesters as soon as all messages for a requester are final. Only
+    /// effective in plan-based executions
+    void emitted(int first, int count);
+
+    /// Split-phase plan-based post_comm(): post_comm_begin() gathers the
+    /// output on the workers and starts the non-blocking exchange.
+    /// post_comm_test() and post_comm_wait() scatter the data into o_buf once
+    /// it has arrived
+    void post_comm_begin(Plan* plan, void* i_buf, void* o_buf);
+    bool post_comm_test();
+    void post_comm_wait();
+
 
 private:    
     /// Number of messages to receive and send
@@ -103,13 +138,52 @@ private:
     /// post_comm routine
     int* offsets_send_buf;
 
-    /// Send and receive requests
+    /// Offsets of the messages received from one source which are passed
+    /// to Job::exec_partial()
+    int* stream_offsets;
+
+    /// Send and receive requests. One per peer, reallocated as needed
     MPI_Request* send_req;
     MPI_Request* recv_req;
+    int num_send_req;
+    int num_recv_req;
+
+    /// Resize the request arrays to n entries
+    void realloc_requests(MPI_Request** req, int n);
 
     /// Displacement vector (temporarily used)
     int* displs;
 
+    /// Scatter the received output into o_buf and clear the pending
+    /// post_comm
+    void post_comm_finish();
+
+    /// Plan of the running plan-based execution. Zero if the requesters
+    /// of the output are not known on the worker during the job
+    Plan_MPI_Common* active_plan;
+
+    /// True if the job emitted output during the running execution
+    bool emitting;
+    /// Number of messages per requester (index in o_send_peers) which have
+    /// not been emitted yet
+    int* emit_pending;
+    /// Requesters of each output message on the worker in compressed row
+    /// format: Entries emit_ptr[s] to emit_ptr[s+1]-1 of emit_peer and
+    /// emit_pos give the requester (index in o_send_peers) and the position
+    /// in o_send_offsets of the message at offset s
+    int* emit_ptr;
+    int* emit_peer;
+    int* emit_pos;
+    /// Whether the message at offset s has been emitted
+    char* emit_done;
+
+    /// Build the lookup tables for emitted() and start the execution
+    void emit_begin();
+
+    /// Reuse the routing of the previous call if the pattern did not
+    /// change (see RuntimeImpl_MPI_Common::update_cached_plan())
+    bool cache_plan;
+
 };
 
 }
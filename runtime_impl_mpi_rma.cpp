@@ -38,6 +38,7 @@
 #include <limits.h>
 
 #include "runtime_impl_mpi_rma.hpp"
+#include "runs.hpp"
 #include "job.hpp"
 #include "runtime.hpp"
 #include "memory.hpp"
@@ -54,14 +55,48 @@ mexico::RuntimeImpl_MPI_RMA::RuntimeImpl_MPI_RMA(Instance* ptr, const std::strin
 
     /// Read the hints
     MEXICO_READ_HINT(hints, "coalesce", coalesce);
+    MEXICO_READ_HINT(hints, "indexed", indexed);
+    MEXICO_READ_HINT(hints, "sort", sort);
+    MEXICO_READ_HINT(hints, "shm", shm);
+    MEXICO_READ_HINT(hints, "passive", passive);
+    MEXICO_READ_HINT(hints, "pscw", pscw);
+    MEXICO_READ_HINT(hints, "pull", pull);
+    MEXICO_READ_HINT(hints, "steal", steal);
+
+    if((shm or pscw) and passive)
+        MEXICO_FATAL("The passive hint cannot be combined with shm or pscw.");
+    if(shm and pscw)
+        MEXICO_FATAL("The shm and pscw hints cannot be combined.");
+    if(pull and steal)
+        MEXICO_FATAL("The pull and steal hints cannot be combined.");
+
+    i_runs = (sort) ? new Runs(instance) : 0;
+    o_runs = (sort) ? new Runs(instance) : 0;
+
+    /// The values of a source can be processed once they arrived
+    supports_streaming = pull;
+
+    i_access_group   = MPI_GROUP_EMPTY;
+    i_exposure_group = MPI_GROUP_EMPTY;
+    o_access_group   = MPI_GROUP_EMPTY;
+    o_exposure_group = MPI_GROUP_EMPTY;
+
+    sync_plan        = 0;
+    i_clear_expected = 0;
+    o_done_expected  = 0;
+    num_calls        = 0;
 
     if(instance->pe_is_worker)
     {
         MPI_Type_extent(job->i_type, &job_i_extent);
         MPI_Type_extent(job->o_type, &job_o_extent);
 
-        i_buf = memory->mpi_alloc_mem(job->i_N*job_i_extent);
-        o_buf = memory->mpi_alloc_mem(job->o_N*job_o_extent);
+        /// With shm or passive the buffers are allocated below
+        if(not (shm or passive))
+        {
+            i_buf = memory->mpi_alloc_mem(job->i_N*job_i_extent);
+            o_buf = memory->mpi_alloc_mem(job->o_N*job_o_extent);
+        }
     }
     else
     {
@@ -80,36 +115,586 @@ mexico::RuntimeImpl_MPI_RMA::RuntimeImpl_MPI_RMA(Instance* ptr, const std::strin
 
     MEXICO_WRITE(Log::MEDIUM, "[i|o]_ndims = [ %d, %d ]", i_ndims, o_ndims);
     /// ----------------------------------------------------------------------
+
+    if(shm)
+        create_shm_windows(i_ndims, o_ndims);
     
     /// ----------------------------------------------------------------------
     /// Create the window
 
-    /* TODO Can use the no_lock info here */
+    if(passive)
+        create_passive_windows(i_ndims, o_ndims);
+    else
+    {
+        /* TODO Can use the no_lock info here */
+
+        comm->win_create(i_buf, i_ndims, 1, MPI_INFO_NULL, &i_win);
+        comm->win_create(o_buf, o_ndims, 1, MPI_INFO_NULL, &o_win);
+    }
+
+    if(passive or pull or steal)
+        create_sync_window();
 
-    comm->win_create(i_buf, i_ndims, 1, MPI_INFO_NULL, &i_win);
-    comm->win_create(o_buf, o_ndims, 1, MPI_INFO_NULL, &o_win);
+    if(steal)
+        create_steal_windows(i_ndims, o_ndims);
     /// ----------------------------------------------------------------------
 }
 
 mexico::RuntimeImpl_MPI_RMA::~RuntimeImpl_MPI_RMA()
 {
+    if(passive)
+    {
+        MPI_Win_unlock_all(i_win);
+        MPI_Win_unlock_all(o_win);
+    }
+
+    if(steal)
+    {
+        MPI_Win_unlock_all(steal_i_win);
+        MPI_Win_unlock_all(steal_o_win);
+        MPI_Win_free(&steal_i_win);
+        MPI_Win_free(&steal_o_win);
+
+        memory->free_char(&steal_i_buf);
+        memory->free_char(&steal_o_buf);
+    }
+
+    if(passive or pull or steal)
+    {
+        MPI_Win_unlock_all(sync_win);
+
+        /// Frees sync_buf
+        MPI_Win_free(&sync_win);
+    }
+
+    /// With passive this frees i_buf and o_buf
     MPI_Win_free(&i_win);
     MPI_Win_free(&o_win);
 
-    if(instance->pe_is_worker)
+    free_groups();
+
+    delete i_runs;
+    delete o_runs;
+
+    if(shm)
+    {
+        memory->free_ptr((void*** )&i_shm_base);
+        memory->free_ptr((void*** )&o_shm_base);
+
+        /// Frees i_buf and o_buf
+        MPI_Win_free(&i_shm_win);
+        MPI_Win_free(&o_shm_win);
+        MPI_Comm_free(&node_comm);
+    }
+    else
+    if(instance->pe_is_worker and not passive)
     {
         memory->mpi_free_mem(&i_buf);
         memory->mpi_free_mem(&o_buf);
     }
 }
 
+void mexico::RuntimeImpl_MPI_RMA::create_shm_windows(MPI_Aint i_size, MPI_Aint o_size)
+{
+    int r, node_rank, node_size, disp_unit;
+    int* members;
+    MPI_Aint size;
+    void *i_base, *o_base;
+
+    comm->split_type_shared(&node_comm);
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+
+    MPI_Win_allocate_shared(i_size, 1, MPI_INFO_NULL, node_comm, &i_base, &i_shm_win);
+    MPI_Win_allocate_shared(o_size, 1, MPI_INFO_NULL, node_comm, &o_base, &o_shm_win);
+
+    if(instance->pe_is_worker)
+    {
+        i_buf = i_base;
+        o_buf = o_base;
+    }
+
+    /// ----------------------------------------------------------------------
+    /// Look up the buffers of the processing elements on the node
+    members = memory->alloc_int(node_size);
+    MPI_Allgather(&comm->myrank, 1, MPI_INT, members, 1, MPI_INT, node_comm);
+
+    i_shm_base = (char** )memory->alloc_ptr(comm->nprocs);
+    o_shm_base = (char** )memory->alloc_ptr(comm->nprocs);
+    std::fill(i_shm_base, i_shm_base+comm->nprocs, (char* )0);
+    std::fill(o_shm_base, o_shm_base+comm->nprocs, (char* )0);
+
+    for(r = 0; r < node_size; ++r)
+    {
+        MPI_Win_shared_query(i_shm_win, r, &size, &disp_unit, &i_base);
+        if(size > 0)
+            i_shm_base[members[r]] = (char* )i_base;
+
+        MPI_Win_shared_query(o_shm_win, r, &size, &disp_unit, &o_base);
+        if(size > 0)
+            o_shm_base[members[r]] = (char* )o_base;
+    }
+
+    memory->free_int(&members);
+    /// ----------------------------------------------------------------------
+
+    MEXICO_WRITE(Log::DEBUG, "node_rank = %d, node_size = %d", node_rank, node_size);
+}
+
+void mexico::RuntimeImpl_MPI_RMA::create_passive_windows(MPI_Aint i_size, MPI_Aint o_size)
+{
+    MPI_Info info;
+    void *i_base, *o_base;
+
+    /// The data windows are only accessed with MPI_Put and MPI_Get and
+    /// all processing elements use the same displacement unit
+    MPI_Info_create(&info);
+    MPI_Info_set(info, (char* )"accumulate_ops", (char* )"same_op_no_op");
+    MPI_Info_set(info, (char* )"accumulate_ordering", (char* )"none");
+    MPI_Info_set(info, (char* )"same_disp_unit", (char* )"true");
+
+    comm->win_allocate(i_size, 1, info, &i_base, &i_win);
+    comm->win_allocate(o_size, 1, info, &o_base, &o_win);
+
+    MPI_Info_free(&info);
+
+    if(instance->pe_is_worker)
+    {
+        i_buf = i_base;
+        o_buf = o_base;
+    }
+
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, i_win);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, o_win);
+}
+
+void mexico::RuntimeImpl_MPI_RMA::create_sync_window()
+{
+    comm->win_allocate(SYNC_NUM*sizeof(int), sizeof(int), MPI_INFO_NULL, &sync_buf, &sync_win);
+    std::fill(sync_buf, sync_buf+SYNC_NUM, 0);
+
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, sync_win);
+
+    /// Make sure nobody increments a counter before it is initialized
+    MPI_Win_sync(sync_win);
+    comm->barrier();
+}
+
+void mexico::RuntimeImpl_MPI_RMA::create_steal_windows(MPI_Aint i_size, MPI_Aint o_size)
+{
+    int i, geom[6];
+
+    /// The thieves compute the chunks of the owner from their own job
+    geom[0] = geom[1] = geom[2] = INT_MIN;
+    geom[3] = geom[4] = geom[5] = INT_MIN;
+
+    if(instance->pe_is_worker)
+    {
+        geom[0] =  job->i_N;
+        geom[1] =  job->o_N;
+        geom[2] =  job->num_chunks;
+        geom[3] = -job->i_N;
+        geom[4] = -job->o_N;
+        geom[5] = -job->num_chunks;
+    }
+
+    comm->allreduce(MPI_IN_PLACE, geom, 6, MPI_INT, MPI_MAX);
+
+    if(geom[0] != -geom[3] or geom[1] != -geom[4] or geom[2] != -geom[5])
+        MEXICO_FATAL("The steal hint requires the same i_N, o_N and num_chunks on all workers.");
+    if(geom[2] > 0 and (0 != geom[0]%geom[2] or 0 != geom[1]%geom[2]))
+        MEXICO_FATAL("The number of chunks must divide i_N and o_N.");
+
+    steal_i_buf = 0;
+    steal_o_buf = 0;
+    steal_index = -1;
+    steal_calls = 0;
+
+    if(instance->pe_is_worker and job->num_chunks > 0)
+    {
+        steal_i_buf = memory->alloc_char(i_size/job->num_chunks);
+        steal_o_buf = memory->alloc_char(o_size/job->num_chunks);
+    }
+
+    for(i = 0; i < instance->num_worker; ++i)
+        if(comm->myrank == instance->worker[i])
+            steal_index = i;
+
+    comm->win_create(i_buf, i_size, 1, MPI_INFO_NULL, &steal_i_win);
+    comm->win_create(o_buf, o_size, 1, MPI_INFO_NULL, &steal_o_win);
+
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, steal_i_win);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, steal_o_win);
+}
+
+int mexico::RuntimeImpl_MPI_RMA::claim_chunk(int w)
+{
+    int zero = 0, claimed, limit, next, prev;
+
+    MPI_Fetch_and_op(&zero, &limit, MPI_INT, w, SYNC_LIMIT, MPI_NO_OP, sync_win);
+    MPI_Fetch_and_op(&zero, &claimed, MPI_INT, w, SYNC_CLAIMED, MPI_NO_OP, sync_win);
+    MPI_Win_flush(w, sync_win);
+
+    /// The limit only grows so an outdated value is safe
+    while(claimed < limit)
+    {
+        next = claimed + 1;
+        MPI_Compare_and_swap(&next, &claimed, &prev, MPI_INT, w, SYNC_CLAIMED, sync_win);
+        MPI_Win_flush(w, sync_win);
+
+        if(prev == claimed)
+            return claimed;
+
+        claimed = prev;
+    }
+
+    return -1;
+}
+
+void mexico::RuntimeImpl_MPI_RMA::steal_chunks()
+{
+    int m, w, c, k, zero = 0, one = 1, done;
+    MPI_Aint i_size, o_size;
+
+    k      = job->num_chunks;
+    i_size = (job->i_N/k)*job_i_extent;
+    o_size = (job->o_N/k)*job_o_extent;
+
+    /// Open our chunks for this call. The input must be visible to the
+    /// gets of the thieves
+    MPI_Win_sync(steal_i_win);
+    MPI_Accumulate(&k, 1, MPI_INT, comm->myrank, SYNC_LIMIT, 1, MPI_INT, MPI_SUM, sync_win);
+    MPI_Win_flush(comm->myrank, sync_win);
+
+    /// Process our own chunks first and then visit the other workers,
+    /// starting with the next one in the list. Since all chunks of a call
+    /// are claimed before the next call opens its chunks, c%k is the index
+    /// of the chunk
+    for(m = 0; m < instance->num_worker; ++m)
+    {
+        w = instance->worker[(steal_index + m)%instance->num_worker];
+
+        while(-1 != (c = claim_chunk(w)))
+        {
+            if(w == comm->myrank)
+                job->exec_chunk((char* )i_buf + (c%k)*i_size, (char* )o_buf + (c%k)*o_size, c%k);
+            else
+            {
+                MPI_Get(steal_i_buf, i_size, MPI_BYTE, w, (c%k)*i_size, i_size, MPI_BYTE, steal_i_win);
+                MPI_Win_flush(w, steal_i_win);
+
+                job->exec_chunk(steal_i_buf, steal_o_buf, c%k);
+
+                MPI_Put(steal_o_buf, o_size, MPI_BYTE, w, (c%k)*o_size, o_size, MPI_BYTE, steal_o_win);
+                MPI_Win_flush(w, steal_o_win);
+            }
+
+            MPI_Accumulate(&one, 1, MPI_INT, w, SYNC_DONE, 1, MPI_INT, MPI_SUM, sync_win);
+            MPI_Win_flush(w, sync_win);
+        }
+    }
+
+    /// Wait until the thieves have written back the output of our chunks
+    ++steal_calls;
+
+    do
+    {
+        MPI_Fetch_and_op(&zero, &done, MPI_INT, comm->myrank, SYNC_DONE, MPI_NO_OP, sync_win);
+        MPI_Win_flush(comm->myrank, sync_win);
+    }
+    while(done < steal_calls*k);
+
+    MPI_Win_sync(steal_o_win);
+}
+
+void mexico::RuntimeImpl_MPI_RMA::exec_job()
+{
+    if(steal and instance->pe_is_worker and job->num_chunks > 0)
+        steal_chunks();
+    else
+        RuntimeImpl::exec_job();
+}
+
+mexico::Plan_MPI_Common* mexico::RuntimeImpl_MPI_RMA::create_cached_plan(Plan_MPI_Common* prev,
+                                                                          int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                                          int* i_worker, int* i_offsets,
+                                                                          int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                                          int* o_worker, int* o_offsets)
+{
+    Plan_MPI_Common* plan;
+
+    if(indexed or pull)
+        plan = new Plan_MPI_RMA(instance, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                                o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets, indexed, pull);
+    else
+        plan = RuntimeImpl_MPI_Common::create_cached_plan(prev, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                                                          o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets);
+
+    if(pscw)
+    {
+        free_groups();
+
+        comm->group_incl(plan->i_num_send_peers, plan->i_send_peers, &i_access_group);
+        comm->group_incl(plan->i_num_recv_peers, plan->i_recv_peers, &i_exposure_group);
+        comm->group_incl(plan->o_num_recv_peers, plan->o_recv_peers, &o_access_group);
+        comm->group_incl(plan->o_num_send_peers, plan->o_send_peers, &o_exposure_group);
+    }
+
+    return plan;
+}
+
+void mexico::RuntimeImpl_MPI_RMA::free_groups()
+{
+    /// MPI_GROUP_EMPTY is predefined and must not be freed
+    if(MPI_GROUP_EMPTY != i_access_group)
+        MPI_Group_free(&i_access_group);
+    if(MPI_GROUP_EMPTY != i_exposure_group)
+        MPI_Group_free(&i_exposure_group);
+    if(MPI_GROUP_EMPTY != o_access_group)
+        MPI_Group_free(&o_access_group);
+    if(MPI_GROUP_EMPTY != o_exposure_group)
+        MPI_Group_free(&o_exposure_group);
+
+    i_access_group   = MPI_GROUP_EMPTY;
+    i_exposure_group = MPI_GROUP_EMPTY;
+    o_access_group   = MPI_GROUP_EMPTY;
+    o_exposure_group = MPI_GROUP_EMPTY;
+}
+
+void mexico::RuntimeImpl_MPI_RMA::notify(int num, int* ranks, int counter)
+{
+    int m, one = 1;
+
+    for(m = 0; m < num; ++m)
+        MPI_Accumulate(&one, 1, MPI_INT, ranks[m], counter, 1, MPI_INT, MPI_SUM, sync_win);
+
+    MPI_Win_flush_all(sync_win);
+}
+
+void mexico::RuntimeImpl_MPI_RMA::wait_for(int counter, int num)
+{
+    int val, zero = 0;
+
+    if(0 == num)
+        return;
+
+    /// Use atomic reads since the peers update the counter concurrently
+    do
+    {
+        MPI_Fetch_and_op(&zero, &val, MPI_INT, comm->myrank, counter, MPI_NO_OP, sync_win);
+        MPI_Win_flush(comm->myrank, sync_win);
+    }
+    while(val < num);
+
+    /// Notifications for the next call may already have arrived so we
+    /// cannot reset the counter to zero
+    val = -num;
+    MPI_Accumulate(&val, 1, MPI_INT, comm->myrank, counter, 1, MPI_INT, MPI_SUM, sync_win);
+    MPI_Win_flush(comm->myrank, sync_win);
+}
+
+void mexico::RuntimeImpl_MPI_RMA::pull_inputs(Plan_MPI_RMA* p, void* i_buf, int i_cnt, MPI_Aint i_extent)
+{
+    int j, k, m, n, w, zero = 0, one = 1;
+    int *pending, *packed;
+    MPI_Aint size = i_cnt*i_extent;
+    char* buf;
+
+    /// ----------------------------------------------------------------------
+    /// Expose our values. The workers of the last call must be done with
+    /// the buffer
+    wait_for(SYNC_I_CLEAR, i_clear_expected);
+
+    for(m = 0; m < p->i_num_send_peers; ++m)
+    {
+        w   = p->i_send_peers[m];
+        buf = p->pull_buf + p->i_send_displs[w]*i_extent;
+
+        for(k = 0; k < p->i_num_msgs_to_send[w]; ++k)
+            std::copy(&((char* )i_buf)[p->i_send_idx[w][k]*size], &((char* )i_buf)[(p->i_send_idx[w][k] + 1)*size], buf + k*size);
+    }
+
+    MPI_Win_sync(p->pull_win);
+    MPI_Accumulate(&one, 1, MPI_INT, comm->myrank, SYNC_I_PACKED, 1, MPI_INT, MPI_SUM, sync_win);
+    MPI_Win_flush(comm->myrank, sync_win);
+
+    i_clear_expected = p->i_num_send_peers;
+    ++num_calls;
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Fetch the values from the sources which packed already. pending
+    /// holds the indices (into i_recv_peers) of the remaining sources
+    pending = memory->alloc_int(p->i_num_recv_peers);
+    packed  = memory->alloc_int(p->i_num_recv_peers);
+
+    for(m = 0; m < p->i_num_recv_peers; ++m)
+        pending[m] = m;
+
+    n = p->i_num_recv_peers;
+    while(n > 0)
+    {
+        for(k = 0; k < n; ++k)
+            MPI_Fetch_and_op(&zero, &packed[k], MPI_INT, p->i_recv_peers[pending[k]], SYNC_I_PACKED, MPI_NO_OP, sync_win);
+
+        MPI_Win_flush_all(sync_win);
+
+        for(k = 0; k < n; ++k)
+            if(packed[k] >= num_calls)
+                get(this->i_buf, p->pull_origin_types[pending[k]], p->i_recv_peers[pending[k]],
+                    p->pull_target_types[pending[k]], p->pull_cnts[pending[k]], p->pull_win);
+
+        for(k = 0, j = 0; k < n; ++k)
+        {
+            if(packed[k] < num_calls)
+            {
+                pending[j++] = pending[k];
+                continue;
+            }
+
+            w = p->i_recv_peers[pending[k]];
+
+            MPI_Win_flush(w, p->pull_win);
+            stream(i_cnt, p->i_num_msgs_to_recv[w], p->i_recv_offsets[w]);
+        }
+
+        n = j;
+    }
+
+    memory->free_int(&packed);
+    memory->free_int(&pending);
+
+    /// The sources may overwrite their buffers again
+    notify(p->i_num_recv_peers, p->i_recv_peers, SYNC_I_CLEAR);
+
+    /// See i_sync_end()
+    if(passive)
+        wait_for(SYNC_O_DONE, o_done_expected);
+    /// ----------------------------------------------------------------------
+}
+
+void mexico::RuntimeImpl_MPI_RMA::i_sync_begin()
+{
+    /// Synchronized in pull_inputs()
+    if(pull)
+        return;
+
+    if(passive)
+    {
+        /// Our workers from the last call must be done with their i_buf
+        wait_for(SYNC_I_CLEAR, i_clear_expected);
+        return;
+    }
+
+    if(pscw)
+    {
+        /// Expose our i_buf to the sources first since MPI_Win_start
+        /// may block until the targets posted
+        MPI_Win_post(i_exposure_group, 0, i_win);
+        MPI_Win_start(i_access_group, 0, i_win);
+        return;
+    }
+
+    MPI_Win_fence(0, i_win);
+    if(shm)
+        MPI_Win_fence(0, i_shm_win);
+}
+
+void mexico::RuntimeImpl_MPI_RMA::i_sync_end()
+{
+    if(pull)
+        return;
+
+    if(passive)
+    {
+        /// Complete the puts at the targets before notifying them
+        MPI_Win_flush_all(i_win);
+        notify(sync_plan->i_num_send_peers, sync_plan->i_send_peers, SYNC_I_ARRIVED);
+
+        /// As a worker we need the input from all sources and the
+        /// requesters from the last call must be done with our o_buf
+        /// before the job overwrites it
+        wait_for(SYNC_I_ARRIVED, sync_plan->i_num_recv_peers);
+        wait_for(SYNC_O_DONE, o_done_expected);
+        MPI_Win_sync(i_win);
+
+        i_clear_expected = sync_plan->i_num_send_peers;
+        return;
+    }
+
+    if(pscw)
+    {
+        /// As a worker we only wait for our own sources
+        MPI_Win_complete(i_win);
+        MPI_Win_wait(i_win);
+        return;
+    }
+
+    MPI_Win_fence(0, i_win);
+    if(shm)
+        MPI_Win_fence(0, i_shm_win);
+}
+
+void mexico::RuntimeImpl_MPI_RMA::o_sync_begin()
+{
+    if(passive)
+    {
+        /// The job is done: Release the i_buf to the sources and the
+        /// o_buf to the requesters
+        MPI_Win_sync(o_win);
+        if(not pull)
+            notify(sync_plan->i_num_recv_peers, sync_plan->i_recv_peers, SYNC_I_CLEAR);
+        notify(sync_plan->o_num_send_peers, sync_plan->o_send_peers, SYNC_O_READY);
+
+        wait_for(SYNC_O_READY, sync_plan->o_num_recv_peers);
+        return;
+    }
+
+    if(pscw)
+    {
+        MPI_Win_post(o_exposure_group, 0, o_win);
+        MPI_Win_start(o_access_group, 0, o_win);
+        return;
+    }
+
+    MPI_Win_fence(0, o_win);
+    if(shm)
+        MPI_Win_fence(0, o_shm_win);
+}
+
+void mexico::RuntimeImpl_MPI_RMA::o_sync_end()
+{
+    if(passive)
+    {
+        /// The gets only need to complete locally. The workers wait for
+        /// the notifications before the next execution of the job
+        MPI_Win_flush_local_all(o_win);
+        notify(sync_plan->o_num_recv_peers, sync_plan->o_recv_peers, SYNC_O_DONE);
+
+        o_done_expected = sync_plan->o_num_send_peers;
+        return;
+    }
+
+    if(pscw)
+    {
+        MPI_Win_complete(o_win);
+        MPI_Win_wait(o_win);
+        return;
+    }
+
+    MPI_Win_fence(0, o_win);
+    if(shm)
+        MPI_Win_fence(0, o_shm_win);
+}
+
 void mexico::RuntimeImpl_MPI_RMA::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
                                        int* i_worker, int* i_offsets,
                                        void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
                                        int* o_worker, int* o_offsets)
 {
-    int i, j, w, w0, lo, lo0, i0, nv;
+    int i, j, m, r, w, w0, lo, lo0, i0, nv;
     MPI_Aint i_extent;
+    Plan_MPI_RMA* p;
 
     /// Declared in RuntimeImpl_MPI_Common
     put_min_cnt = INT_MAX;
@@ -121,8 +706,34 @@ void mexico::RuntimeImpl_MPI_RMA::pre_comm(void* i_buf, int i_cnt, MPI_Datatype
     /// Exchange the data
     MPI_Type_extent(i_type, &i_extent);
 
-    MPI_Win_fence(0, i_win);
+    /// The plan is only rebuilt (collectively) if the pattern changes
+    if(passive or pscw or indexed or pull)
+        sync_plan = update_cached_plan(i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                                       o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets);
+
+    i_sync_begin();
+
+    if(pull)
+        pull_inputs((Plan_MPI_RMA* )sync_plan, i_buf, i_cnt, i_extent);
+    else
+    if(indexed)
+    {
+        p = (Plan_MPI_RMA* )sync_plan;
+
+        for(m = 0; m < p->i_num_send_peers; ++m)
+            put(i_buf, p->i_origin_types[m], p->i_send_peers[m], p->i_target_types[m], p->i_type_cnts[m], i_win);
+    }
+    else
+    if(sort)
+    {
+        i_runs->build(i_num_vals, i_max_worker_per_val, i_worker, i_offsets, false);
+        i_runs->gather(i_buf, i_cnt*i_extent);
 
+        for(r = 0; r < i_runs->num_runs; ++r)
+            put_or_copy(i_runs->staging + i_runs->run_first[r]*i_cnt*i_extent, i_cnt*i_runs->run_len[r], i_type, i_extent,
+                        i_runs->run_worker[r], i_cnt*i_runs->run_offset[r]*i_extent);
+    }
+    else
     if(not coalesce)
     {
         for(j = 0; j < i_max_worker_per_val; ++j)
@@ -131,7 +742,7 @@ void mexico::RuntimeImpl_MPI_RMA::pre_comm(void* i_buf, int i_cnt, MPI_Datatype
                 if(-1 == (w = i_worker[i + i_num_vals*j]))
                     continue;
 
-                put(&((char* )i_buf)[i*i_cnt*i_extent], i_cnt, i_type, w, i_cnt*i_offsets[i + i_num_vals*j]*i_extent, i_win);
+                put_or_copy(&((char* )i_buf)[i*i_cnt*i_extent], i_cnt, i_type, i_extent, w, i_cnt*i_offsets[i + i_num_vals*j]*i_extent);
             }
     }
     else
@@ -172,7 +783,7 @@ void mexico::RuntimeImpl_MPI_RMA::pre_comm(void* i_buf, int i_cnt, MPI_Datatype
 
                 /// The item does not match the bucket so we send the
                 /// current bucket
-                put(&((char* )i_buf)[i0*i_cnt*i_extent], i_cnt*nv, i_type, w0, lo0*i_extent, i_win);
+                put_or_copy(&((char* )i_buf)[i0*i_cnt*i_extent], i_cnt*nv, i_type, i_extent, w0, lo0*i_extent);
 
                 /// Our bucket is empty
                 lo0 = lo;
@@ -183,11 +794,11 @@ void mexico::RuntimeImpl_MPI_RMA::pre_comm(void* i_buf, int i_cnt, MPI_Datatype
 
             /// Make sure the bucket is empty on start of the next iteration
             if(nv > 0)
-                put(&((char* )i_buf)[i0*i_cnt*i_extent], i_cnt*nv, i_type, w0, lo0*i_extent, i_win);
+                put_or_copy(&((char* )i_buf)[i0*i_cnt*i_extent], i_cnt*nv, i_type, i_extent, w0, lo0*i_extent);
         }
     }
 
-    MPI_Win_fence(0, i_win);
+    i_sync_end();
     /// ----------------------------------------------------------------------
 
     /// Compute the average
@@ -201,8 +812,9 @@ void mexico::RuntimeImpl_MPI_RMA::post_comm(void* i_buf, int i_cnt, MPI_Datatype
                                         void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
                                         int* o_worker, int* o_offsets)
 {
-    int i, j, w, w0, lo, lo0, i0, nv;
+    int i, j, m, r, w, w0, lo, lo0, i0, nv;
     MPI_Aint o_extent;
+    Plan_MPI_RMA* p;
     
     MPI_Type_extent(o_type, &o_extent);
 
@@ -214,8 +826,26 @@ void mexico::RuntimeImpl_MPI_RMA::post_comm(void* i_buf, int i_cnt, MPI_Datatype
 
     /// ----------------------------------------------------------------------
     /// Exchange the data
-    MPI_Win_fence(0, o_win);
+    o_sync_begin();
+
+    if(indexed)
+    {
+        p = (Plan_MPI_RMA* )sync_plan;
+
+        for(m = 0; m < p->o_num_recv_peers; ++m)
+            get(o_buf, p->o_origin_types[m], p->o_recv_peers[m], p->o_target_types[m], p->o_type_cnts[m], o_win);
+    }
+    else
+    if(sort)
+    {
+        o_runs->build(o_num_vals, o_max_worker_per_val, o_worker, o_offsets, true);
+        o_runs->alloc_staging(o_cnt*o_extent);
 
+        for(r = 0; r < o_runs->num_runs; ++r)
+            get_or_copy(o_runs->staging + o_runs->run_first[r]*o_cnt*o_extent, o_cnt*o_runs->run_len[r], o_type, o_extent,
+                        o_runs->run_worker[r], o_cnt*o_runs->run_offset[r]*o_extent);
+    }
+    else
     if(not coalesce)
     {
         for(j = 0; j < o_max_worker_per_val; ++j)
@@ -224,7 +854,7 @@ void mexico::RuntimeImpl_MPI_RMA::post_comm(void* i_buf, int i_cnt, MPI_Datatype
                 if(-1 == (w = o_worker[i + o_num_vals*j]))
                     continue;
 
-                get(&((char* )o_buf)[o_cnt*o_extent*(i + o_num_vals*j)], o_cnt, o_type, w, o_cnt*o_offsets[i + o_num_vals*j]*o_extent, o_win);
+                get_or_copy(&((char* )o_buf)[o_cnt*o_extent*(i + o_num_vals*j)], o_cnt, o_type, o_extent, w, o_cnt*o_offsets[i + o_num_vals*j]*o_extent);
             }
     }
     else
@@ -265,7 +895,7 @@ void mexico::RuntimeImpl_MPI_RMA::post_comm(void* i_buf, int i_cnt, MPI_Datatype
 
                 /// The item does not match the bucket so we send the
                 /// current bucket
-                get(&((char* )o_buf)[o_cnt*o_extent*(i0 + o_num_vals*j)], o_cnt*nv, o_type, w0, lo0*o_extent, o_win);
+                get_or_copy(&((char* )o_buf)[o_cnt*o_extent*(i0 + o_num_vals*j)], o_cnt*nv, o_type, o_extent, w0, lo0*o_extent);
 
                 /// Our bucket is empty
                 lo0 = lo;
@@ -276,11 +906,15 @@ void mexico::RuntimeImpl_MPI_RMA::post_comm(void* i_buf, int i_cnt, MPI_Datatype
 
             /// Make sure the bucket is empty on start of the next iteration
             if(nv > 0)
-                get(&((char* )o_buf)[o_cnt*o_extent*(i0 + o_num_vals*j)], o_cnt*nv, o_type, w0, lo0*o_extent, o_win);
+                get_or_copy(&((char* )o_buf)[o_cnt*o_extent*(i0 + o_num_vals*j)], o_cnt*nv, o_type, o_extent, w0, lo0*o_extent);
         }
     }
 
-    MPI_Win_fence(0, o_win);
+    o_sync_end();
+
+    /// The gets completed so we can move the values to their place
+    if(sort)
+        o_runs->scatter(o_buf, o_cnt*o_extent);
     /// ----------------------------------------------------------------------
 
     /// Compute the average
@@ -289,3 +923,173 @@ void mexico::RuntimeImpl_MPI_RMA::post_comm(void* i_buf, int i_cnt, MPI_Datatype
     MEXICO_WRITE(Log::DEBUG, "get cnt stats: num = %d, min = %d, max = %d, avg = %.3f", get_num, get_min_cnt, get_max_cnt, get_avg_cnt);
 }
 
+mexico::Plan_MPI_RMA::Plan_MPI_RMA(Instance* ptr, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                   int* i_worker, int* i_offsets,
+                                   int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                   int* o_worker, int* o_offsets, bool indexed, bool pull)
+: Plan_MPI_Common(ptr, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                  o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets),
+  indexed(indexed), pull(pull)
+{
+    if(indexed)
+    {
+        create_types(i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets, false,
+                     i_num_send_peers, i_send_peers, &i_origin_types, &i_target_types, &i_type_cnts);
+        create_types(o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets, true,
+                     o_num_recv_peers, o_recv_peers, &o_origin_types, &o_target_types, &o_type_cnts);
+    }
+
+    if(pull)
+        create_pull_window();
+}
+
+mexico::Plan_MPI_RMA::~Plan_MPI_RMA()
+{
+    if(indexed)
+    {
+        free_types(i_num_send_peers, &i_origin_types, &i_target_types, &i_type_cnts);
+        free_types(o_num_recv_peers, &o_origin_types, &o_target_types, &o_type_cnts);
+    }
+
+    if(pull)
+    {
+        free_types(i_num_recv_peers, &pull_origin_types, &pull_target_types, &pull_cnts);
+
+        /// Frees pull_buf
+        MPI_Win_unlock_all(pull_win);
+        MPI_Win_free(&pull_win);
+    }
+}
+
+void mexico::Plan_MPI_RMA::create_pull_window()
+{
+    int k, m, n, w, disp;
+    int *src_displs, *displs;
+    MPI_Aint extent;
+
+    MPI_Type_extent(i_type, &extent);
+
+    comm->win_allocate(i_total_send*i_cnt*extent, 1, MPI_INFO_NULL, &pull_buf, &pull_win);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, pull_win);
+
+    /// Start of our values in the buffers of the sources
+    src_displs = memory->alloc_int(comm->nprocs);
+    comm->alltoall(i_send_displs, 1, MPI_INT, src_displs, 1, MPI_INT);
+
+    pull_origin_types = 0;
+    pull_target_types = 0;
+    memory->realloc_char((char** )&pull_origin_types, i_num_recv_peers*sizeof(MPI_Datatype));
+    memory->realloc_char((char** )&pull_target_types, i_num_recv_peers*sizeof(MPI_Datatype));
+    pull_cnts = memory->alloc_int(i_num_recv_peers);
+
+    displs = memory->alloc_int(i_total_recv);
+
+    for(m = 0; m < i_num_recv_peers; ++m)
+    {
+        w = i_recv_peers[m];
+        n = i_num_msgs_to_recv[w];
+
+        for(k = 0; k < n; ++k)
+            displs[k] = i_cnt*i_recv_offsets[w][k];
+
+        disp = src_displs[w];
+
+        MPI_Type_create_indexed_block(n, i_cnt, displs, i_type, &pull_origin_types[m]);
+        MPI_Type_create_indexed_block(1, n*i_cnt, &disp, i_type, &pull_target_types[m]);
+        MPI_Type_commit(&pull_origin_types[m]);
+        MPI_Type_commit(&pull_target_types[m]);
+
+        pull_cnts[m] = n*i_cnt;
+    }
+
+    memory->free_int(&displs);
+    memory->free_int(&src_displs);
+}
+
+void mexico::Plan_MPI_RMA::create_types(int cnt, MPI_Datatype type, int num_vals, int max_worker_per_val,
+                                        int* worker, int* offsets, bool per_column,
+                                        int num_peers, int* peers,
+                                        MPI_Datatype** origin_types, MPI_Datatype** target_types, int** type_cnts)
+{
+    int i, j, m, w;
+    int *pos, *first, *origin_displs, *target_displs;
+
+    *origin_types = 0;
+    *target_types = 0;
+    memory->realloc_char((char** )origin_types, num_peers*sizeof(MPI_Datatype));
+    memory->realloc_char((char** )target_types, num_peers*sizeof(MPI_Datatype));
+    *type_cnts = memory->alloc_int(num_peers);
+
+    /// ----------------------------------------------------------------------
+    /// Count the values per peer. pos maps a rank to its index in peers
+    pos   = memory->alloc_int(comm->nprocs);
+    first = memory->alloc_int(num_peers+1);
+
+    for(m = 0; m < num_peers; ++m)
+        pos[peers[m]] = m;
+
+    std::fill(first, first+num_peers+1, 0);
+
+    for(j = 0; j < max_worker_per_val; ++j)
+        for(i = 0; i < num_vals; ++i)
+            if(-1 != (w = worker[i + num_vals*j]))
+                ++first[pos[w]+1];
+
+    std::partial_sum(first, first+num_peers+1, first);
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Collect the displacements in units of type. first[m] is advanced
+    /// to the end of the list of peer m and restored afterwards
+    origin_displs = memory->alloc_int(first[num_peers]);
+    target_displs = memory->alloc_int(first[num_peers]);
+
+    for(j = 0; j < max_worker_per_val; ++j)
+        for(i = 0; i < num_vals; ++i)
+        {
+            if(-1 == (w = worker[i + num_vals*j]))
+                continue;
+
+            m = pos[w];
+
+            origin_displs[first[m]] = cnt*((per_column) ? i + num_vals*j : i);
+            target_displs[first[m]] = cnt*offsets[i + num_vals*j];
+            ++first[m];
+        }
+
+    for(m = num_peers; m > 0; --m)
+        first[m] = first[m-1];
+    first[0] = 0;
+    /// ----------------------------------------------------------------------
+
+    for(m = 0; m < num_peers; ++m)
+    {
+        MPI_Type_create_indexed_block(first[m+1] - first[m], cnt, origin_displs + first[m], type, &(*origin_types)[m]);
+        MPI_Type_create_indexed_block(first[m+1] - first[m], cnt, target_displs + first[m], type, &(*target_types)[m]);
+        MPI_Type_commit(&(*origin_types)[m]);
+        MPI_Type_commit(&(*target_types)[m]);
+
+        (*type_cnts)[m] = cnt*(first[m+1] - first[m]);
+    }
+
+    memory->free_int(&origin_displs);
+    memory->free_int(&target_displs);
+    memory->free_int(&first);
+    memory->free_int(&pos);
+}
+
+void mexico::Plan_MPI_RMA::free_types(int num_peers, MPI_Datatype** origin_types, MPI_Datatype** target_types, int** type_cnts)
+{
+    int m;
+
+    for(m = 0; m < num_peers; ++m)
+    {
+        MPI_Type_free(&(*origin_types)[m]);
+        MPI_Type_free(&(*target_types)[m]);
+    }
+
+    memory->free_char((char** )origin_types);
+    memory->free_char((char** )target_types);
+    memory->free_int(type_cnts);
+}
+
@@ -32,6 +32,7 @@
 #define MEXICO_RUNTIME_IMPL_MPI_RMA_HPP_INCLUDED 1
 
 #include <string>
+#include <algorithm>
 
 #include "pointers.hpp"
 #include "runtime_impl_mpi_common.hpp"
@@ -40,6 +41,9 @@
 namespace mexico
 {
 
+class Runs;
+class Plan_MPI_RMA;
+
 /// RuntimeImpl_MPI_RMA: Runtime implementation based on the RMA functionality
 ///                      in MPI-II
 class RuntimeImpl_MPI_RMA : public RuntimeImpl_MPI_Common
@@ -83,11 +87,295 @@ public:
                    int* o_worker,
                    int* o_offsets);
 
+    /// See RuntimeImpl::exec_job(). Distributes the chunks of the jobs
+    /// if steal is true
+    void exec_job();
+
+protected:
+    /// See RuntimeImpl_MPI_Common::create_cached_plan(). Rebuilds the
+    /// groups if pscw is true
+    Plan_MPI_Common* create_cached_plan(Plan_MPI_Common* prev,
+                                        int i_cnt,
+                                        MPI_Datatype i_type,
+                                        int i_num_vals,
+                                        int i_max_worker_per_val,
+                                        int* i_worker,
+                                        int* i_offsets,
+                                        int o_cnt,
+                                        MPI_Datatype o_type,
+                                        int o_num_vals,
+                                        int o_max_worker_per_val,
+                                        int* o_worker,
+                                        int* o_offsets);
+
 private:
     /// Input and output windows
     MPI_Win i_win, o_win;
     /// Whether or not to coalesce puts and gets
     bool coalesce;
+    /// Sort the entries by worker and remote offset, stage the values in
+    /// this order and move each run of consecutive offsets with a single
+    /// put or get (see Runs)
+    bool sort;
+    /// Sorted entries of the input and output matrices. Only allocated
+    /// if sort is true
+    Runs* i_runs;
+    Runs* o_runs;
+    /// Issue a single MPI_Put and MPI_Get per peer with indexed datatypes
+    /// which are cached in a Plan_MPI_RMA while the pattern is unchanged
+    bool indexed;
+    /// Allocate the worker buffers in shared memory windows on each node
+    /// and access workers on the same node with plain copies instead of
+    /// MPI_Put/MPI_Get
+    bool shm;
+
+    /// Communicator of the processing elements on the same node and
+    /// the shared memory windows. Only used if shm is true
+    MPI_Comm node_comm;
+    MPI_Win i_shm_win, o_shm_win;
+    /// Local addresses of the i_buf and o_buf of each processing element
+    /// in the communicator. Zero for processing elements on other nodes.
+    /// Only allocated if shm is true
+    char** i_shm_base;
+    char** o_shm_base;
+
+    /// Allocate the windows with MPI_Win_allocate and keep a passive
+    /// target epoch (MPI_Win_lock_all) open for the lifetime of the
+    /// runtime. Instead of MPI_Win_fence the processing elements only
+    /// synchronize with their peers through counters in sync_win
+    bool passive;
+
+    /// Counters in sync_win. Each counter is incremented by one by every
+    /// peer which notifies the processing element
+    enum
+    {
+        /// The puts of a source have completed at the worker
+        SYNC_I_ARRIVED = 0,
+        /// The worker is done with its i_buf and a source may put again
+        SYNC_I_CLEAR   = 1,
+        /// The o_buf of the worker is ready to be read
+        SYNC_O_READY   = 2,
+        /// The gets of a requester from the worker o_buf have completed
+        SYNC_O_DONE    = 3,
+        /// Number of calls for which a source packed its values. Only
+        /// used if pull is true
+        SYNC_I_PACKED  = 4,
+        /// Number of chunks of the worker which have been claimed. Only
+        /// used if steal is true
+        SYNC_CLAIMED   = 5,
+        /// Number of chunks of the worker which may be claimed
+        SYNC_LIMIT     = 6,
+        /// Number of chunks of the worker which have been processed
+        SYNC_DONE      = 7,
+        SYNC_NUM       = 8
+    };
+
+    /// Window with the counters. Only used if passive, pull or steal is
+    /// true
+    MPI_Win sync_win;
+    int* sync_buf;
+
+    /// Use generalized active target synchronization (MPI_Win_post,
+    /// MPI_Win_start, MPI_Win_complete and MPI_Win_wait) with groups that
+    /// only contain the actual peers instead of MPI_Win_fence
+    bool pscw;
+
+    /// Access groups (the workers we put to and get from) and exposure
+    /// groups (the sources and requesters of our i_buf and o_buf). Only
+    /// used if pscw is true
+    MPI_Group i_access_group, i_exposure_group;
+    MPI_Group o_access_group, o_exposure_group;
+
+    /// Let the workers fetch their input from the sources instead of
+    /// pushing it: Each source packs its values (in the order of the
+    /// plan) into a window and the workers get them with one MPI_Get per
+    /// source as soon as the source has packed. The values of a source can
+    /// be passed to Job::exec_partial() while the others are still being
+    /// fetched
+    bool pull;
+    /// Number of calls to pre_comm(). Only used if pull is true
+    int num_calls;
+
+    /// Let idle workers process chunks of other workers (see
+    /// Job::exec_chunk()): The chunks of each worker are claimed with
+    /// MPI_Compare_and_swap on counters in sync_win, by the worker itself
+    /// first and by other workers once they are done with their own
+    /// chunks. A thief gets the input of the chunk, processes it and puts
+    /// the output back into the o_buf of the owner
+    bool steal;
+    /// Windows of i_buf and o_buf which are only accessed by thieves.
+    /// They are kept in a passive target epoch. Only used if steal is
+    /// true
+    MPI_Win steal_i_win, steal_o_win;
+    /// Buffers for stolen chunks
+    char* steal_i_buf;
+    char* steal_o_buf;
+    /// Index of this processing element in the list of workers
+    int steal_index;
+    /// Number of calls to exec_job()
+    int steal_calls;
+
+    /// Claim a chunk of worker w. Returns the value of the SYNC_CLAIMED
+    /// counter of the chunk or -1 if all chunks which may be claimed are
+    /// gone
+    int claim_chunk(int w);
+
+    /// Process our chunks and steal chunks of the other workers
+    void steal_chunks();
+
+    /// Create the steal windows and check the chunks of the jobs. The
+    /// function is collective
+    void create_steal_windows(MPI_Aint i_size, MPI_Aint o_size);
+
+    /// Plan of the current communication pattern. The peers are needed
+    /// to know whom to notify and how many notifications to expect or
+    /// to build the groups. Only used if passive, pscw, indexed or pull is
+    /// true
+    Plan_MPI_Common* sync_plan;
+    /// Number of SYNC_I_CLEAR and SYNC_O_DONE notifications to wait for
+    /// which belong to the previous call
+    int i_clear_expected;
+    int o_done_expected;
+
+    /// Start and end the access to the i_win in pre_comm() and to the
+    /// o_win in post_comm()
+    void i_sync_begin();
+    void i_sync_end();
+    void o_sync_begin();
+    void o_sync_end();
+
+    /// Allocate the worker buffers with MPI_Win_allocate and open the
+    /// passive target epochs
+    void create_passive_windows(MPI_Aint i_size, MPI_Aint o_size);
+
+    /// Create the counter window and open the passive target epoch
+    void create_sync_window();
+
+    /// Expose our values to the workers and, on a worker, fetch the
+    /// values from the sources
+    void pull_inputs(Plan_MPI_RMA* p, void* i_buf, int i_cnt, MPI_Aint i_extent);
+
+    /// Free the access and exposure groups
+    void free_groups();
+
+    /// Increment the counter on the num processing elements in ranks
+    void notify(int num, int* ranks, int counter);
+
+    /// Wait until num notifications have arrived in the local counter
+    /// and consume them
+    void wait_for(int counter, int num);
+
+    /// Put cnt elements of type to the i_buf of worker rank or copy them
+    /// if the worker is on the same node
+    inline void put_or_copy(void* addr, int cnt, MPI_Datatype type, MPI_Aint extent, int rank, MPI_Aint disp)
+    {
+        if(shm and i_shm_base[rank])
+            std::copy((char* )addr, (char* )addr + cnt*extent, i_shm_base[rank] + disp);
+        else
+            put(addr, cnt, type, rank, disp, i_win);
+    }
+
+    /// Get cnt elements of type from the o_buf of worker rank or copy
+    /// them if the worker is on the same node
+    inline void get_or_copy(void* addr, int cnt, MPI_Datatype type, MPI_Aint extent, int rank, MPI_Aint disp)
+    {
+        if(shm and o_shm_base[rank])
+            std::copy(o_shm_base[rank] + disp, o_shm_base[rank] + disp + cnt*extent, (char* )addr);
+        else
+            get(addr, cnt, type, rank, disp, o_win);
+    }
+
+    /// Allocate the worker buffers in shared memory windows and look up
+    /// the addresses of the buffers of the other processing elements on
+    /// the node
+    void create_shm_windows(MPI_Aint i_size, MPI_Aint o_size);
+
+};
+
+/// Plan_MPI_RMA: Cached plan of the RMA runtime implementation if the
+///               indexed or the pull hint is given. For indexed it holds,
+///               for each peer, an origin and a target datatype (created
+///               with MPI_Type_create_indexed_block) which describe all
+///               values exchanged with the peer. For pull it holds the
+///               window with the packed values of the source and the
+///               datatypes to get them directly into the worker i_buf.
+class Plan_MPI_RMA : public Plan_MPI_Common
+{
+
+public:
+    /// Create the plan. The function is collective.
+    Plan_MPI_RMA(Instance* ptr,
+                 int i_cnt,
+                 MPI_Datatype i_type,
+                 int i_num_vals,
+                 int i_max_worker_per_val,
+                 int* i_worker,
+                 int* i_offsets,
+                 int o_cnt,
+                 MPI_Datatype o_type,
+                 int o_num_vals,
+                 int o_max_worker_per_val,
+                 int* o_worker,
+                 int* o_offsets,
+                 bool indexed,
+                 bool pull);
+
+    /// Destructor
+    ~Plan_MPI_RMA();
+
+    /// Datatypes for the put to i_send_peers[m]
+    MPI_Datatype* i_origin_types;
+    MPI_Datatype* i_target_types;
+    /// Number of elements of i_type described by the datatypes
+    int* i_type_cnts;
+
+    /// Datatypes for the get from o_recv_peers[m]
+    MPI_Datatype* o_origin_types;
+    MPI_Datatype* o_target_types;
+    /// Number of elements of o_type described by the datatypes
+    int* o_type_cnts;
+
+    /// Window with the values to send, packed by worker in the order of
+    /// i_send_idx at i_send_displs
+    MPI_Win pull_win;
+    char* pull_buf;
+    /// Datatypes for the get from i_recv_peers[m]. The origin datatype
+    /// scatters the values to their offsets in the worker i_buf
+    MPI_Datatype* pull_origin_types;
+    MPI_Datatype* pull_target_types;
+    /// Number of elements of i_type described by the datatypes
+    int* pull_cnts;
+
+private:
+    /// Whether the datatypes for indexed and the window for pull exist
+    bool indexed;
+    bool pull;
+
+    /// Create pull_win and the datatypes for the gets. The function is
+    /// collective
+    void create_pull_window();
+
+    /// Create the datatypes for the num_peers peers. The origin 
+    /// displacement of value i in column j is cnt*i, or cnt*(i + num_vals*j)
+    /// if per_column is true, the target displacement is cnt times the offset
+    void create_types(int cnt,
+                      MPI_Datatype type,
+                      int num_vals,
+                      int max_worker_per_val,
+                      int* worker,
+                      int* offsets,
+                      bool per_column,
+                      int num_peers,
+                      int* peers,
+                      MPI_Datatype** origin_types,
+                      MPI_Datatype** target_types,
+                      int** type_cnts);
+
+    /// Free the datatypes and the arrays
+    void free_types(int num_peers,
+                    MPI_Datatype** origin_types,
+                    MPI_Datatype** target_types,
+                    int** type_cnts);
 
 };
 
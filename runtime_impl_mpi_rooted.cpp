@@ -0,0 +1,490 @@
+
+/// vi: tabstop=4:expandtab
+
+/* Copyright 2010 University of Lugano. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the University of Lugano.
+ */
+
+#include "mexico_config.hpp"
+
+#include <stdlib.h>
+#ifdef MEXICO_HAVE_MPI_H
+#include <mpi.h>
+#endif
+#include <algorithm>
+
+#include "runtime_impl_mpi_rooted.hpp"
+#include "job.hpp"
+#include "runtime.hpp"
+#include "plan.hpp"
+#include "memory.hpp"
+#include "comm.hpp"
+#include "assert.hpp"
+#include "utils.hpp"
+#include "log.hpp"
+
+
+mexico::RuntimeImpl_MPI_Rooted::RuntimeImpl_MPI_Rooted(Instance* ptr, const std::string& hints)
+: RuntimeImpl_MPI_Common(ptr, hints)
+{
+    if(instance->pe_is_worker)
+    {
+        MPI_Type_extent(job->i_type, &job_i_extent);
+        MPI_Type_extent(job->o_type, &job_o_extent);
+
+        i_buf = memory->alloc_char(job->i_N*job_i_extent);
+        o_buf = memory->alloc_char(job->o_N*job_o_extent);
+    }
+    else
+    {
+        job_i_extent = 0;
+        job_o_extent = 0;
+
+        i_buf = 0;
+        o_buf = 0;
+    }
+
+    /// Allocated on demand
+    comm_send_buf = 0;
+    comm_recv_buf = 0;
+
+    req     = 0;
+    num_req = 0;
+}
+
+mexico::RuntimeImpl_MPI_Rooted::~RuntimeImpl_MPI_Rooted()
+{
+    memory->free_char((char** )&req);
+
+    memory->free_char(&comm_send_buf);
+    memory->free_char(&comm_recv_buf);
+
+    if(instance->pe_is_worker)
+    {
+        memory->free_char((char** )&i_buf);
+        memory->free_char((char** )&o_buf);
+    }
+}
+
+void mexico::RuntimeImpl_MPI_Rooted::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                              int* i_worker, int* i_offsets,
+                                              void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                              int* o_worker, int* o_offsets)
+{
+    pre_comm(update_cached_plan(i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                                o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets),
+             i_buf, o_buf);
+}
+
+void mexico::RuntimeImpl_MPI_Rooted::post_comm(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                               int* i_worker, int* i_offsets,
+                                               void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                               int* o_worker, int* o_offsets)
+{
+    /// The plan has been updated in pre_comm()
+    post_comm(cached_plan, i_buf, o_buf);
+}
+
+mexico::Plan* mexico::RuntimeImpl_MPI_Rooted::create_plan(int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                          int* i_worker, int* i_offsets,
+                                                          int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                          int* o_worker, int* o_offsets)
+{
+    return new Plan_MPI_Rooted(instance, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                               o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets);
+}
+
+mexico::Plan_MPI_Common* mexico::RuntimeImpl_MPI_Rooted::create_cached_plan(Plan_MPI_Common* prev,
+                                                                            int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                                                            int* i_worker, int* i_offsets,
+                                                                            int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                                                            int* o_worker, int* o_offsets)
+{
+    return new Plan_MPI_Rooted(instance, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                               o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets,
+                               static_cast<Plan_MPI_Rooted*>(prev));
+}
+
+void mexico::RuntimeImpl_MPI_Rooted::pre_comm(Plan* plan, void* i_buf, void* o_buf)
+{
+    Plan_MPI_Rooted* p = static_cast<Plan_MPI_Rooted*>(plan);
+    int k, m, w, i_cnt, cnt;
+    MPI_Aint i_extent;
+    MPI_Datatype recv_type;
+    long n;
+
+    i_cnt = p->i_cnt;
+    MPI_Type_extent(p->i_type, &i_extent);
+
+    /// No job pointer on non-worker processing elements. These are never
+    /// the root of a group
+    recv_type = (instance->pe_is_worker) ? job->i_type : p->i_type;
+
+    memory->realloc_char(&comm_send_buf, p->i_total_send*i_cnt*    i_extent);
+    memory->realloc_char(&comm_recv_buf, p->i_total_recv*i_cnt*job_i_extent);
+    memory->realloc_char((char** )&req, (p->i_num_send_peers + p->i_num_recv_peers + 1)*sizeof(MPI_Request));
+
+    num_req = 0;
+
+    /// ----------------------------------------------------------------------
+    /// Prepost the receives from processing elements outside of the group
+    for(m = 0; m < p->i_num_recv_peers; ++m)
+    {
+        w = p->i_recv_peers[m];
+        if(comm->myrank == p->home_of[w])
+            continue;
+
+        req[num_req++] = comm->irecv(comm_recv_buf + p->i_recv_displs[w]*job_i_extent, p->i_num_vals_to_recv[w], job->i_type, w, 0);
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Pack the data and send it to the workers outside of the group
+    n = 0;
+    for(m = 0; m < p->i_num_send_peers; ++m)
+    {
+        w = p->i_send_peers[m];
+
+        for(k = 0; k < p->i_num_msgs_to_send[w]; ++k, ++n)
+            std::copy(&((char* )i_buf)[i_cnt*i_extent*p->i_send_idx[w][k]],
+                      &((char* )i_buf)[i_cnt*i_extent*p->i_send_idx[w][k]]+i_cnt*i_extent,
+                      &comm_send_buf[n*i_cnt*i_extent]);
+
+        if(w != p->home)
+            req[num_req++] = comm->isend(comm_send_buf + p->i_send_displs[w]*i_extent, p->i_num_vals_to_send[w], p->i_type, w, 0);
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Gather the values within the group
+    if(MPI_COMM_NULL != p->group_comm)
+    {
+        cnt = p->i_num_vals_to_send[p->home];
+
+        MPI_Igatherv(comm_send_buf + p->i_send_displs[p->home]*i_extent, cnt, p->i_type,
+                     comm_recv_buf, p->gather_cnts, p->gather_displs, recv_type, 0, p->group_comm, &req[num_req++]);
+    }
+
+    MPI_Waitall(num_req, req, MPI_STATUSES_IGNORE);
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Reorder the data
+    for(m = 0; m < p->i_num_recv_peers; ++m)
+    {
+        w = p->i_recv_peers[m];
+
+        for(k = 0; k < p->i_num_msgs_to_recv[w]; ++k)
+        {
+            MEXICO_ASSERT(p->i_recv_offsets[w][k]*i_cnt < job->i_N);
+
+            /// Caution: Need to use the i_buf member variable here!
+            std::copy(&comm_recv_buf[(p->i_recv_displs[w] + k*i_cnt)*job_i_extent],
+                      &comm_recv_buf[(p->i_recv_displs[w] + k*i_cnt)*job_i_extent]+i_cnt*job_i_extent,
+                      &((char* )this->i_buf)[p->i_recv_offsets[w][k]*i_cnt*job_i_extent]);
+        }
+    }
+    /// ----------------------------------------------------------------------
+}
+
+void mexico::RuntimeImpl_MPI_Rooted::post_comm(Plan* plan, void* i_buf, void* o_buf)
+{
+    post_comm_begin(plan, i_buf, o_buf);
+    post_comm_wait();
+}
+
+void mexico::RuntimeImpl_MPI_Rooted::post_comm_begin(Plan* plan, void* i_buf, void* o_buf)
+{
+    Plan_MPI_Rooted* p = static_cast<Plan_MPI_Rooted*>(plan);
+    int k, m, w, o_cnt, cnt;
+    MPI_Aint o_extent;
+    MPI_Datatype send_type;
+
+    o_cnt = p->o_cnt;
+    MPI_Type_extent(p->o_type, &o_extent);
+
+    send_type = (instance->pe_is_worker) ? job->o_type : p->o_type;
+
+    memory->realloc_char(&comm_send_buf, p->o_total_send*o_cnt*job_o_extent);
+    memory->realloc_char(&comm_recv_buf, p->o_total_recv*o_cnt*    o_extent);
+    memory->realloc_char((char** )&req, (p->o_num_send_peers + p->o_num_recv_peers + 1)*sizeof(MPI_Request));
+
+    num_req = 0;
+
+    /// ----------------------------------------------------------------------
+    /// Prepost the receives from the workers outside of the group
+    for(m = 0; m < p->o_num_recv_peers; ++m)
+    {
+        w = p->o_recv_peers[m];
+        if(w == p->home)
+            continue;
+
+        req[num_req++] = comm->irecv(comm_recv_buf + p->o_recv_displs[w]*o_extent, p->o_num_vals_to_recv[w], p->o_type, w, 2);
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Gather the output data on the worker and send it to the requesters
+    /// outside of the group
+    for(m = 0; m < p->o_num_send_peers; ++m)
+    {
+        w = p->o_send_peers[m];
+
+        for(k = 0; k < p->o_num_msgs_to_send[w]; ++k)
+        {
+            MEXICO_ASSERT(p->o_send_offsets[w][k]*o_cnt < job->o_N);
+
+            /// Caution: Need to use the o_buf member variable here!
+            std::copy(&((char* )this->o_buf)[p->o_send_offsets[w][k]*o_cnt*job_o_extent],
+                      &((char* )this->o_buf)[p->o_send_offsets[w][k]*o_cnt*job_o_extent]+o_cnt*job_o_extent,
+                      &comm_send_buf[(p->o_send_displs[w] + k*o_cnt)*job_o_extent]);
+        }
+
+        if(comm->myrank != p->home_of[w])
+            req[num_req++] = comm->isend(comm_send_buf + p->o_send_displs[w]*job_o_extent, p->o_num_vals_to_send[w], job->o_type, w, 2);
+    }
+    /// ----------------------------------------------------------------------
+
+    /// ----------------------------------------------------------------------
+    /// Scatter the values within the group
+    if(MPI_COMM_NULL != p->group_comm)
+    {
+        cnt = p->o_num_vals_to_recv[p->home];
+
+        MPI_Iscatterv(comm_send_buf, p->scatter_cnts, p->scatter_displs, send_type,
+                      comm_recv_buf + p->o_recv_displs[p->home]*o_extent, cnt, p->o_type, 0, p->group_comm, &req[num_req++]);
+    }
+    /// ----------------------------------------------------------------------
+
+    pending_plan  = plan;
+    pending_i_buf = i_buf;
+    pending_o_buf = o_buf;
+}
+
+bool mexico::RuntimeImpl_MPI_Rooted::post_comm_test()
+{
+    int flag;
+
+    if(!pending_plan)
+        return true;
+
+    MPI_Testall(num_req, req, &flag, MPI_STATUSES_IGNORE);
+    if(!flag)
+        return false;
+
+    post_comm_finish();
+    return true;
+}
+
+void mexico::RuntimeImpl_MPI_Rooted::post_comm_wait()
+{
+    if(!pending_plan)
+        return;
+
+    MPI_Waitall(num_req, req, MPI_STATUSES_IGNORE);
+    post_comm_finish();
+}
+
+void mexico::RuntimeImpl_MPI_Rooted::post_comm_finish()
+{
+    Plan_MPI_Rooted* p = static_cast<Plan_MPI_Rooted*>(pending_plan);
+    int k, m, w, o_cnt;
+    MPI_Aint o_extent;
+
+    o_cnt = p->o_cnt;
+    MPI_Type_extent(p->o_type, &o_extent);
+
+    /// ----------------------------------------------------------------------
+    /// Reorder the data
+    for(m = 0; m < p->o_num_recv_peers; ++m)
+    {
+        w = p->o_recv_peers[m];
+
+        for(k = 0; k < p->o_num_msgs_to_recv[w]; ++k)
+            std::copy(&comm_recv_buf[(p->o_recv_displs[w] + k*o_cnt)*o_extent],
+                      &comm_recv_buf[(p->o_recv_displs[w] + k*o_cnt)*o_extent]+o_cnt*o_extent,
+                      &((char* )pending_o_buf)[o_cnt*o_extent*p->o_recv_idx[w][k]]);
+    }
+    /// ----------------------------------------------------------------------
+
+    pending_plan = 0;
+}
+
+mexico::Plan_MPI_Rooted::Plan_MPI_Rooted(Instance* ptr, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
+                                         int* i_worker, int* i_offsets,
+                                         int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
+                                         int* o_worker, int* o_offsets,
+                                         Plan_MPI_Rooted* prev)
+: Plan_MPI_Common(ptr, i_cnt, i_type, i_num_vals, i_max_worker_per_val, i_worker, i_offsets,
+                  o_cnt, o_type, o_num_vals, o_max_worker_per_val, o_worker, o_offsets),
+  group_comm(MPI_COMM_NULL), home(-1), home_of(0), group_size(0), group_ranks(0),
+  gather_cnts(0), gather_displs(0), scatter_cnts(0), scatter_displs(0)
+{
+    groups(prev);
+    compact();
+}
+
+mexico::Plan_MPI_Rooted::~Plan_MPI_Rooted()
+{
+    if(MPI_COMM_NULL != group_comm)
+        MPI_Comm_free(&group_comm);
+
+    memory->free_int(&home_of);
+    memory->free_int(&group_ranks);
+
+    memory->free_int(&gather_cnts);
+    memory->free_int(&gather_displs);
+    memory->free_int(&scatter_cnts);
+    memory->free_int(&scatter_displs);
+}
+
+void mexico::Plan_MPI_Rooted::update(int i_num_changed, int* i_idx, int* i_worker, int* i_offsets,
+                                     int o_num_changed, int* o_idx, int* o_worker, int* o_offsets)
+{
+    Plan_MPI_Common::update(i_num_changed, i_idx, i_worker, i_offsets,
+                            o_num_changed, o_idx, o_worker, o_offsets);
+
+    groups(this);
+    compact();
+}
+
+int mexico::Plan_MPI_Rooted::find_home() const
+{
+    int m, w, n, best, best_n;
+
+    if(instance->pe_is_worker)
+        return comm->myrank;
+
+    best   = -1;
+    best_n =  0;
+
+    /// Both lists only contain workers
+    for(m = 0; m < i_num_send_peers; ++m)
+    {
+        w = i_send_peers[m];
+        n = i_num_msgs_to_send[w] + o_num_msgs_to_recv[w];
+
+        if(n > best_n or (n == best_n and w < best))
+        {
+            best   = w;
+            best_n = n;
+        }
+    }
+
+    for(m = 0; m < o_num_recv_peers; ++m)
+    {
+        w = o_recv_peers[m];
+        n = i_num_msgs_to_send[w] + o_num_msgs_to_recv[w];
+
+        if(n > best_n or (n == best_n and w < best))
+        {
+            best   = w;
+            best_n = n;
+        }
+    }
+
+    return best;
+}
+
+void mexico::Plan_MPI_Rooted::groups(Plan_MPI_Rooted* prev)
+{
+    int r, g, h, changed, any_changed;
+
+    h = find_home();
+
+    if(prev and prev->home_of)
+        changed = (h != prev->home);
+    else
+        changed = 1;
+
+    comm->allreduce(&changed, &any_changed, 1, MPI_INT, MPI_MAX);
+
+    if(any_changed)
+    {
+        if(MPI_COMM_NULL != group_comm)
+            MPI_Comm_free(&group_comm);
+
+        home = h;
+
+        memory->realloc_int(&home_of, comm->nprocs);
+        comm->allgather(&home, 1, MPI_INT, home_of, 1, MPI_INT);
+
+        /// The worker is the root of its group
+        comm->split((home >= 0) ? home : MPI_UNDEFINED, (home == comm->myrank) ? 0 : comm->myrank + 1, &group_comm);
+    }
+    else
+    if(prev != this)
+    {
+        home        = prev->home;
+        home_of     = prev->home_of;
+        group_comm  = prev->group_comm;
+
+        prev->home_of    = 0;
+        prev->group_comm = MPI_COMM_NULL;
+    }
+
+    /// ----------------------------------------------------------------------
+    /// Members of the group in the order of group_comm
+    if(instance->pe_is_worker)
+    {
+        group_size = 0;
+        for(r = 0; r < comm->nprocs; ++r)
+            if(comm->myrank == home_of[r])
+                ++group_size;
+
+        memory->realloc_int(&group_ranks, group_size);
+
+        g = 0;
+        group_ranks[g++] = comm->myrank;
+        for(r = 0; r < comm->nprocs; ++r)
+            if(comm->myrank == home_of[r] and r != comm->myrank)
+                group_ranks[g++] = r;
+    }
+    /// ----------------------------------------------------------------------
+
+    MEXICO_WRITE(Log::DEBUG, "home = %d, group_size = %d, groups %s", home, group_size, (any_changed) ? "created" : "reused");
+}
+
+void mexico::Plan_MPI_Rooted::compact()
+{
+    int g, r;
+
+    memory->realloc_int(&gather_cnts   , group_size);
+    memory->realloc_int(&gather_displs , group_size);
+    memory->realloc_int(&scatter_cnts  , group_size);
+    memory->realloc_int(&scatter_displs, group_size);
+
+    for(g = 0; g < group_size; ++g)
+    {
+        r = group_ranks[g];
+
+        gather_cnts   [g] = i_num_vals_to_recv[r];
+        gather_displs [g] = i_recv_displs[r];
+        scatter_cnts  [g] = o_num_vals_to_send[r];
+        scatter_displs[g] = o_send_displs[r];
+    }
+}
+
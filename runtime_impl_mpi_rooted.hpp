@@ -0,0 +1,237 @@
+
+/// vi: tabstop=4:expandtab
+
+/* Copyright 2010 University of Lugano. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the University of Lugano.
+ */
+
+#ifndef MEXICO_RUNTIME_IMPL_MPI_ROOTED_HPP_INCLUDED
+#define MEXICO_RUNTIME_IMPL_MPI_ROOTED_HPP_INCLUDED 1
+
+#include <string>
+
+#include "pointers.hpp"
+#include "runtime_impl_mpi_common.hpp"
+
+
+namespace mexico
+{
+
+class Plan_MPI_Rooted;
+
+/// RuntimeImpl_MPI_Rooted: Runtime implementation based on rooted 
+///                         collectives. The communicator is split into one
+///                         group per worker. Every other processing element
+///                         joins the group of the worker it exchanges the
+///                         most messages with. Values within a group are
+///                         moved with MPI_Igatherv() (pre_comm) and 
+///                         MPI_Iscatterv() (post_comm) rooted at the
+///                         worker, which lets the MPI library use tree 
+///                         algorithms for the incast at the worker. Values
+///                         for workers outside of the group are send with 
+///                         point-to-point communication. The groups are 
+///                         stored in the plan and only recreated if the
+///                         assignment changes.
+class RuntimeImpl_MPI_Rooted : public RuntimeImpl_MPI_Common
+{
+
+public:
+    RuntimeImpl_MPI_Rooted(Instance* ptr, const std::string& hints);
+
+    /// Destructor
+    ~RuntimeImpl_MPI_Rooted();
+
+    /// See Runtime::pre_comm(). The routing is cached between calls
+    /// (see RuntimeImpl_MPI_Common::update_cached_plan())
+    void pre_comm(void* i_buf,
+                  int i_cnt,
+                  MPI_Datatype i_type,
+                  int i_num_vals,
+                  int i_max_worker_per_val,
+                  int* i_worker,
+                  int* i_offsets,
+                  void* o_buf,
+                  int o_cnt,
+                  MPI_Datatype o_type,
+                  int o_num_vals,
+                  int o_max_worker_per_val,
+                  int* o_worker,
+                  int* o_offsets);
+
+    /// See Runtime::post_comm()
+    void post_comm(void* i_buf,
+                   int i_cnt,
+                   MPI_Datatype i_type,
+                   int i_num_vals,
+                   int i_max_worker_per_val,
+                   int* i_worker,
+                   int* i_offsets,
+                   void* o_buf,
+                   int o_cnt,
+                   MPI_Datatype o_type,
+                   int o_num_vals,
+                   int o_max_worker_per_val,
+                   int* o_worker,
+                   int* o_offsets);
+
+    /// See RuntimeImpl::create_plan(). Returns a Plan_MPI_Rooted
+    Plan* create_plan(int i_cnt,
+                      MPI_Datatype i_type,
+                      int i_num_vals,
+                      int i_max_worker_per_val,
+                      int* i_worker,
+                      int* i_offsets,
+                      int o_cnt,
+                      MPI_Datatype o_type,
+                      int o_num_vals,
+                      int o_max_worker_per_val,
+                      int* o_worker,
+                      int* o_offsets);
+
+    /// Plan-based pre_comm(): Only the payload is exchanged
+    void pre_comm(Plan* plan, void* i_buf, void* o_buf);
+
+    /// Plan-based post_comm(): Only the payload is exchanged
+    void post_comm(Plan* plan, void* i_buf, void* o_buf);
+
+    /// Split-phase plan-based post_comm(). See
+    /// RuntimeImpl_MPI_Alltoall::post_comm_begin()
+    void post_comm_begin(Plan* plan, void* i_buf, void* o_buf);
+    bool post_comm_test();
+    void post_comm_wait();
+
+protected:
+    /// See RuntimeImpl_MPI_Common::create_cached_plan(). The groups of
+    /// prev are reused if the assignment did not change
+    Plan_MPI_Common* create_cached_plan(Plan_MPI_Common* prev,
+                                        int i_cnt,
+                                        MPI_Datatype i_type,
+                                        int i_num_vals,
+                                        int i_max_worker_per_val,
+                                        int* i_worker,
+                                        int* i_offsets,
+                                        int o_cnt,
+                                        MPI_Datatype o_type,
+                                        int o_num_vals,
+                                        int o_max_worker_per_val,
+                                        int* o_worker,
+                                        int* o_offsets);
+
+private:
+    /// Communication buffer
+    char* comm_send_buf;
+    char* comm_recv_buf;
+
+    /// Requests of the point-to-point messages and the rooted collective
+    MPI_Request* req;
+    int num_req;
+
+    /// Scatter the received output into o_buf and clear the pending
+    /// post_comm
+    void post_comm_finish();
+
+};
+
+/// Plan_MPI_Rooted: Plan_MPI_Common plus the group of the processing 
+///                  element and, on the workers, the counts and 
+///                  displacements for the rooted collectives. The root of
+///                  each group has rank zero in the group communicator.
+class Plan_MPI_Rooted : public Plan_MPI_Common
+{
+
+public:
+    /// Create the plan. If prev is not zero and the assignment of all
+    /// processing elements to the groups did not change the groups are 
+    /// taken over from prev. The function is collective.
+    Plan_MPI_Rooted(Instance* ptr,
+                    int i_cnt,
+                    MPI_Datatype i_type,
+                    int i_num_vals,
+                    int i_max_worker_per_val,
+                    int* i_worker,
+                    int* i_offsets,
+                    int o_cnt,
+                    MPI_Datatype o_type,
+                    int o_num_vals,
+                    int o_max_worker_per_val,
+                    int* o_worker,
+                    int* o_offsets,
+                    Plan_MPI_Rooted* prev = 0);
+
+    /// Destructor
+    ~Plan_MPI_Rooted();
+
+    /// See Plan_MPI_Common::update(). The groups are recreated if the
+    /// assignment changed on any rank
+    void update(int i_num_changed,
+                int* i_idx,
+                int* i_worker,
+                int* i_offsets,
+                int o_num_changed,
+                int* o_idx,
+                int* o_worker,
+                int* o_offsets);
+
+    /// Communicator of the group or MPI_COMM_NULL if the processing
+    /// element does not communicate with any worker
+    MPI_Comm group_comm;
+    /// Worker (root) of the group of the processing element or -1
+    int home;
+    /// Worker of the group of every processing element or -1
+    int* home_of;
+
+    /// Number of processing elements in the group and their ranks in
+    /// the communicator ordered by the rank in group_comm. Only set on 
+    /// workers
+    int group_size;
+    int* group_ranks;
+
+    /// Counts and displacements for MPI_Igatherv() and MPI_Iscatterv() on
+    /// the root of the group. The displacements point into the buffers
+    /// laid out by i_recv_displs and o_send_displs
+    int* gather_cnts;
+    int* gather_displs;
+    int* scatter_cnts;
+    int* scatter_displs;
+
+private:
+    /// Worker which this processing element exchanges the most messages
+    /// with. Workers are always their own home
+    int find_home() const;
+
+    /// Create the groups or take them over from prev. The function is
+    /// collective
+    void groups(Plan_MPI_Rooted* prev);
+
+    /// Fill the counts and displacements of the collectives
+    void compact();
+
+};
+
+}
+
+#endif
+
@@ -38,8 +38,10 @@
 #include <mpp/shmem.h>
 #endif
 #include <numeric>
+#include <algorithm>
 
 #include "runtime_impl_shmem.hpp"
+#include "runs.hpp"
 #include "job.hpp"
 #include "runtime.hpp"
 #include "memory.hpp"
@@ -57,6 +59,17 @@ mexico::RuntimeImpl_SHMEM::RuntimeImpl_SHMEM(Instance* ptr, const std::string& h
 
     /// Read the hints
     MEXICO_READ_HINT(hints, "coalesce", coalesce);
+    MEXICO_READ_HINT(hints, "sort", sort);
+    MEXICO_READ_HINT(hints, "signal", signal);
+    MEXICO_READ_HINT(hints, "striped", striped);
+
+    if(signal and striped)
+        MEXICO_FATAL("The signal and striped hints cannot be combined.");
+
+    i_runs = (sort) ? new Runs(instance) : 0;
+    o_runs = (sort) ? new Runs(instance) : 0;
+
+    create_active_set();
 
     if(instance->pe_is_worker)
     {
@@ -75,38 +88,368 @@ mexico::RuntimeImpl_SHMEM::RuntimeImpl_SHMEM(Instance* ptr, const std::string& h
         o_size = 0;
     }
 
-    /// We need to make sure that all processing elements call
-    /// shmalloc with 
-    comm->allreduce(MPI_IN_PLACE, &i_size, 1, MPI_LONG, MPI_MAX);
-    comm->allreduce(MPI_IN_PLACE, &o_size, 1, MPI_LONG, MPI_MAX);
+    if(striped)
+    {
+        /// The worker buffers are private. The symmetric heap only holds
+        /// the stripes
+        i_buf = memory->alloc_char(i_size);
+        o_buf = memory->alloc_char(o_size);
+
+        i_base = memory->alloc_long(comm->nprocs);
+        o_base = memory->alloc_long(comm->nprocs);
+
+        i_chunk = create_stripes(i_size, i_base, &i_stripe);
+        o_chunk = create_stripes(o_size, o_base, &o_stripe);
+    }
+    else
+    {
+        /// We need to make sure that all processing elements call
+        /// shmalloc with 
+        comm->allreduce(MPI_IN_PLACE, &i_size, 1, MPI_LONG, MPI_MAX);
+        comm->allreduce(MPI_IN_PLACE, &o_size, 1, MPI_LONG, MPI_MAX);
+
+        /// Colletive calls. Note that the memory->shmalloc() function
+        /// allocates on each processing element the maximum of all the 
+        i_buf = memory->shmalloc(i_size);
+        o_buf = memory->shmalloc(o_size);
+    }
 
-    /// Colletive calls. Note that the memory->shmalloc() function
-    /// allocates on each processing element the maximum of all the 
-    i_buf = memory->shmalloc(i_size);
-    o_buf = memory->shmalloc(o_size);
+    /// Collective calls. The counters start at zero
+    pSync = (long* )memory->shmalloc(_SHMEM_BARRIER_SYNC_SIZE*sizeof(long));
+    sig   = (long* )memory->shmalloc(SIG_NUM*sizeof(long));
+
+    std::fill(pSync, pSync + _SHMEM_BARRIER_SYNC_SIZE, (long )_SHMEM_SYNC_VALUE);
+    std::fill(sig, sig + SIG_NUM, 0L);
+
+    peer_bytes = memory->alloc_long(comm->nprocs);
+    num_calls  = 0;
+
+    i_bytes_per_call = 0;
+    o_bytes_per_call = 0;
+    i_bytes_expected = 0;
+    o_bytes_expected = 0;
+
+    i_worker_copy = 0;
+    o_worker_copy = 0;
+    /// Force an exchange in the first call
+    i_worker_len  = -1;
+    o_worker_len  = -1;
+    i_size_copy   = 0;
+    o_size_copy   = 0;
+
+    /// Make sure that the initial values are set on all processing
+    /// elements before they are used
+    comm->barrier();
 }
 
 mexico::RuntimeImpl_SHMEM::~RuntimeImpl_SHMEM()
 {
-    memory->shfree(&i_buf);
-    memory->shfree(&o_buf);
+    if(striped)
+    {
+        memory->free_char((char** )&i_buf);
+        memory->free_char((char** )&o_buf);
+        memory->free_long(&i_base);
+        memory->free_long(&o_base);
+        memory->shfree((void** )&i_stripe);
+        memory->shfree((void** )&o_stripe);
+    }
+    else
+    {
+        memory->shfree(&i_buf);
+        memory->shfree(&o_buf);
+    }
+    memory->shfree((void** )&pSync);
+    memory->shfree((void** )&sig);
+
+    memory->free_long(&peer_bytes);
+
+    memory->free_int(&i_worker_copy);
+    memory->free_int(&o_worker_copy);
+
+    memory->free_int(&pes);
+
+    delete i_runs;
+    delete o_runs;
+}
+
+void mexico::RuntimeImpl_SHMEM::create_active_set()
+{
+    int i, stride;
+
+    pes = memory->alloc_int(comm->nprocs);
+    for(i = 0; i < comm->nprocs; ++i)
+        pes[i] = comm->translate_to_MPI_COMM_WORLD(i);
+
+    /// The processing elements of comm form an active set if their
+    /// numbers are PE_start + 2^logPE_stride*i for i = 0, ..., nprocs-1
+    PE_start     = pes[0];
+    PE_size      = comm->nprocs;
+    logPE_stride = 0;
+    active_set   = true;
+
+    if(comm->nprocs > 1)
+    {
+        stride = pes[1] - pes[0];
+
+        for(logPE_stride = 0; stride > (1 << logPE_stride); ++logPE_stride);
+
+        active_set = (stride == (1 << logPE_stride));
+        for(i = 1; i < comm->nprocs and active_set; ++i)
+            active_set = (pes[i] == PE_start + stride*i);
+    }
+}
+
+void mexico::RuntimeImpl_SHMEM::barrier()
+{
+    /// Complete the outstanding non-blocking puts and gets
+    shmem_quiet();
+
+    if(active_set)
+        shmem_barrier(PE_start, logPE_stride, PE_size, pSync);
+    else
+        comm->barrier();
+}
+
+long mexico::RuntimeImpl_SHMEM::create_stripes(long size, long* base, char** stripe)
+{
+    long chunk;
+
+    comm->allgather(&size, 1, MPI_LONG, base, 1, MPI_LONG);
+
+    /// Exclusive scan
+    std::partial_sum(base, base + comm->nprocs, base);
+    chunk = base[comm->nprocs-1];
+    std::copy_backward(base, base + comm->nprocs - 1, base + comm->nprocs);
+    base[0] = 0;
+
+    chunk = std::max(1L, (chunk + comm->nprocs - 1)/comm->nprocs);
+
+    /// Collective call
+    *stripe = (char* )memory->shmalloc(chunk);
+
+    return chunk;
+}
+
+void mexico::RuntimeImpl_SHMEM::put(char* src, long offset, long len, int w)
+{
+    long g, n;
+
+    if(not striped)
+    {
+        shmem_putmem_nbi(((char* )this->i_buf) + offset, src, len, pes[w]);
+        return;
+    }
+
+    /// Split the range at the stripe boundaries
+    for(g = i_base[w] + offset; len > 0; g += n, src += n, len -= n)
+    {
+        n = std::min(len, i_chunk - g%i_chunk);
+        shmem_putmem_nbi(i_stripe + g%i_chunk, src, n, pes[g/i_chunk]);
+    }
+}
+
+void mexico::RuntimeImpl_SHMEM::get(char* dst, long offset, long len, int w)
+{
+    long g, n;
+
+    if(not striped)
+    {
+        shmem_getmem_nbi(dst, ((char* )this->o_buf) + offset, len, pes[w]);
+        return;
+    }
+
+    for(g = o_base[w] + offset; len > 0; g += n, dst += n, len -= n)
+    {
+        n = std::min(len, o_chunk - g%o_chunk);
+        shmem_getmem_nbi(dst, o_stripe + g%o_chunk, n, pes[g/o_chunk]);
+    }
+}
+
+void mexico::RuntimeImpl_SHMEM::fetch_stripes()
+{
+    long g, n, len;
+    char* dst;
+
+    dst = (char* )this->i_buf;
+    len = job->i_N*job_i_extent;
+
+    for(g = i_base[comm->myrank]; len > 0; g += n, dst += n, len -= n)
+    {
+        n = std::min(len, i_chunk - g%i_chunk);
+        shmem_getmem_nbi(dst, i_stripe + g%i_chunk, n, pes[g/i_chunk]);
+    }
+
+    shmem_quiet();
+}
+
+void mexico::RuntimeImpl_SHMEM::store_stripes()
+{
+    long g, n, len;
+    char* src;
+
+    src = (char* )this->o_buf;
+    len = job->o_N*job_o_extent;
+
+    for(g = o_base[comm->myrank]; len > 0; g += n, src += n, len -= n)
+    {
+        n = std::min(len, o_chunk - g%o_chunk);
+        shmem_putmem_nbi(o_stripe + g%o_chunk, src, n, pes[g/o_chunk]);
+    }
 }
 
+void mexico::RuntimeImpl_SHMEM::wait_for_workers(int num_vals, int max_worker_per_val, int* worker, long size, long calls)
+{
+    int i, w;
+
+    std::fill(peer_bytes, peer_bytes + comm->nprocs, 0L);
+
+    for(i = 0; i < num_vals*max_worker_per_val; ++i)
+        if(-1 != (w = worker[i]))
+            peer_bytes[w] += size;
+
+    for(w = 0; w < comm->nprocs; ++w)
+        if(peer_bytes[w] > 0)
+            while(shmem_long_atomic_fetch(&sig[SIG_O_READY], pes[w]) < calls);
+}
+
+void mexico::RuntimeImpl_SHMEM::update_expected(int i_num_vals, int i_max_worker_per_val, int* i_worker, long i_size,
+                                              int o_num_vals, int o_max_worker_per_val, int* o_worker, long o_size)
+{
+    long k, i_len, o_len, bytes[2];
+    long* all_bytes;
+    int w, changed, any_changed;
+
+    i_len = (long )i_num_vals*i_max_worker_per_val;
+    o_len = (long )o_num_vals*o_max_worker_per_val;
+
+    changed = !(i_len  == i_worker_len &&
+                o_len  == o_worker_len &&
+                i_size == i_size_copy  &&
+                o_size == o_size_copy  &&
+                std::equal(i_worker, i_worker + i_len, i_worker_copy) &&
+                std::equal(o_worker, o_worker + o_len, o_worker_copy));
+
+    comm->allreduce(&changed, &any_changed, 1, MPI_INT, MPI_MAX);
+
+    if(!any_changed)
+        return;
+
+    MEXICO_WRITE(Log::DEBUG, "pattern changed, exchanging the expected byte counts");
+
+    /// Interleaved number of bytes put into and read from each worker
+    all_bytes = memory->alloc_long(2*comm->nprocs);
+    std::fill(all_bytes, all_bytes + 2*comm->nprocs, 0L);
+
+    for(k = 0; k < i_len; ++k)
+        if(-1 != (w = i_worker[k]))
+            all_bytes[2*w] += i_size;
+
+    for(k = 0; k < o_len; ++k)
+        if(-1 != (w = o_worker[k]))
+            all_bytes[2*w+1] += o_size;
+
+    comm->reduce_scatter_block(all_bytes, bytes, 2, MPI_LONG, MPI_SUM);
+
+    memory->free_long(&all_bytes);
+
+    i_bytes_per_call = bytes[0];
+    o_bytes_per_call = bytes[1];
+
+    if(!instance->pe_is_worker && (i_bytes_per_call > 0 || o_bytes_per_call > 0))
+        MEXICO_FATAL("Processing element %d is not a worker but has %ld input and %ld output bytes assigned", comm->myrank, i_bytes_per_call, o_bytes_per_call);
+
+    MEXICO_WRITE(Log::DEBUG, "i_bytes_per_call = %ld, o_bytes_per_call = %ld", i_bytes_per_call, o_bytes_per_call);
+
+    memory->realloc_int(&i_worker_copy, i_len);
+    memory->realloc_int(&o_worker_copy, o_len);
+
+    std::copy(i_worker, i_worker + i_len, i_worker_copy);
+    std::copy(o_worker, o_worker + o_len, o_worker_copy);
+
+    i_worker_len = i_len;
+    o_worker_len = o_len;
+    i_size_copy  = i_size;
+    o_size_copy  = o_size;
+}
+
+void mexico::RuntimeImpl_SHMEM::signal_inputs()
+{
+    int w;
+
+    /// Deliver the puts before the counters are incremented
+    shmem_quiet();
+
+    for(w = 0; w < comm->nprocs; ++w)
+        if(peer_bytes[w] > 0)
+            shmem_long_atomic_add(&sig[SIG_I_BYTES], peer_bytes[w], pes[w]);
+
+    /// The worker can start as soon as its input buffer is complete. The
+    /// gets of the previous call from its output buffer must be complete
+    /// as well since the job overwrites it
+    if(instance->pe_is_worker)
+    {
+        i_bytes_expected += i_bytes_per_call;
+
+        shmem_long_wait_until(&sig[SIG_I_BYTES], _SHMEM_CMP_GE, i_bytes_expected);
+        shmem_long_wait_until(&sig[SIG_O_BYTES], _SHMEM_CMP_GE, o_bytes_expected);
+
+        /// Nobody can add to the counters before our output is ready
+        if(shmem_long_atomic_fetch(&sig[SIG_I_BYTES], pes[comm->myrank]) != i_bytes_expected ||
+           shmem_long_atomic_fetch(&sig[SIG_O_BYTES], pes[comm->myrank]) != o_bytes_expected)
+            MEXICO_FATAL("Counters do not match the expected number of bytes");
+    }
+}
+
+void mexico::RuntimeImpl_SHMEM::signal_outputs()
+{
+    int w;
+
+    /// Complete the gets before the workers are told that we are done
+    shmem_quiet();
+
+    for(w = 0; w < comm->nprocs; ++w)
+        if(peer_bytes[w] > 0)
+            shmem_long_atomic_add(&sig[SIG_O_BYTES], peer_bytes[w], pes[w]);
+
+    o_bytes_expected += o_bytes_per_call;
+
+    ++num_calls;
+}
 
 void mexico::RuntimeImpl_SHMEM::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_type, int i_num_vals, int i_max_worker_per_val,
                                        int* i_worker, int* i_offsets,
                                        void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
                                        int* o_worker, int* o_offsets)
 {
-    int i, j, w, w0, lo, lo0, i0, nv;
-    MPI_Aint i_extent;
+    int i, j, r, w, w0, lo, lo0, i0, nv;
+    MPI_Aint i_extent, o_extent;
 
     MPI_Type_extent(i_type, &i_extent);
 
     /// ----------------------------------------------------------------------
     /// Exchange the data
-    shmem_barrier_all();
+    if(signal)
+    {
+        MPI_Type_extent(o_type, &o_extent);
+
+        update_expected(i_num_vals, i_max_worker_per_val, i_worker, i_cnt*i_extent,
+                        o_num_vals, o_max_worker_per_val, o_worker, o_cnt*o_extent);
+
+        wait_for_workers(i_num_vals, i_max_worker_per_val, i_worker, i_cnt*i_extent, num_calls);
+    }
+    else
+        barrier();
+
+    if(sort)
+    {
+        i_runs->build(i_num_vals, i_max_worker_per_val, i_worker, i_offsets, false);
+        i_runs->gather(i_buf, i_cnt*i_extent);
 
+        for(r = 0; r < i_runs->num_runs; ++r)
+            put(i_runs->staging + i_runs->run_first[r]*i_cnt*i_extent, i_cnt*i_runs->run_offset[r]*i_extent,
+                i_cnt*i_runs->run_len[r]*i_extent, i_runs->run_worker[r]);
+    }
+    else
     if(not coalesce)
     {
         for(j = 0; j < i_max_worker_per_val; ++j)
@@ -115,7 +458,7 @@ void mexico::RuntimeImpl_SHMEM::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_
                 if(-1 == (w = i_worker[i + i_num_vals*j]))
                     continue;
 
-                shmem_putmem(((char* )this->i_buf)+i_cnt*i_offsets[i + i_num_vals*j]*i_extent, &((char* )i_buf)[i*i_cnt*i_extent], i_cnt*i_extent, w);
+                put(&((char* )i_buf)[i*i_cnt*i_extent], i_cnt*i_offsets[i + i_num_vals*j]*i_extent, i_cnt*i_extent, w);
             }
     }
     else
@@ -151,7 +494,7 @@ void mexico::RuntimeImpl_SHMEM::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_
 
                 /// The item does not match the bucket so we send the
                 /// current bucket
-                shmem_putmem(((char* )this->i_buf) + lo0*i_extent, &((char* )i_buf)[i0*i_cnt*i_extent], i_cnt*nv*i_extent, w0);
+                put(&((char* )i_buf)[i0*i_cnt*i_extent], lo0*i_extent, i_cnt*nv*i_extent, w0);
 
                 /// Our bucket is empty
                 lo0 = lo;
@@ -161,11 +504,19 @@ void mexico::RuntimeImpl_SHMEM::pre_comm(void* i_buf, int i_cnt, MPI_Datatype i_
             }
 
             /// Make sure the bucket is empty on start of the next iteration
-            shmem_putmem(((char* )this->i_buf) + lo0*i_extent, &((char* )i_buf)[i0*i_cnt*i_extent], i_cnt*nv*i_extent, w0);
+            if(nv > 0)
+                put(&((char* )i_buf)[i0*i_cnt*i_extent], lo0*i_extent, i_cnt*nv*i_extent, w0);
         }
     }
 
-    shmem_barrier_all();
+    if(signal)
+        signal_inputs();
+    else
+        barrier();
+
+    /// Copy the input of the worker out of the stripes
+    if(striped and instance->pe_is_worker)
+        fetch_stripes();
     /// ----------------------------------------------------------------------
 }
 
@@ -174,15 +525,40 @@ void mexico::RuntimeImpl_SHMEM::post_comm(void* i_buf, int i_cnt, MPI_Datatype i
                                         void* o_buf, int o_cnt, MPI_Datatype o_type, int o_num_vals, int o_max_worker_per_val,
                                         int* o_worker, int* o_offsets)
 {
-    int i, j, w, w0, lo, lo0, i0, nv;
+    int i, j, r, w, w0, lo, lo0, i0, nv;
     MPI_Aint o_extent;
     
     MPI_Type_extent(o_type, &o_extent);
 
     /// ----------------------------------------------------------------------
     /// Exchange the data
-    shmem_barrier_all();
+    if(signal)
+    {
+        /// The output of this call is ready
+        if(instance->pe_is_worker)
+            shmem_long_atomic_inc(&sig[SIG_O_READY], pes[comm->myrank]);
+
+        wait_for_workers(o_num_vals, o_max_worker_per_val, o_worker, o_cnt*o_extent, num_calls + 1);
+    }
+    else
+    {
+        /// Copy the output of the worker into the stripes
+        if(striped and instance->pe_is_worker)
+            store_stripes();
+
+        barrier();
+    }
+
+    if(sort)
+    {
+        o_runs->build(o_num_vals, o_max_worker_per_val, o_worker, o_offsets, true);
+        o_runs->alloc_staging(o_cnt*o_extent);
 
+        for(r = 0; r < o_runs->num_runs; ++r)
+            get(o_runs->staging + o_runs->run_first[r]*o_cnt*o_extent, o_cnt*o_runs->run_offset[r]*o_extent,
+                o_cnt*o_runs->run_len[r]*o_extent, o_runs->run_worker[r]);
+    }
+    else
     if(not coalesce)
     {
         for(j = 0; j < o_max_worker_per_val; ++j)
@@ -191,7 +567,7 @@ void mexico::RuntimeImpl_SHMEM::post_comm(void* i_buf, int i_cnt, MPI_Datatype i
                 if(-1 == (w = o_worker[i + o_num_vals*j]))
                     continue;
 
-                shmem_getmem(&((char* )o_buf)[o_cnt*o_extent*(i + o_num_vals*j)], ((char* )this->o_buf) + o_cnt*o_offsets[i + o_num_vals*j]*o_extent, o_cnt*o_extent, w);
+                get(&((char* )o_buf)[o_cnt*o_extent*(i + o_num_vals*j)], o_cnt*o_offsets[i + o_num_vals*j]*o_extent, o_cnt*o_extent, w);
             }
     }
     else
@@ -227,7 +603,7 @@ void mexico::RuntimeImpl_SHMEM::post_comm(void* i_buf, int i_cnt, MPI_Datatype i
 
                 /// The item does not match the bucket so we send the
                 /// current bucket
-                shmem_getmem(&((char* )o_buf)[o_cnt*o_extent*(i0 + o_num_vals*j)], ((char* )this->o_buf) + lo0*o_extent, o_cnt*nv*o_extent, w0);
+                get(&((char* )o_buf)[o_cnt*o_extent*(i0 + o_num_vals*j)], lo0*o_extent, o_cnt*nv*o_extent, w0);
 
                 /// Our bucket is empty
                 lo0 = lo;
@@ -237,11 +613,18 @@ void mexico::RuntimeImpl_SHMEM::post_comm(void* i_buf, int i_cnt, MPI_Datatype i
             }
 
             /// Make sure the bucket is empty on start of the next iteration
-            shmem_getmem(&((char* )o_buf)[o_cnt*o_extent*(i0 + o_num_vals*j)], ((char* )this->o_buf) + lo0*o_extent, o_cnt*nv*o_extent, w0);
+            if(nv > 0)
+                get(&((char* )o_buf)[o_cnt*o_extent*(i0 + o_num_vals*j)], lo0*o_extent, o_cnt*nv*o_extent, w0);
         }
     }
 
-    shmem_barrier_all();
+    if(signal)
+        signal_outputs();
+    else
+        barrier();
+
+    if(sort)
+        o_runs->scatter(o_buf, o_cnt*o_extent);
     /// ----------------------------------------------------------------------
 }
 #endif
@@ -43,6 +43,8 @@
 namespace mexico
 {
 
+class Runs;
+
 /// RuntimeImpl_SHMEM: Runtime implementation based on the shmem API
 class RuntimeImpl_SHMEM : public RuntimeImpl
 {
@@ -88,6 +90,136 @@ public:
 private:
     /// Whether or not to coalesce puts and gets
     bool coalesce;
+    /// Sort the entries by worker and remote offset, stage the values in
+    /// this order and move each run of consecutive offsets with a single
+    /// put or get (see Runs)
+    bool sort;
+    /// Sorted entries of the input and output matrices. Only allocated
+    /// if sort is true
+    Runs* i_runs;
+    Runs* o_runs;
+
+    /// Number of the processing element (in MPI_COMM_WORLD) of each rank
+    /// in comm. The puts and gets are addressed with these numbers
+    int* pes;
+    /// Whether the processing elements of comm form an active set in
+    /// which case shmem_barrier() is used instead of shmem_barrier_all()
+    bool active_set;
+    int PE_start;
+    int logPE_stride;
+    int PE_size;
+    /// Symmetric work array for shmem_barrier()
+    long* pSync;
+
+    /// Replace the barriers by counters on the workers: The sources
+    /// add the number of bytes put into the input buffer of a worker
+    /// to a counter on the worker and the worker starts the job as soon
+    /// as its whole input buffer has been written. The requesters
+    /// wait until the output of the workers they read from is ready and
+    /// add the number of bytes they read to a counter on the worker.
+    /// The number of bytes each worker expects per call is exchanged
+    /// whenever the worker matrices change on any rank
+    bool signal;
+
+    /// Counters in sig
+    enum
+    {
+        /// Number of bytes put into the input buffer
+        SIG_I_BYTES = 0,
+        /// Number of calls for which the output buffer is ready
+        SIG_O_READY = 1,
+        /// Number of bytes read from the output buffer
+        SIG_O_BYTES = 2,
+        SIG_NUM     = 3
+    };
+
+    /// Symmetric array with the counters. Only used if signal is true
+    long* sig;
+    /// Number of bytes exchanged with each rank in the current phase
+    long* peer_bytes;
+    /// Number of completed calls
+    long num_calls;
+    /// Number of bytes put into our input buffer and read from our output
+    /// buffer per call
+    long i_bytes_per_call;
+    long o_bytes_per_call;
+    /// Value of SIG_I_BYTES once the input of the current call is complete
+    /// and of SIG_O_BYTES once the gets of the previous call are done
+    long i_bytes_expected;
+    long o_bytes_expected;
+    /// Copy of the worker matrices and sizes of the last call used to
+    /// detect changes
+    int* i_worker_copy;
+    int* o_worker_copy;
+    long i_worker_len;
+    long o_worker_len;
+    long i_size_copy;
+    long o_size_copy;
+
+    /// Do not allocate the worker buffers on the symmetric heap but
+    /// distribute them over all processing elements: The input (output)
+    /// buffers of all workers are concatenated and split into stripes of
+    /// equal size, one per processing element. The sources put into and
+    /// the requesters get from the stripes. The worker copies its input
+    /// out of the stripes before the job and its output into the stripes
+    /// after the job. Each processing element allocates the sum of the
+    /// worker buffer sizes divided by the number of processing elements
+    /// instead of the maximum
+    bool striped;
+    /// Start of the buffers of each rank in the concatenation. Only
+    /// used if striped is true
+    long* i_base;
+    long* o_base;
+    /// Size of the stripes
+    long i_chunk;
+    long o_chunk;
+    /// Symmetric stripes
+    char* i_stripe;
+    char* o_stripe;
+
+    /// Compute base, allocate the stripe and return the stripe size. The
+    /// function is collective
+    long create_stripes(long size, long* base, char** stripe);
+
+    /// Put len bytes into the input buffer of worker w at the given byte
+    /// offset
+    void put(char* src, long offset, long len, int w);
+
+    /// Get len bytes from the output buffer of worker w at the given byte
+    /// offset
+    void get(char* dst, long offset, long len, int w);
+
+    /// On a worker, copy the input buffer out of the stripes
+    void fetch_stripes();
+
+    /// On a worker, copy the output buffer into the stripes
+    void store_stripes();
+
+    /// Compute peer_bytes and wait until the output buffers of all
+    /// workers we exchange data with are ready for the given number of
+    /// calls
+    void wait_for_workers(int num_vals, int max_worker_per_val, int* worker, long size, long calls);
+
+    /// Update i_bytes_per_call and o_bytes_per_call if the worker matrices
+    /// or the sizes of the values changed on any rank. The function is
+    /// collective
+    void update_expected(int i_num_vals, int i_max_worker_per_val, int* i_worker, long i_size,
+                         int o_num_vals, int o_max_worker_per_val, int* o_worker, long o_size);
+
+    /// Increment the input counters of the workers and, on a worker, wait
+    /// for the input
+    void signal_inputs();
+
+    /// Increment the output counters of the workers
+    void signal_outputs();
+
+    /// Compute pes and check whether they form an active set
+    void create_active_set();
+
+    /// Complete all outstanding puts and gets and synchronize the
+    /// processing elements of comm. Processing elements outside of comm
+    /// are not involved
+    void barrier();
 
 };
 
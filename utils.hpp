@@ -84,6 +84,20 @@ void incl_scan(Tp* start, Tp* end, Tp* out)
         *out++ = val = val + *start++;
 }
 
+/// Count the positive entries
+template<typename Tp>
+int count_positive(Tp* start, Tp* end)
+{
+    int n;
+
+    n = 0;
+    while(start != end)
+        if(*start++ > 0)
+            ++n;
+
+    return n;
+}
+
 }
 
 #endif